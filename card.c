@@ -20,6 +20,7 @@
 #include <ctype.h>
 #include <string.h>
 #include "card.h"
+#include "rng.h"
 
 /** A card having a particular suit and rank. */
 struct card_impl
@@ -164,292 +165,6 @@ write_card (enum card_suit_rank csr, card *c)
     }
 }
 
-struct card_collection;
-
-/** A collection of cards. */
-struct card_collection
-{
-  struct card_collection *prev; /**< The previous card in the collection. */
-  struct card_collection *next; /**< The next card in the collection. */
-  const card *c; /**< A card in a collection. */
-};
-
-/**
- * Inserts a card having the specified suit and rank into a collection.
- *
- * @param [in] head a pointer to the first element of the collection (this
- *                  can be NULL if the collection is still empty).
- * @param [in] c the card to be inserted into the collection.
- * @param [in] sorter a callback function that determines the placement of the
- *                    card in the collection.
- *
- * @return 0 if the addition is successful or non-zero if a new element cannot
- *         be created.
- */
-static int
-insert_into_collection (struct card_collection **head, const card *c,
-			card_sorter sorter)
-{
-  struct card_collection *col;
-  struct card_collection *itr;
-
-  col = malloc (sizeof (*col));
-  if (col == NULL)
-    {
-      destroy_card (&c);
-      return 1;
-    }
-
-  col->c = c;
-
-  if (*head == NULL)
-    {
-      col->prev = col;
-      col->next = col;
-      *head = col;
-
-      return 0;
-    }
-
-  itr = *head;
-  if (sorter (NULL, c, itr->c))
-    {
-      col->prev = itr->prev;
-      col->next = itr;
-
-      itr->prev = col;
-      col->prev->next = col;
-
-      *head = col;
-
-      return 0;
-    }
-  while (itr->next != *head)
-    {
-      if (sorter (itr->c, c, itr->next->c))
-	{
-	  col->prev = itr;
-	  col->next = itr->next;
-
-	  itr->next = col;
-	  col->next->prev = col;
-
-	  return 0;
-	}
-      itr = itr->next;
-    }
-  if (sorter (itr->c, c, NULL))
-    {
-      col->prev = itr;
-      col->next = *head;
-
-      itr->next = col;
-      col->next->prev = col;
-
-      return 0;
-    }
-
-  return 0;
-}
-
-/**
- * Iterates a collection through the next pointer.
- *
- * @param [in] head the pointer to the first element in the collection. NULL
- *                  means an empty collection.
- * @param [in,out] itr the pointer by which the caller can operate on the
- *                     element under the iterator. The iteration state is
- *                     saved in this pointer. The pointer should first point to
- *                     NULL. You can point itr to the address of an element in
- *                     the collection to start the
- *                     iteration with the element <strong>after</strong> the
- *                     pointed element onward.
- *
- * @return zero if all elements has been iterated or non-zero if there are still
- *         some elements to be iterated.
- */
-static int
-iterate_collection (struct card_collection *head, struct card_collection **itr)
-{
-  if (head == NULL)
-    {
-      return 0;
-    }
-
-  if (*itr == NULL)
-    {
-      *itr = head;
-    }
-  else
-    {
-      *itr = (*itr)->next;
-      if (*itr == head)
-	{
-	  *itr = NULL;
-	}
-    }
-
-  return *itr != NULL;
-}
-
-/**
- * Appends a new entry into the end of the collection.
- *
- * @param [in] head a pointer to the head of the collection. It can point to
- *                  NULL if the collection is empty.
- * @param [in] new the new entry to be appended.
- */
-static void
-append_into_collection (struct card_collection **head, struct card_collection *new)
-{
-  if (*head == NULL)
-    {
-      new->prev = new;
-      new->next = new;      
-      *head = new;
-
-      return;
-    }
-
-  new->prev = (*head)->prev;
-  new->next = *head;
-  new->prev->next = new;
-  new->next->prev = new;
-}
-
-/**
- * Detach an entry from the collection.
- * This function is safe to be used during iteration because the detached entry
- * is not freed and its previous and next pointers are still valid although the
- * entry is no longer recognized as a part of the collection (i.e., subsequent
- * iteration on the collection will not iterate the detached entry).
- * It is your responsibility to free the detached entry as well as its payload.
- *
- * @param [in] entry the entry to be detached.
- */
-static void
-detach_from_collection (const struct card_collection *entry)
-{
-  entry->next->prev = entry->prev;
-  entry->prev->next = entry->next;
-}
-
-/**
- * The callback function used to free the payload of an entry in the collection.
- *
- * @param [in] payload the pointer to the payload to be freed.
- */
-typedef void (*payload_freer) (void **payload);
-
-static void
-destroy_card_payload (void **payload)
-{
-  destroy_card ((const card **) payload);
-}
-
-/**
- * Reclaims the memory space that was allocated for the entry as well as
- * setting the pointer to NULL as a safe guard. Passing a pointer to NULL is,
- * safe but not a NULL pointer. A function callback to free the payload should
- * be provided unless the payload should not be freed.
- *
- * @param [in] entry the pointer pointing to the entry to be freed.
- * @param [in] freer the callback function used to free the payload of an entry
- *                   or NULL if the payload should not be freed.
- */
-static void
-destroy_collection_entry (struct card_collection **entry, payload_freer freer)
-{
-  if (*entry == NULL)
-    {
-      return;
-    }
-
-  if (freer != NULL)
-    {
-      freer ((void *) &(*entry)->c);
-    }
-  free ((void *) *entry);
-
-  *entry = NULL;
-}
-
-/**
- * Reclaims the memory space that was allocated for the entry under an iteration.
- * Entry and head must point to valid entries in a collection. Upon completion,
- * invocation of iterate_collection() on the entry will continue with the next
- * entry. If head gets removed, head will be adjusted to point to the next entry
- * in the chain. A function callback to free the payload should be provided
- * unless the payload should not be freed.
- *
- * @param [in] head the pointer pointing to the head of the collection.
- * @param [in] entry the pointer pointing to the entry to be freed.
- * @param [in] freer the callback function used to free the payload of the entry
- *                   or NULL if the payload should not be freed.
- */
-static void
-remove_from_collection_under_itr (struct card_collection **head,
-				  struct card_collection **entry,
-				  payload_freer freer)
-{
-  struct card_collection *entry_to_remove = NULL;
-  int is_entry_head = (*head == *entry);
-
-  detach_from_collection (*entry);
-  entry_to_remove = *entry;
-  *entry = (*entry)->prev;
-  if (*entry == entry_to_remove)
-    {
-      *entry = NULL;
-    }
-  destroy_collection_entry (&entry_to_remove, freer);
-
-  if (is_entry_head && *head != *entry) // the head gets deleted;
-    {
-      *head = ((*entry == NULL) ? NULL : (*entry)->next);
-    }
-}
-
-/**
- * Reclaims the memory space that was allocated for the collection as well as
- * setting the pointer to NULL as a safe guard. Passing a pointer to NULL is,
- * safe but not a NULL pointer. A function callback to free the payload should
- * be provided unless the payload should not be freed.
- *
- * @param [in] col_ptr the pointer pointing to the collection to be freed.
- * @param [in] freer the callback function used to free the payload of an entry
- *                   or NULL if the payload should not be freed.
- */
-static void
-destroy_collection (struct card_collection **col_ptr, payload_freer freer)
-{
-  struct card_collection *head = *col_ptr;
-  struct card_collection *head_next;
-
-  if (head == NULL)
-    {
-      return;
-    }
-
-  head->prev->next = NULL; /* break the ring */
-
-  do
-    {
-      head_next = head->next;
-
-      if (freer != NULL)
-	{
-	  freer ((void *) &head->c);
-	}
-      free (head);
-
-      head = head_next;
-    }
-  while (head != NULL);
-
-  *col_ptr = NULL;
-}
-
 /** A hand of cards. */
 struct card_hand_impl
 {
@@ -459,7 +174,10 @@ struct card_hand_impl
 		       * The callback function used to determine the place of
 		       * insertion of a new card.
 		       */
-  struct card_collection *cards; /**< The cards at hand. */
+  const card *cards[]; /**<
+			* The cards at hand in the sorted order allocated
+			* inline for max cards.
+			*/
 };
 
 /** A deck of cards. */
@@ -467,6 +185,7 @@ struct card_deck_impl
 {
   char card_count; /**< The number of cards in the deck. */
   card cards[CARD_COUNT]; /**< The cards in the deck. */
+  rng *rng; /**< The source of randomness or NULL to use lrand48(). */
 };
 
 enum card_suit_rank
@@ -555,7 +274,8 @@ strtocard (const char *str)
   enum card_suit_rank csr;
   size_t char_count = strlen (str);
 
-  if (char_count != 2)
+  if (char_count != 2
+      && (char_count != 3 || str[1] != '1' || str[2] != '0'))
     {
       return NULL;
     }
@@ -723,7 +443,7 @@ sort_card_by_rank (const card *before, const card *new, const card *after)
 card_hand *
 create_hand (unsigned char max, card_sorter sorter)
 {
-  struct card_hand_impl *h = malloc (sizeof (*h));
+  struct card_hand_impl *h = malloc (sizeof (*h) + max * sizeof (h->cards[0]));
 
   if (h == NULL)
     {
@@ -738,7 +458,6 @@ create_hand (unsigned char max, card_sorter sorter)
   h->max = max;
   h->len = 0;
   h->sorter = sorter;
-  h->cards = NULL;
 
   return h;
 }
@@ -747,19 +466,78 @@ void
 reset_hand (card_hand *h)
 {
   h->len = 0;
+}
+
+/**
+ * Finds the place where a card should be inserted into a hand.
+ *
+ * @param [in] h the hand into which the card is to be inserted.
+ * @param [in] c the card to be inserted.
+ *
+ * @return the position of the card in the hand after the insertion or a
+ *         negative number if the sorter of the hand accepts no place.
+ */
+static int
+find_insertion_place (const card_hand *h, const card *c)
+{
+  int i;
+  int len = h->len;
+
+  if (h->sorter == sort_card_after)
+    {
+      return len;
+    }
+
+  if (h->sorter == sort_card_by_rank)
+    {
+      uint8_t r = c->card & RANK_BITS;
+
+      for (i = len; i > 0 && (h->cards[i - 1]->card & RANK_BITS) >= r; i--)
+	{
+	}
+
+      return i;
+    }
+
+  if (len == 0)
+    {
+      return 0;
+    }
+
+  for (i = 0; i <= len; i++)
+    {
+      if (h->sorter (i == 0 ? NULL : h->cards[i - 1], c,
+		     i == len ? NULL : h->cards[i]))
+	{
+	  return i;
+	}
+    }
 
-  destroy_collection (&h->cards, NULL);
+  return -1;
 }
 
 void
 insert_into_hand (card_hand *h, const card *c)
 {
+  int i;
+  int pos;
+
   if (h->max == h->len)
     {
       return;
     }
 
-  insert_into_collection (&h->cards, c, h->sorter);
+  pos = find_insertion_place (h, c);
+  if (pos < 0)
+    {
+      return;
+    }
+
+  for (i = h->len; i > pos; i--)
+    {
+      h->cards[i] = h->cards[i - 1];
+    }
+  h->cards[pos] = c;
   h->len++;
 }
 
@@ -778,90 +556,117 @@ get_max_of_hand (const card_hand *h)
 enum card_rank
 get_max_rank_of_hand (const card_hand *h)
 {
-  struct card_collection *itr = NULL;
-  enum card_rank cr = INVALID_RANK;
+  uint8_t max_bits = INVALID_CARD_BITS;
+  int i;
 
   if (h->len == 0)
     {
-      return cr;
+      return INVALID_RANK;
     }
 
-  while (iterate_collection (h->cards, &itr))
+  for (i = 0; i < h->len; i++)
     {
-      enum card_rank this_cr = get_card_rank (itr->c);
+      uint8_t this_bits = h->cards[i]->card & RANK_BITS;
 
-      if (cr == INVALID_RANK)
+      if (this_bits > max_bits)
 	{
-	  cr = this_cr;
-	}
-      else if (this_cr > cr)
-	{
-	  cr = this_cr;
+	  max_bits = this_bits;
 	}
     }
 
-  return cr;
+  return max_bits - ACE_BITS;
+}
+
+void
+count_ranks_in_hand (const card_hand *h, uint8_t rank_counts[RANK_COUNT])
+{
+  int i;
+
+  memset (rank_counts, 0, RANK_COUNT * sizeof (*rank_counts));
+
+  for (i = 0; i < h->len; i++)
+    {
+      rank_counts[(h->cards[i]->card & RANK_BITS) - ACE_BITS]++;
+    }
 }
 
 /**
- * Removes an entry in a hand under an iteration.
+ * Removes a card from a hand by shifting the cards after it.
  *
- * @param [in] h the hand from which the entry is to be removed.
- * @param [in] itr the iterator that is iterating the hand.
- * @param [in] pos the iteration position to be adjusted
- *                 (set to NULL if there is need for one)
+ * @param [in] h the hand from which the card is to be removed.
+ * @param [in] pos the position of the card to be removed.
  */
 static void
-remove_from_hand_under_itr (card_hand *h, struct card_collection **itr,
-			    unsigned long *pos)
+remove_from_hand_at (card_hand *h, int pos)
 {
-  remove_from_collection_under_itr (&h->cards, itr, NULL);
+  int i;
 
   h->len--;
-  if (pos != NULL)
+  for (i = pos; i < h->len; i++)
     {
-      *pos -= 1;
+      h->cards[i] = h->cards[i + 1];
     }
 }
 
 void
-iterate_hand (card_hand *h, card_iterator itr_fn)
+iterate_hand_ctx (card_hand *h, card_iterator_ctx itr_fn, void *ctx)
 {
-  struct card_collection *itr = NULL;
-  unsigned long pos = 0;
-  int is_stopped = 0;
+  int pos = 0;
 
-  while (!is_stopped && iterate_collection (h->cards, &itr))
+  while (pos < h->len)
     {
-      switch (itr_fn (h->len, pos, itr->c))
+      switch (itr_fn (ctx, h->len, pos, h->cards[pos]))
 	{
 	case CONTINUE:
+	  pos++;
 	  break;
 	case BREAK:
-	  is_stopped = 1;
-	  break;
+	  return;
 	case REMOVE_AND_CONTINUE:
-	  remove_from_hand_under_itr (h, &itr, &pos);
+	  remove_from_hand_at (h, pos);
 	  break;
 	case REMOVE_AND_BREAK:
-	  remove_from_hand_under_itr (h, &itr, &pos);
-	  is_stopped = 1;
-	  break;
+	  remove_from_hand_at (h, pos);
+	  return;
 	}
-      pos++;
     }
 }
 
+/** The context of an iterator that does not take any context. */
+struct plain_itr_ctx
+{
+  card_iterator itr_fn; /**< The iterator without any context. */
+};
+
+/** Adapts an iterator without any context to iterate_hand_ctx(). */
+static enum itr_action
+plain_itr (void *ctx, unsigned long len, unsigned long pos, const card *c)
+{
+  return ((struct plain_itr_ctx *) ctx)->itr_fn (len, pos, c);
+}
+
+void
+iterate_hand (card_hand *h, card_iterator itr_fn)
+{
+  struct plain_itr_ctx ctx = {itr_fn};
+
+  iterate_hand_ctx (h, plain_itr, &ctx);
+}
+
 void
 remove_from_hand (card_hand *h, enum card_suit_rank c)
 {
-  struct card_collection *itr = NULL;
+  int pos = 0;
 
-  while (iterate_collection (h->cards, &itr))
+  while (pos < h->len)
     {
-      if (get_card_suit_rank (itr->c) == c)
+      if (get_card_suit_rank (h->cards[pos]) == c)
+	{
+	  remove_from_hand_at (h, pos);
+	}
+      else
 	{
-	  remove_from_hand_under_itr (h, &itr, NULL);
+	  pos++;
 	}
     }
 }
@@ -874,7 +679,6 @@ destroy_hand (card_hand **h_ptr)
       return;
     }
 
-  destroy_collection (&(*h_ptr)->cards, NULL);
   free ((void *) *h_ptr);
 
   *h_ptr = NULL;
@@ -886,6 +690,25 @@ is_card_in_deck (enum card_suit_rank c, const card_deck *d)
   return get_card_suit_rank (&d->cards[c]) == INVALID_CARD;
 }
 
+/**
+ * Draws a random number for dealing from the deck.
+ *
+ * @param [in] d the deck to deal from.
+ * @param [in] n the number of possible outcomes (at most 2^31).
+ *
+ * @return a random number between 0 inclusive and n exclusive.
+ */
+static unsigned long
+draw_random_below (card_deck *d, unsigned long n)
+{
+  if (d->rng != NULL)
+    {
+      return rng_below (d->rng, n);
+    }
+
+  return lrand48 () % n;
+}
+
 const card *
 deal_from_deck (card_deck *d)
 {
@@ -899,7 +722,7 @@ deal_from_deck (card_deck *d)
       return NULL;
     }
 
-  selected_card_idx = lrand48 () % d->card_count;
+  selected_card_idx = draw_random_below (d, d->card_count);
 
   valid_card_idx = 0;
   for (i = 0; i < CARD_COUNT; i++)
@@ -921,6 +744,134 @@ deal_from_deck (card_deck *d)
   return c;
 }
 
+/**
+ * The binomial coefficients C(n, k) for n up to ::CARD_COUNT and k up to
+ * ::MAX_COMBINATION_SIZE forming the table of the combinatorial number system.
+ */
+static const uint32_t binomial[CARD_COUNT + 1][MAX_COMBINATION_SIZE + 1] = {
+  {1, 0, 0, 0, 0, 0, 0, 0},
+  {1, 1, 0, 0, 0, 0, 0, 0},
+  {1, 2, 1, 0, 0, 0, 0, 0},
+  {1, 3, 3, 1, 0, 0, 0, 0},
+  {1, 4, 6, 4, 1, 0, 0, 0},
+  {1, 5, 10, 10, 5, 1, 0, 0},
+  {1, 6, 15, 20, 15, 6, 1, 0},
+  {1, 7, 21, 35, 35, 21, 7, 1},
+  {1, 8, 28, 56, 70, 56, 28, 8},
+  {1, 9, 36, 84, 126, 126, 84, 36},
+  {1, 10, 45, 120, 210, 252, 210, 120},
+  {1, 11, 55, 165, 330, 462, 462, 330},
+  {1, 12, 66, 220, 495, 792, 924, 792},
+  {1, 13, 78, 286, 715, 1287, 1716, 1716},
+  {1, 14, 91, 364, 1001, 2002, 3003, 3432},
+  {1, 15, 105, 455, 1365, 3003, 5005, 6435},
+  {1, 16, 120, 560, 1820, 4368, 8008, 11440},
+  {1, 17, 136, 680, 2380, 6188, 12376, 19448},
+  {1, 18, 153, 816, 3060, 8568, 18564, 31824},
+  {1, 19, 171, 969, 3876, 11628, 27132, 50388},
+  {1, 20, 190, 1140, 4845, 15504, 38760, 77520},
+  {1, 21, 210, 1330, 5985, 20349, 54264, 116280},
+  {1, 22, 231, 1540, 7315, 26334, 74613, 170544},
+  {1, 23, 253, 1771, 8855, 33649, 100947, 245157},
+  {1, 24, 276, 2024, 10626, 42504, 134596, 346104},
+  {1, 25, 300, 2300, 12650, 53130, 177100, 480700},
+  {1, 26, 325, 2600, 14950, 65780, 230230, 657800},
+  {1, 27, 351, 2925, 17550, 80730, 296010, 888030},
+  {1, 28, 378, 3276, 20475, 98280, 376740, 1184040},
+  {1, 29, 406, 3654, 23751, 118755, 475020, 1560780},
+  {1, 30, 435, 4060, 27405, 142506, 593775, 2035800},
+  {1, 31, 465, 4495, 31465, 169911, 736281, 2629575},
+  {1, 32, 496, 4960, 35960, 201376, 906192, 3365856},
+  {1, 33, 528, 5456, 40920, 237336, 1107568, 4272048},
+  {1, 34, 561, 5984, 46376, 278256, 1344904, 5379616},
+  {1, 35, 595, 6545, 52360, 324632, 1623160, 6724520},
+  {1, 36, 630, 7140, 58905, 376992, 1947792, 8347680},
+  {1, 37, 666, 7770, 66045, 435897, 2324784, 10295472},
+  {1, 38, 703, 8436, 73815, 501942, 2760681, 12620256},
+  {1, 39, 741, 9139, 82251, 575757, 3262623, 15380937},
+  {1, 40, 780, 9880, 91390, 658008, 3838380, 18643560},
+  {1, 41, 820, 10660, 101270, 749398, 4496388, 22481940},
+  {1, 42, 861, 11480, 111930, 850668, 5245786, 26978328},
+  {1, 43, 903, 12341, 123410, 962598, 6096454, 32224114},
+  {1, 44, 946, 13244, 135751, 1086008, 7059052, 38320568},
+  {1, 45, 990, 14190, 148995, 1221759, 8145060, 45379620},
+  {1, 46, 1035, 15180, 163185, 1370754, 9366819, 53524680},
+  {1, 47, 1081, 16215, 178365, 1533939, 10737573, 62891499},
+  {1, 48, 1128, 17296, 194580, 1712304, 12271512, 73629072},
+  {1, 49, 1176, 18424, 211876, 1906884, 13983816, 85900584},
+  {1, 50, 1225, 19600, 230300, 2118760, 15890700, 99884400},
+  {1, 51, 1275, 20825, 249900, 2349060, 18009460, 115775100},
+  {1, 52, 1326, 22100, 270725, 2598960, 20358520, 133784560},
+};
+
+unsigned long
+count_combinations_in_deck (const card_deck *d, unsigned char k)
+{
+  if (k > MAX_COMBINATION_SIZE)
+    {
+      return 0;
+    }
+
+  return binomial[(int) d->card_count][k];
+}
+
+void
+deal_combination_at (card_deck *d, unsigned char k, unsigned long idx,
+		     const card **cards)
+{
+  uint8_t pos[MAX_COMBINATION_SIZE]; /* the positions in ascending order */
+  int c = d->card_count;
+  int i, j;
+  uint8_t valid_card_idx;
+
+  /* Unrank the index into the positions among the cards left */
+  for (i = k; i > 0; i--)
+    {
+      while (binomial[c][i] > idx)
+	{
+	  c--;
+	}
+      pos[i - 1] = c;
+      idx -= binomial[c][i];
+    }
+
+  /* Deal the cards at the positions in one pass */
+  valid_card_idx = 0;
+  for (i = 0, j = 0; i < CARD_COUNT && j < k; i++)
+    {
+      card *this_card = &d->cards[i];
+
+      if (get_card_suit_rank (this_card) != INVALID_CARD)
+	{
+	  continue;
+	}
+
+      if (valid_card_idx == pos[j])
+	{
+	  write_card (i, this_card);
+	  cards[j++] = this_card;
+	}
+      valid_card_idx++;
+    }
+
+  d->card_count -= k;
+}
+
+int
+deal_combination_from_deck (card_deck *d, unsigned char k, const card **cards)
+{
+  unsigned long n = count_combinations_in_deck (d, k);
+
+  if (n == 0)
+    {
+      return 1;
+    }
+
+  deal_combination_at (d, k, draw_random_below (d, n), cards);
+
+  return 0;
+}
+
 void
 strip_card_from_deck (enum card_suit_rank c, card_deck *d)
 {
@@ -947,10 +898,39 @@ create_shuffled_deck (void)
   memset (deck, 0, sizeof (*deck));
 
   deck->card_count = CARD_COUNT;
+  deck->rng = NULL;
 
   return deck;
 }
 
+void
+set_deck_rng (card_deck *d, rng *r)
+{
+  d->rng = r;
+}
+
+card_deck *
+copy_deck (const card_deck *d)
+{
+  struct card_deck_impl *deck;
+
+  deck = malloc (sizeof (*deck));
+  if (deck == NULL)
+    {
+      return NULL;
+    }
+
+  reset_deck_from (deck, d);
+
+  return deck;
+}
+
+void
+reset_deck_from (card_deck *d, const card_deck *tmpl)
+{
+  *d = *tmpl;
+}
+
 void
 destroy_deck (card_deck **d_ptr)
 {
@@ -962,3 +942,60 @@ destroy_deck (card_deck **d_ptr)
   free (*d_ptr);
   *d_ptr = NULL;
 }
+
+void
+init_rank_deck (struct rank_deck *d)
+{
+  int i;
+
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      d->rank_counts[i] = SUIT_COUNT;
+    }
+  d->card_count = CARD_COUNT;
+}
+
+int
+strip_rank_from_rank_deck (enum card_rank r, struct rank_deck *d)
+{
+  if (r < ACE || r > K || d->rank_counts[r] == 0)
+    {
+      return 1;
+    }
+
+  d->rank_counts[r]--;
+  d->card_count--;
+
+  return 0;
+}
+
+enum card_rank
+deal_rank_from_rank_deck (struct rank_deck *d, rng *r)
+{
+  unsigned long selected_card_idx;
+  int i;
+
+  if (d->card_count == 0)
+    {
+      return INVALID_RANK;
+    }
+
+  if (r != NULL)
+    {
+      selected_card_idx = rng_below (r, d->card_count);
+    }
+  else
+    {
+      selected_card_idx = lrand48 () % d->card_count;
+    }
+
+  for (i = 0; selected_card_idx >= d->rank_counts[i]; i++)
+    {
+      selected_card_idx -= d->rank_counts[i];
+    }
+
+  d->rank_counts[i]--;
+  d->card_count--;
+
+  return i;
+}
@@ -20,6 +20,7 @@
  ****************************************************************************/
 
 #include <stdint.h>
+#include "rng.h"
 
 #ifndef CARD_H
 #define CARD_H
@@ -283,6 +284,17 @@ get_max_of_hand (const card_hand *h);
 enum card_rank
 get_max_rank_of_hand (const card_hand *h);
 
+/**
+ * Counts the cards of each rank in the hand.
+ *
+ * @param [in] h the card hand to be counted.
+ * @param [out] rank_counts the array of ::RANK_COUNT elements whose n-th
+ *                          element receives the number of cards having the
+ *                          n-th rank.
+ */
+void
+count_ranks_in_hand (const card_hand *h, uint8_t rank_counts[RANK_COUNT]);
+
 /** What the iterator should do. */
 enum itr_action
   {
@@ -331,6 +343,36 @@ typedef enum itr_action (*card_iterator) (unsigned long len,
 void
 iterate_hand (card_hand *h, card_iterator itr_fn);
 
+/**
+ * The callback function used to iterate the cards in a hand with a context
+ * pointer. This is the same as ::card_iterator except that the callback
+ * function can keep its state in the context instead of in static variables,
+ * so that different hands can be iterated concurrently by different threads.
+ *
+ * @param [in] ctx the context pointer given to iterate_hand_ctx().
+ * @param [in] len the total number of cards in this hand.
+ * @param [in] pos the 0-based position of the current card in the hand.
+ * @param [in] c the current card under the iterator's view.
+ *
+ * @return the action that the iterator should do next.
+ */
+typedef enum itr_action (*card_iterator_ctx) (void *ctx,
+					      unsigned long len,
+					      unsigned long pos,
+					      const card *c);
+
+/**
+ * Iterates a hand invoking the callback function with a context pointer for
+ * each iterated card in the hand.
+ *
+ * @param [in] h the hand to be iterated.
+ * @param [in] itr_fn the callback function that will be invoked in each
+ *                    iteration.
+ * @param [in] ctx the context pointer passed as is to the callback function.
+ */
+void
+iterate_hand_ctx (card_hand *h, card_iterator_ctx itr_fn, void *ctx);
+
 /**
  * Removes all cards having the same suit and rank from a card hand.
  *
@@ -377,6 +419,55 @@ is_card_in_deck (enum card_suit_rank c, const card_deck *d);
 const card *
 deal_from_deck (card_deck *d);
 
+/** The maximum number of cards that can be dealt as one combination. */
+#define MAX_COMBINATION_SIZE 7
+
+/**
+ * Counts the different combinations of cards that can be dealt from the deck
+ * at once.
+ *
+ * @param [in] d the deck from which the cards are to be dealt.
+ * @param [in] k the number of cards in each combination.
+ *
+ * @return the number of combinations or 0 if k exceeds
+ *         ::MAX_COMBINATION_SIZE or the number of cards in the deck.
+ */
+unsigned long
+count_combinations_in_deck (const card_deck *d, unsigned char k);
+
+/**
+ * Deals the combination of cards having the given index from the deck. The
+ * combinations are ordered according to the combinatorial number system over
+ * the positions of the cards left in the deck, so every index between 0
+ * inclusive and count_combinations_in_deck() exclusive identifies a unique
+ * combination. This allows stratified or quasi-random dealing.
+ *
+ * @param [in] d the deck from which the cards are to be dealt.
+ * @param [in] k the number of cards to deal (at most ::MAX_COMBINATION_SIZE
+ *               and the number of cards in the deck).
+ * @param [in] idx the index of the combination.
+ * @param [out] cards the array of k elements to receive the dealt cards.
+ */
+void
+deal_combination_at (card_deck *d, unsigned char k, unsigned long idx,
+		     const card **cards);
+
+/**
+ * Deals several cards from the deck at once drawing only one random number.
+ * The dealt cards have the same distribution as when they are dealt one by one
+ * using deal_from_deck(). The dealt cards are freed upon destructing the deck
+ * with destroy_deck().
+ *
+ * @param [in] d the deck from which the cards are to be dealt.
+ * @param [in] k the number of cards to deal.
+ * @param [out] cards the array of k elements to receive the dealt cards.
+ *
+ * @return 0 if the cards are dealt or non-zero if k exceeds
+ *         ::MAX_COMBINATION_SIZE or the number of cards in the deck.
+ */
+int
+deal_combination_from_deck (card_deck *d, unsigned char k, const card **cards);
+
 /**
  * Removes the specified card from the deck. This is different from
  * deal_from_deck() in a way that this removes an arbitrary card from the deck
@@ -398,6 +489,42 @@ strip_card_from_deck (enum card_suit_rank c, card_deck *d);
 card_deck *
 create_shuffled_deck (void);
 
+/**
+ * Makes the deck draw its random numbers from the given generator instead of
+ * lrand48(). The generator is not owned by the deck and must outlive its use
+ * by the deck. The setting is carried over by copy_deck() and
+ * reset_deck_from().
+ *
+ * @param [in] d the deck whose source of randomness is to be set.
+ * @param [in] r the generator or NULL to use lrand48() again.
+ */
+void
+set_deck_rng (card_deck *d, rng *r);
+
+/**
+ * Creates a copy of a deck having the same cards left to be dealt. The
+ * returned card deck has to be freed with destroy_deck().
+ *
+ * @param [in] d the deck to be copied.
+ *
+ * @return NULL if the deck cannot be created or a copy of the deck.
+ */
+card_deck *
+copy_deck (const card_deck *d);
+
+/**
+ * Makes a deck have the same cards left to be dealt as another deck without
+ * allocating any memory. This allows a deck stripped once to be used as the
+ * template of a working deck that is restored at the start of each game.
+ * <strong>WARNING:</strong> all pointers to a card that has ever been dealt
+ * from the restored deck will be invalid.
+ *
+ * @param [out] d the deck to be restored.
+ * @param [in] tmpl the deck whose state is to be copied.
+ */
+void
+reset_deck_from (card_deck *d, const card_deck *tmpl);
+
 /**
  * Reclaims the memory space that was allocated for the card deck as well as
  * setting the pointer to NULL as a safe guard. Passing a pointer to NULL is
@@ -410,6 +537,51 @@ create_shuffled_deck (void);
 void
 destroy_deck (card_deck **d_ptr);
 
+/**
+ * A deck that only tracks how many cards of each rank are left to be dealt.
+ * This is enough for games in which the suits do not matter, such as Razz,
+ * and takes only a few bytes, so it can be copied freely by value.
+ */
+struct rank_deck
+{
+  uint8_t rank_counts[RANK_COUNT]; /**< The number of cards of each rank. */
+  uint8_t card_count; /**< The total number of cards in the deck. */
+};
+
+/**
+ * Fills a rank deck with the four cards of each rank.
+ *
+ * @param [out] d the rank deck to be filled.
+ */
+void
+init_rank_deck (struct rank_deck *d);
+
+/**
+ * Removes a card of the specified rank from the rank deck.
+ *
+ * @param [in] r the rank of the card to be removed.
+ * @param [in] d the rank deck from which the card is to be removed.
+ *
+ * @return 0 if a card is removed or non-zero if there is no card of the rank
+ *         left in the deck.
+ */
+int
+strip_rank_from_rank_deck (enum card_rank r, struct rank_deck *d);
+
+/**
+ * Deals the rank of a random card from the rank deck. Each rank is dealt with
+ * a probability proportional to the number of its cards left in the deck,
+ * which is the same as dealing a card from a deck of suited cards and
+ * ignoring its suit.
+ *
+ * @param [in] d the rank deck from which the next card is to be dealt.
+ * @param [in] r the generator to draw from or NULL to use lrand48().
+ *
+ * @return the dealt rank or ::INVALID_RANK if the deck is empty.
+ */
+enum card_rank
+deal_rank_from_rank_deck (struct rank_deck *d, rng *r);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "card.h"
 
 static enum card_suit_rank seed3_dealing_order[] = {
@@ -78,6 +79,37 @@ test_sort_card_by_rank_4 (unsigned long len, unsigned long pos, const card *c)
   return CONTINUE;
 }
 
+static enum itr_action
+test_remove_under_itr (unsigned long len, unsigned long pos, const card *c)
+{
+  static int call_count = 0;
+  static const unsigned long test_len[] = {7, 7, 6, 5, 5, 5, 5};
+  static const unsigned long test_pos[] = {0, 1, 1, 1, 2, 3, 4};
+
+  assert (len == test_len[call_count]);
+  assert (pos == test_pos[call_count]);
+  call_count++;
+
+  if (get_card_rank (c) == R2)
+    {
+      return REMOVE_AND_CONTINUE;
+    }
+
+  return CONTINUE;
+}
+
+static enum itr_action
+test_count_with_ctx (void *ctx, unsigned long len, unsigned long pos,
+		     const card *c)
+{
+  unsigned long *count = ctx;
+
+  assert (pos == *count);
+  (*count)++;
+
+  return CONTINUE;
+}
+
 static enum itr_action
 test_empty_hand (unsigned long len, unsigned long pos, const card *c)
 {
@@ -91,8 +123,10 @@ main (int argc, char **argv, char **envp)
 {
   int i;
   int end;
+  unsigned long iterated_count;
   const card *c;
   card_deck *d;
+  card_deck *t;
   card_hand *h;
 
   /* Enum position */
@@ -172,6 +206,11 @@ main (int argc, char **argv, char **envp)
   assert (c == NULL);
   c = strtocard ("a2");
   assert (c == NULL);
+  c = strtocard ("S11");
+  assert (c == NULL);
+  c = strtocard ("H10");
+  assert (get_card_suit_rank (c) == HEART_10);
+  destroy_card (&c);
 
   /* Rank */
   assert (strtorank ("ace") == ACE);
@@ -214,6 +253,195 @@ main (int argc, char **argv, char **envp)
   destroy_deck (&d);
   assert (d == NULL);
 
+  /* Deck template */
+  srand48 (3);
+  d = create_shuffled_deck ();
+  assert (d != NULL);
+  strip_card_from_deck (HEART_K, d);
+  t = copy_deck (d);
+  assert (t != NULL);
+  assert (!is_card_in_deck (HEART_K, t));
+  assert (is_card_in_deck (HEART_9, t));
+  for (i = 1; i <= 51; i++)
+    {
+      c = deal_from_deck (d);
+      assert (c != NULL);
+      assert (is_card_in_deck (get_card_suit_rank (c), t));
+    }
+  assert (deal_from_deck (d) == NULL);
+  reset_deck_from (d, t);
+  assert (!is_card_in_deck (HEART_K, d));
+  assert (is_card_in_deck (HEART_9, d));
+  for (i = 1; i <= 51; i++)
+    {
+      assert (deal_from_deck (d) != NULL);
+    }
+  assert (deal_from_deck (d) == NULL);
+  destroy_deck (&t);
+  assert (t == NULL);
+  destroy_deck (&d);
+  assert (d == NULL);
+
+  /* Combination */
+  srand48 (3);
+  d = create_shuffled_deck ();
+  assert (d != NULL);
+  assert (count_combinations_in_deck (d, 4) == 270725);
+  assert (count_combinations_in_deck (d, MAX_COMBINATION_SIZE + 1) == 0);
+  for (i = 0; i < CARD_COUNT - 6; i++)
+    {
+      strip_card_from_deck (i, d);
+    }
+  assert (count_combinations_in_deck (d, 3) == 20);
+  assert (count_combinations_in_deck (d, 7) == 0);
+  t = copy_deck (d);
+  assert (t != NULL);
+  {
+    unsigned long seen[64] = {0};
+    const card *dealt[MAX_COMBINATION_SIZE];
+
+    for (i = 0; i < 20; i++)
+      {
+	unsigned long mask = 0;
+	int j;
+
+	reset_deck_from (d, t);
+	deal_combination_at (d, 3, i, dealt);
+	assert (count_combinations_in_deck (d, 3) == 1);
+	for (j = 0; j < 3; j++)
+	  {
+	    assert (get_card_suit_rank (dealt[j]) >= CARD_COUNT - 6);
+	    assert (!is_card_in_deck (get_card_suit_rank (dealt[j]), d));
+	    mask |= 1UL << (get_card_suit_rank (dealt[j]) - (CARD_COUNT - 6));
+	  }
+	assert (!seen[mask]);
+	seen[mask] = 1;
+      }
+    reset_deck_from (d, t);
+    deal_combination_at (d, 3, 0, dealt);
+    assert (get_card_suit_rank (dealt[0]) == CLUB_8);
+    assert (get_card_suit_rank (dealt[2]) == CLUB_10);
+    reset_deck_from (d, t);
+    assert (deal_combination_from_deck (d, 6, dealt) == 0);
+    assert (deal_from_deck (d) == NULL);
+    reset_deck_from (d, t);
+    assert (deal_combination_from_deck (d, 7, dealt) != 0);
+  }
+  destroy_deck (&t);
+  destroy_deck (&d);
+
+  /* Buffered random numbers */
+  {
+    rng *r1 = create_rng (3);
+    rng *r2 = create_rng (3);
+    unsigned long below_count[5] = {0};
+
+    assert (r1 != NULL && r2 != NULL);
+    for (i = 0; i < 3 * RNG_BUFFER_SIZE; i++)
+      {
+	assert (rng_next (r1) == rng_next (r2));
+      }
+    for (i = 0; i < 50000; i++)
+      {
+	uint32_t v = rng_below (r1, 5);
+
+	assert (v < 5);
+	below_count[v]++;
+      }
+    for (i = 0; i < 5; i++)
+      {
+	assert (below_count[i] > 9500 && below_count[i] < 10500);
+      }
+
+    d = create_shuffled_deck ();
+    assert (d != NULL);
+    set_deck_rng (d, r1);
+    t = copy_deck (d);
+    assert (t != NULL);
+    for (i = 1; i <= 52; i++)
+      {
+	assert (deal_from_deck (t) != NULL);
+      }
+    assert (deal_from_deck (t) == NULL);
+    destroy_deck (&t);
+    destroy_deck (&d);
+
+    destroy_rng (&r1);
+    assert (r1 == NULL);
+    destroy_rng (&r2);
+  }
+
+  /* Counter-based random numbers */
+  {
+    const uint32_t zero[4] = {0, 0, 0, 0};
+    const uint32_t pi_counter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e,
+				    0x03707344};
+    const uint32_t pi_key[2] = {0xa4093822, 0x299f31d0};
+    uint32_t out[4];
+    uint32_t first[40];
+    rng *r1 = create_counter_rng (0);
+    rng *r2 = create_counter_rng (7);
+
+    /* The known-answer vectors of Random123 */
+    philox4x32 (zero, zero, out);
+    assert (out[0] == 0x6627e8d5 && out[1] == 0xe169c58d
+	    && out[2] == 0xbc57ac4c && out[3] == 0x9b00dbd8);
+    philox4x32 (pi_counter, pi_key, out);
+    assert (out[0] == 0xd16cfe09 && out[1] == 0x94fdcceb
+	    && out[2] == 0x5001e420 && out[3] == 0x24126ea1);
+
+    assert (r1 != NULL && r2 != NULL);
+    assert (rng_next (r1) == 0x6627e8d5);
+
+    rng_seek (r1, 7, 1000000007);
+    for (i = 0; i < 40; i++)
+      {
+	first[i] = rng_next (r1);
+      }
+    rng_seek (r2, 7, 5);
+    assert (rng_next (r2) != first[0]);
+    rng_seek (r2, 7, 1000000007);
+    for (i = 0; i < 40; i++)
+      {
+	assert (rng_next (r2) == first[i]);
+      }
+    rng_seek (r2, 8, 1000000007);
+    assert (rng_next (r2) != first[0]);
+
+    destroy_rng (&r1);
+    destroy_rng (&r2);
+  }
+
+  /* Rank deck */
+  {
+    struct rank_deck rd;
+    unsigned long dealt_count[RANK_COUNT] = {0};
+
+    init_rank_deck (&rd);
+    assert (rd.card_count == CARD_COUNT);
+    for (i = 0; i < SUIT_COUNT; i++)
+      {
+	assert (strip_rank_from_rank_deck (K, &rd) == 0);
+      }
+    assert (strip_rank_from_rank_deck (K, &rd) != 0);
+    assert (strip_rank_from_rank_deck (INVALID_RANK, &rd) != 0);
+    assert (rd.card_count == CARD_COUNT - SUIT_COUNT);
+
+    srand48 (3);
+    for (i = 0; i < CARD_COUNT - SUIT_COUNT; i++)
+      {
+	enum card_rank cr = deal_rank_from_rank_deck (&rd, NULL);
+
+	assert (cr >= ACE && cr < K);
+	dealt_count[cr]++;
+      }
+    assert (deal_rank_from_rank_deck (&rd, NULL) == INVALID_RANK);
+    for (i = 0; i < RANK_COUNT; i++)
+      {
+	assert (dealt_count[i] == (i == K ? 0 : SUIT_COUNT));
+      }
+  }
+
   /* Hand */
   srand48 (3);
   d = create_shuffled_deck ();
@@ -324,6 +552,31 @@ main (int argc, char **argv, char **envp)
   destroy_deck (&d);
   assert (d == NULL);
 
+  /* Removal under iteration */
+  srand48 (3);
+  d = create_shuffled_deck ();
+  assert (d != NULL);
+  h = create_hand (7, sort_card_by_rank);
+  assert (h != NULL);
+  for (i = 0; i < 7; i++)
+    {
+      insert_into_hand (h, deal_from_deck (d));
+    }
+  iterate_hand (h, test_sort_card_by_rank_1);
+  iterate_hand (h, test_remove_under_itr);
+  assert (count_cards_in_hand (h) == 5);
+  remove_from_hand (h, DIAMOND_6);
+  assert (count_cards_in_hand (h) == 4);
+  assert (get_max_rank_of_hand (h) == Q);
+  iterated_count = 0;
+  iterate_hand_ctx (h, test_count_with_ctx, &iterated_count);
+  assert (iterated_count == 4);
+
+  destroy_hand (&h);
+  assert (h == NULL);
+  destroy_deck (&d);
+  assert (d == NULL);
+
   /* Uniform distribution */
   unsigned long card_count[CARD_COUNT] = {0};
   unsigned long expected_card_count[] = {
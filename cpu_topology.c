@@ -0,0 +1,203 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_topology.h"
+
+/** The directory of the CPU entries in sysfs. */
+#define SYSFS_CPU_DIR "/sys/devices/system/cpu"
+
+/**
+ * Reads one integer attribute of the topology of a CPU from sysfs.
+ *
+ * @param [in] cpu the number of the CPU.
+ * @param [in] name the name of the attribute.
+ * @param [in] fallback the value to use if the attribute cannot be read.
+ *
+ * @return the value of the attribute.
+ */
+static int
+read_topology_attribute (int cpu, const char *name, int fallback)
+{
+  char path[128];
+  FILE *f;
+  int value;
+
+  snprintf (path, sizeof (path), SYSFS_CPU_DIR "/cpu%d/topology/%s",
+	    cpu, name);
+  f = fopen (path, "r");
+  if (f == NULL)
+    {
+      return fallback;
+    }
+  if (fscanf (f, "%d", &value) != 1)
+    {
+      value = fallback;
+    }
+  fclose (f);
+
+  return value;
+}
+
+static int
+compare_cpus (const void *a, const void *b)
+{
+  const struct cpu_info *x = a;
+  const struct cpu_info *y = b;
+
+  if (x->package != y->package)
+    {
+      return x->package < y->package ? -1 : 1;
+    }
+  if (x->core != y->core)
+    {
+      return x->core < y->core ? -1 : 1;
+    }
+
+  return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+int
+read_cpu_topology (struct cpu_topology *t)
+{
+  cpu_set_t mask;
+  unsigned int i;
+  int cpu;
+  int package;
+
+  t->cpu_count = 0;
+  t->package_count = 0;
+  t->cpus = NULL;
+
+  if (sched_getaffinity (0, sizeof (mask), &mask))
+    {
+      return 1;
+    }
+
+  t->cpus = malloc (CPU_COUNT (&mask) * sizeof (*t->cpus));
+  if (t->cpus == NULL)
+    {
+      return 1;
+    }
+
+  for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      struct cpu_info *c;
+
+      if (!CPU_ISSET (cpu, &mask))
+	{
+	  continue;
+	}
+
+      c = &t->cpus[t->cpu_count++];
+      c->cpu = cpu;
+      c->package = read_topology_attribute (cpu, "physical_package_id", 0);
+      c->core = read_topology_attribute (cpu, "core_id", cpu);
+    }
+
+  qsort (t->cpus, t->cpu_count, sizeof (*t->cpus), compare_cpus);
+
+  /* Turn the package IDs into dense indices and mark the first siblings */
+  package = -1;
+  for (i = 0; i < t->cpu_count; i++)
+    {
+      struct cpu_info *c = &t->cpus[i];
+      int is_new_package = (i == 0 || c->package != package);
+
+      c->is_first_thread = (is_new_package || c->core != c[-1].core);
+      package = c->package;
+      if (is_new_package)
+	{
+	  t->package_count++;
+	}
+      c->package = t->package_count - 1;
+    }
+
+  return 0;
+}
+
+void
+release_cpu_topology (struct cpu_topology *t)
+{
+  free (t->cpus);
+  t->cpus = NULL;
+  t->cpu_count = 0;
+  t->package_count = 0;
+}
+
+unsigned int
+count_worker_cpus (const struct cpu_topology *t, int avoid_smt)
+{
+  unsigned int i;
+  unsigned int count = 0;
+
+  for (i = 0; i < t->cpu_count; i++)
+    {
+      if (!avoid_smt || t->cpus[i].is_first_thread)
+	{
+	  count++;
+	}
+    }
+
+  return count;
+}
+
+void
+assign_worker_cpus (const struct cpu_topology *t, int avoid_smt,
+		    unsigned int worker_count, unsigned int *cpus)
+{
+  unsigned int i;
+  unsigned int assigned = 0;
+  unsigned int round;
+
+  /* Take the n-th usable CPU of every socket in turn for n = 0, 1, ... */
+  for (round = 0; assigned < worker_count; round++)
+    {
+      unsigned int p;
+      int is_any_taken = 0;
+
+      for (p = 0; p < t->package_count && assigned < worker_count; p++)
+	{
+	  unsigned int n = 0;
+
+	  for (i = 0; i < t->cpu_count; i++)
+	    {
+	      const struct cpu_info *c = &t->cpus[i];
+
+	      if (c->package != p || (avoid_smt && !c->is_first_thread))
+		{
+		  continue;
+		}
+	      if (n++ == round)
+		{
+		  cpus[assigned++] = i;
+		  is_any_taken = 1;
+		  break;
+		}
+	    }
+	}
+
+      if (!is_any_taken)
+	{
+	  /* Every usable CPU is taken, so start over */
+	  round = -1;
+	}
+    }
+}
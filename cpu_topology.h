@@ -0,0 +1,102 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file cpu_topology.h
+ * @brief The discovery of the CPU topology for placing worker threads.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The place of a CPU in the topology. */
+struct cpu_info
+{
+  int cpu; /**< The number of the CPU as known to the kernel. */
+  int package; /**< The dense index of the socket of the CPU. */
+  int core; /**< The core ID of the CPU within its socket. */
+  int is_first_thread; /**<
+			* Non-zero if the CPU is the first SMT sibling of its
+			* core.
+			*/
+};
+
+/** The CPUs the process may run on grouped by socket and core. */
+struct cpu_topology
+{
+  unsigned int cpu_count; /**< The number of CPUs. */
+  unsigned int package_count; /**< The number of sockets. */
+  struct cpu_info *cpus; /**< The CPUs sorted by socket, core and number. */
+};
+
+/**
+ * Discovers the topology of the CPUs in the affinity mask of the process from
+ * sysfs. A CPU whose topology cannot be read is assumed to be a core of its
+ * own on the first socket.
+ *
+ * @param [out] t the discovered topology, which has to be released with
+ *                release_cpu_topology().
+ *
+ * @return 0 if the topology is discovered or non-zero if it cannot be.
+ */
+int
+read_cpu_topology (struct cpu_topology *t);
+
+/**
+ * Reclaims the memory space that was allocated for a topology.
+ *
+ * @param [in] t the topology to be released.
+ */
+void
+release_cpu_topology (struct cpu_topology *t);
+
+/**
+ * Chooses the CPUs to pin a number of workers to. Consecutive workers go to
+ * different sockets in turn so that the load is spread evenly, and within a
+ * socket the workers fill the cores in order. If there are more workers than
+ * CPUs, the CPUs are reused from the start.
+ *
+ * @param [in] t the topology to choose from.
+ * @param [in] avoid_smt non-zero to use only the first SMT sibling of every
+ *                       core.
+ * @param [in] worker_count the number of workers, which must not be 0.
+ * @param [out] cpus the index into the CPUs of the topology of every worker.
+ */
+void
+assign_worker_cpus (const struct cpu_topology *t, int avoid_smt,
+		    unsigned int worker_count, unsigned int *cpus);
+
+/**
+ * Counts the CPUs that workers can be pinned to.
+ *
+ * @param [in] t the topology whose CPUs are counted.
+ * @param [in] avoid_smt non-zero to count only the first SMT sibling of every
+ *                       core.
+ *
+ * @return the number of CPUs.
+ */
+unsigned int
+count_worker_cpus (const struct cpu_topology *t, int avoid_smt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPU_TOPOLOGY_H */
@@ -0,0 +1,182 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file perf_counters.c
+ * @brief The hardware performance counters of the simulating threads.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "perf_counters.h"
+
+/** The generalized hardware event of every ::perf_event_kind. */
+static const uint64_t event_configs[PERF_EVENT_KIND_COUNT] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+/**
+ * Opens a counter of the calling thread on any CPU.
+ *
+ * @param [in] config the generalized hardware event.
+ * @param [in] group_fd the descriptor of the group leader or -1 to open a
+ *                      leader, which starts disabled.
+ *
+ * @return the descriptor of the counter or -1 if it cannot be opened.
+ */
+static int
+open_event (uint64_t config, int group_fd)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = (group_fd == -1);
+  /* Counting only user space works with the default perf_event_paranoid */
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = (PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+		      | PERF_FORMAT_TOTAL_TIME_RUNNING);
+
+  return syscall (__NR_perf_event_open, &attr, 0, -1, group_fd,
+		  PERF_FLAG_FD_CLOEXEC);
+}
+
+int
+open_perf_group (struct perf_group *g)
+{
+  int i;
+
+  g->leader_fd = -1;
+  g->member_count = 0;
+  for (i = 0; i < PERF_EVENT_KIND_COUNT; i++)
+    {
+      g->fds[i] = open_event (event_configs[i], g->leader_fd);
+      g->slots[i] = -1;
+      if (g->fds[i] == -1)
+	{
+	  continue;
+	}
+
+      if (g->leader_fd == -1)
+	{
+	  g->leader_fd = g->fds[i];
+	}
+      g->slots[i] = g->member_count++;
+    }
+
+  if (g->leader_fd == -1)
+    {
+      return 1;
+    }
+
+  if (ioctl (g->leader_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) == -1
+      || ioctl (g->leader_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1)
+    {
+      close_perf_group (g);
+      return 1;
+    }
+
+  return 0;
+}
+
+int
+read_perf_group (const struct perf_group *g,
+		 uint64_t values[PERF_EVENT_KIND_COUNT])
+{
+  /* The member count, the enabled time, the running time and the values */
+  uint64_t buf[3 + PERF_EVENT_KIND_COUNT];
+  size_t len = (3 + g->member_count) * sizeof (buf[0]);
+  double scale = 1;
+  int i;
+
+  if (g->leader_fd == -1 || read (g->leader_fd, buf, len) != (ssize_t) len
+      || buf[0] != g->member_count)
+    {
+      return 1;
+    }
+
+  /* The group is multiplexed with others if it is not always running */
+  if (buf[2] != 0 && buf[2] < buf[1])
+    {
+      scale = (double) buf[1] / buf[2];
+    }
+
+  for (i = 0; i < PERF_EVENT_KIND_COUNT; i++)
+    {
+      values[i] = (g->slots[i] == -1
+		   ? 0 : (uint64_t) (buf[3 + g->slots[i]] * scale));
+    }
+
+  return 0;
+}
+
+void
+add_perf_counts (struct perf_counts *counts, const struct perf_group *g,
+		 const uint64_t before[PERF_EVENT_KIND_COUNT],
+		 const uint64_t after[PERF_EVENT_KIND_COUNT],
+		 unsigned long game_count)
+{
+  unsigned int missing_mask = 0;
+  int i;
+
+  for (i = 0; i < PERF_EVENT_KIND_COUNT; i++)
+    {
+      if (g == NULL || g->slots[i] == -1)
+	{
+	  missing_mask |= 1 << i;
+	}
+      else if (after[i] > before[i])
+	{
+	  __atomic_fetch_add (&counts->values[i], after[i] - before[i],
+			      __ATOMIC_RELAXED);
+	}
+    }
+
+  __atomic_fetch_add (&counts->game_count, game_count, __ATOMIC_RELAXED);
+  if (missing_mask != 0)
+    {
+      __atomic_fetch_or (&counts->missing_mask, missing_mask,
+			 __ATOMIC_RELAXED);
+    }
+}
+
+void
+close_perf_group (struct perf_group *g)
+{
+  int i;
+
+  for (i = 0; i < PERF_EVENT_KIND_COUNT; i++)
+    {
+      if (g->fds[i] != -1)
+	{
+	  close (g->fds[i]);
+	  g->fds[i] = -1;
+	}
+      g->slots[i] = -1;
+    }
+  g->leader_fd = -1;
+  g->member_count = 0;
+}
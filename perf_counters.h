@@ -0,0 +1,122 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file perf_counters.h
+ * @brief The hardware performance counters of the simulating threads.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The hardware events counted in user space by a thread. */
+enum perf_event_kind
+  {
+    PERF_CYCLES, PERF_INSTRUCTIONS, PERF_CACHE_MISSES, PERF_BRANCH_MISSES,
+
+    PERF_EVENT_KIND_COUNT,
+  };
+
+/**
+ * The hardware events counted by the threads running the games of a
+ * simulation. The counts are added to atomically, so any number of threads
+ * can add to the same counts.
+ */
+struct perf_counts
+{
+  uint64_t values[PERF_EVENT_KIND_COUNT]; /**< The count of every event. */
+  unsigned long game_count; /**< The number of games counted. */
+  unsigned int missing_mask; /**<
+			      * Bit ::perf_event_kind is set if a thread could
+			      * not count the event during its games, so its
+			      * value covers fewer games than game_count.
+			      */
+};
+
+/** The counters of the calling thread grouped to be read at once. */
+struct perf_group
+{
+  int leader_fd; /**< The descriptor of the group leader or -1. */
+  int fds[PERF_EVENT_KIND_COUNT]; /**< The descriptor of each event or -1. */
+  int slots[PERF_EVENT_KIND_COUNT]; /**<
+				     * The position of each event in a read of
+				     * the group or -1.
+				     */
+  unsigned int member_count; /**< The number of events in the group. */
+};
+
+/**
+ * Opens and starts the counters of the calling thread. Events that cannot be
+ * counted (e.g., because of perf_event_paranoid or a virtual machine without
+ * a PMU) are left out.
+ *
+ * @param [out] g the group, which has to be closed with close_perf_group()
+ *                even on failure.
+ *
+ * @return 0 if at least one event is counted or non-zero otherwise.
+ */
+int
+open_perf_group (struct perf_group *g);
+
+/**
+ * Reads the counters of a group scaled for the time the group was not
+ * scheduled on the PMU.
+ *
+ * @param [in] g the opened group.
+ * @param [out] values the count of every event, which is 0 for the events not
+ *                     in the group.
+ *
+ * @return 0 if the counters are read or non-zero otherwise.
+ */
+int
+read_perf_group (const struct perf_group *g,
+		 uint64_t values[PERF_EVENT_KIND_COUNT]);
+
+/**
+ * Adds the events counted by a group between two reads to the counts.
+ *
+ * @param [in,out] counts the counts to add to.
+ * @param [in] g the group that was read, or NULL if the thread could not
+ *               count anything.
+ * @param [in] before the first read.
+ * @param [in] after the second read.
+ * @param [in] game_count the number of games run between the reads.
+ */
+void
+add_perf_counts (struct perf_counts *counts, const struct perf_group *g,
+		 const uint64_t before[PERF_EVENT_KIND_COUNT],
+		 const uint64_t after[PERF_EVENT_KIND_COUNT],
+		 unsigned long game_count);
+
+/**
+ * Closes the counters of a group.
+ *
+ * @param [in,out] g the group to be closed.
+ */
+void
+close_perf_group (struct perf_group *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_COUNTERS_H */
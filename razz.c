@@ -15,11 +15,62 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *****************************************************************************/
 
+#include <math.h>
 #include <time.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "card.h"
 #include "razz_simulation.h"
+#include "razz_ev.h"
+#include "razz_store.h"
+#include "razz_metrics.h"
+#include "razz_session.h"
+#include "perf_counters.h"
+
+/**
+ * Parses a decided card given either as a rank, which takes the first suit
+ * whose card is still in the deck, or as a suited card like SA or H10.
+ *
+ * @param [in] str the string to be parsed.
+ * @param [in] deck the deck of the cards not decided yet.
+ * @param [out] csr the decided card.
+ *
+ * @return 0 if the card is parsed, 1 if the string is invalid or 2 if the
+ *         card is already decided.
+ */
+int
+parse_decided_card (const char *str, const card_deck *deck,
+		    enum card_suit_rank *csr)
+{
+  enum card_rank rank;
+  enum card_suit cs;
+  const card *c;
+
+  if ((rank = strtorank (str)) == INVALID_RANK)
+    {
+      if ((c = strtocard (str)) == NULL)
+	{
+	  return 1;
+	}
+      *csr = get_card_suit_rank (c);
+      destroy_card (&c);
+
+      return is_card_in_deck (*csr, deck) ? 0 : 2;
+    }
+
+  for (cs = SPADE; cs < SUIT_COUNT; cs++)
+    {
+      *csr = cs * RANK_COUNT + rank;
+      if (is_card_in_deck (*csr, deck))
+	{
+	  return 0;
+	}
+    }
+
+  return 2;
+}
 
 int
 process_args (unsigned long *game_count,
@@ -28,6 +79,7 @@ process_args (unsigned long *game_count,
 	      char **argv)
 {
   int i, end;
+  int rc;
   enum card_suit_rank csr;
   card_deck *deck;
 
@@ -49,31 +101,12 @@ process_args (unsigned long *game_count,
   decided_cards->my_card_count = end;
   for (i = 0; i < end; i++)
     {
-      enum card_rank my_rank;
-      enum card_suit cs = SPADE;
       const card *my_card;
 
-      if ((my_rank = strtorank (*argv++)) == INVALID_RANK)
-	{
-	  fprintf (stderr, "Invalid my rank specification #%d\n", i + 1);
-	  destroy_deck (&deck);  
-	  return 1;
-	}
-
-      csr = cs * RANK_COUNT + my_rank;
-      while (!is_card_in_deck (csr, deck))
-	{
-	  if (++cs == SUIT_COUNT)
-	    {
-	      break;
-	    }
-
-	  csr = cs * RANK_COUNT + my_rank;
-	}
-
-      if (cs == SUIT_COUNT)
+      if ((rc = parse_decided_card (*argv++, deck, &csr)) != 0)
 	{
-	  fprintf (stderr, "Duplicated my rank specification #%d\n", i + 1);
+	  fprintf (stderr, rc == 1 ? "Invalid my rank specification #%d\n"
+		   : "Duplicated my rank specification #%d\n", i + 1);
 	  destroy_deck (&deck);  
 	  return 1;
 	}
@@ -92,31 +125,12 @@ process_args (unsigned long *game_count,
   i = 0;
   while (*argv != NULL)
     {
-      enum card_rank opponent_rank;
-      enum card_suit cs = SPADE;
       const card *opponent_card;
 
-      if ((opponent_rank = strtorank (*argv++)) == INVALID_RANK)
+      if ((rc = parse_decided_card (*argv++, deck, &csr)) != 0)
 	{
-	  fprintf (stderr, "Invalid opponent rank specification #%d\n", i + 1);
-	  destroy_deck (&deck);  
-	  return 1;
-	}
-
-      csr = cs * RANK_COUNT + opponent_rank;
-      while (!is_card_in_deck (csr, deck))
-	{
-	  if (++cs == SUIT_COUNT)
-	    {
-	      break;
-	    }
-
-	  csr = cs * RANK_COUNT + opponent_rank;
-	}
-
-      if (cs == SUIT_COUNT)
-	{
-	  fprintf (stderr, "Duplicated opponent rank specification #%d\n", i + 1);
+	  fprintf (stderr, rc == 1 ? "Invalid opponent rank specification #%d\n"
+		   : "Duplicated opponent rank specification #%d\n", i + 1);
 	  destroy_deck (&deck);  
 	  return 1;
 	}
@@ -139,6 +153,59 @@ process_args (unsigned long *game_count,
   return 0;
 }
 
+/** Set by the SIGINT handler to stop the simulation early. */
+static volatile sig_atomic_t is_interrupted;
+
+/** The tracer of the program or NULL if no trace is requested. */
+static razz_tracer *tracer;
+
+/** The file the trace is written to at exit. */
+static const char *trace_path;
+
+/**
+ * Writes the trace of the program at exit once every worker thread is gone,
+ * then frees the tracer.
+ */
+void
+write_trace (void)
+{
+  if (razz_tracer_write (tracer, trace_path))
+    {
+      fprintf (stderr, "Cannot write the trace to %s\n", trace_path);
+    }
+  razz_tracer_destroy (&tracer);
+}
+
+void
+interrupt_handler (int signum)
+{
+  is_interrupted = 1;
+}
+
+/** The state of the progress listener of the program. */
+struct progress_state
+{
+  int is_shown; /**< Non-zero to print the progress to stderr. */
+  unsigned long game_count; /**< The number of games simulated so far. */
+};
+
+void
+progress_printer (void *arg, const struct razz_progress *progress)
+{
+  struct progress_state *state = arg;
+
+  state->game_count = progress->game_count;
+  if (!state->is_shown)
+    {
+      return;
+    }
+
+  fprintf (stderr, "\r%lu/%lu games (%.1f%%), %.0f games/s",
+	   progress->game_count, progress->total_game_count,
+	   100.0 * progress->game_count / progress->total_game_count,
+	   progress->games_per_second);
+}
+
 void
 listener (void *arg, enum card_rank r)
 {
@@ -156,47 +223,940 @@ listener (void *arg, enum card_rank r)
     }
 }
 
+void
+low_index_listener (void *arg, unsigned int low_index)
+{
+  unsigned long *low_count = arg;
+
+  if (low_index < RAZZ_LOW_INDEX_COUNT)
+    {
+      low_count[low_index]++;
+    }
+}
+
+/**
+ * Prints the probability of every Razz low that occurred in the simulation
+ * from the best to the worst.
+ *
+ * @param [in] low_count the occurrence count of each Razz low index.
+ * @param [in] game_count the number of simulated games.
+ */
+void
+print_low_distribution (const unsigned long *low_count,
+			unsigned long game_count)
+{
+  unsigned int i;
+  int j;
+
+  for (i = 0; i < RAZZ_LOW_INDEX_COUNT; i++)
+    {
+      enum card_rank ranks[5];
+      char str[16];
+      size_t len = 0;
+
+      if (low_count[i] == 0)
+	{
+	  continue;
+	}
+
+      get_razz_low_ranks (i, ranks);
+      for (j = 0; j < 5; j++)
+	{
+	  len += sprintf (str + len, j == 0 ? "%s" : "-%s",
+			  ranktostr (ranks[j]));
+	}
+
+      printf ("%14s = %.6f\n", str, (double) low_count[i] / game_count);
+    }
+}
+
+/**
+ * Runs the simulation on the workers of a simulation context and collects
+ * the same counts as the listeners do. With a store, only the games missing
+ * from the stored counts are simulated.
+ *
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in,out] game_count the number of Razz games to be counted, which is
+ *                            set to the number of games actually counted.
+ * @param [in] options the options of the simulation.
+ * @param [in] store the store of the counts or NULL.
+ * @param [in] std_error the largest standard error of an outcome probability
+ *                       to reach by counting more games than requested or 0.
+ * @param [in] metrics_path the file to export the counters of the context
+ *                          and the store to or NULL.
+ * @param [in] metrics_interval_ms the milliseconds between two exports or 0
+ *                                 for the default.
+ * @param [in] thread_count the number of worker threads.
+ * @param [in] pin_threads non-zero to pin the workers to CPUs.
+ * @param [in] avoid_smt non-zero to pin the workers only to the first SMT
+ *                       sibling of every core.
+ * @param [out] rank_count the occurrence count of each rank from R5 to K.
+ * @param [out] low_count the occurrence count of each Razz low index.
+ * @param [out] high_count the occurrence count of each stud high category.
+ * @param [out] qualified_low_count the number of eight-or-better lows.
+ *
+ * @return 0 if the simulation encounters no error, ::RAZZ_CANCELLED if it is
+ *         interrupted or another non-zero value if it encounters an error.
+ */
+int
+simulate_with_ctx (const struct razz_scenario *scenario,
+		   unsigned long *game_count,
+		   const struct simulation_options *options,
+		   razz_store *store,
+		   double std_error,
+		   const char *metrics_path,
+		   unsigned long metrics_interval_ms,
+		   unsigned int thread_count,
+		   int pin_threads,
+		   int avoid_smt,
+		   unsigned long *rank_count,
+		   unsigned long *low_count,
+		   unsigned long *high_count,
+		   unsigned long *qualified_low_count)
+{
+  static struct razz_result result;
+  struct razz_ctx_options ctx_options;
+  razz_metrics_exporter *exporter = NULL;
+  razz_ctx *ctx;
+  int i;
+  int rc;
+
+  init_razz_ctx_options (&ctx_options);
+  ctx_options.thread_count = thread_count;
+  ctx_options.pin_threads = pin_threads;
+  ctx_options.avoid_smt = avoid_smt;
+  ctx_options.simulation = *options;
+
+  ctx = razz_ctx_create (&ctx_options);
+  if (ctx == NULL)
+    {
+      fprintf (stderr, "Cannot create a simulation context\n");
+      return 1;
+    }
+  if (metrics_path != NULL)
+    {
+      exporter = razz_metrics_exporter_create (metrics_path,
+					       metrics_interval_ms,
+					       ctx, store);
+      if (exporter == NULL)
+	{
+	  fprintf (stderr, "Cannot start exporting the metrics\n");
+	  razz_ctx_destroy (&ctx);
+	  return 1;
+	}
+    }
+
+  if (store == NULL)
+    {
+      rc = razz_ctx_run_scenario (ctx, scenario, *game_count, NULL, &result);
+    }
+  else
+    {
+      unsigned long simulated_count;
+
+      if (std_error > 0)
+	{
+	  unsigned long needed_count;
+
+	  razz_store_lookup (store, scenario, options->variant, &result);
+	  needed_count = get_razz_game_count_for_precision (&result,
+							    options->variant,
+							    std_error);
+	  if (needed_count > *game_count)
+	    {
+	      *game_count = needed_count;
+	    }
+	}
+      rc = razz_store_top_up (store, ctx, scenario, *game_count, options,
+			      &result, &simulated_count);
+      fprintf (stderr, "Reused %lu stored games and simulated %lu\n",
+	       result.game_count - simulated_count, simulated_count);
+    }
+  razz_metrics_exporter_destroy (&exporter);
+  razz_ctx_destroy (&ctx);
+  if (rc != 0 && rc != RAZZ_CANCELLED)
+    {
+      return rc;
+    }
+  *game_count = result.game_count;
+
+  for (i = R5; i <= K; i++)
+    {
+      rank_count[i - R5] = result.rank_counts[i];
+    }
+  for (i = 0; i < RAZZ_LOW_INDEX_COUNT; i++)
+    {
+      low_count[i] = result.low_counts[i];
+    }
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      high_count[i] = result.high_counts[i];
+    }
+  *qualified_low_count = result.qualified_low_count;
+
+  return rc;
+}
+
+/**
+ * Prints the probability of every stud high category from the worst to the
+ * best.
+ *
+ * @param [in] high_count the occurrence count of each stud high category.
+ * @param [in] game_count the number of simulated games.
+ */
+void
+print_high_distribution (const unsigned long *high_count,
+			 unsigned long game_count)
+{
+  static const char *const names[HIGH_CATEGORY_COUNT] = {
+    "high card", "one pair", "two pair", "three of a kind", "straight",
+    "flush", "full house", "four of a kind", "straight flush",
+  };
+  int i;
+
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      printf ("%15s = %.4f\n", names[i], (double) high_count[i] / game_count);
+    }
+}
+
+/**
+ * Sweeps one more opponent upcard over every rank on common random numbers
+ * and prints the outcome distribution of every upcard in a row.
+ *
+ * @param [in] scenario the cards known in every cell of the sweep.
+ * @param [in] deal_count the number of deals shared by the cells.
+ * @param [in] options the options of the sweep.
+ *
+ * @return 0 if the sweep is run or non-zero otherwise.
+ */
+int
+print_sweep (const struct razz_scenario *scenario, unsigned long deal_count,
+	     const struct simulation_options *options)
+{
+  static const char *const high_names[HIGH_CATEGORY_COUNT] = {
+    "hi", "1p", "2p", "3k", "st", "fl", "fh", "4k", "sf",
+  };
+  struct razz_scenario cells[RANK_COUNT];
+  enum card_rank upcards[RANK_COUNT];
+  struct razz_result *results;
+  unsigned int cell_count = 0;
+  unsigned int i;
+  int j;
+  int rc;
+
+  for (i = ACE; i < RANK_COUNT; i++)
+    {
+      for (j = SPADE; j < SUIT_COUNT; j++)
+	{
+	  uint64_t bit = RAZZ_CARD_BIT (j * RANK_COUNT + i);
+
+	  if ((scenario->known_mask & bit) == 0)
+	    {
+	      cells[cell_count] = *scenario;
+	      cells[cell_count].known_mask |= bit;
+	      upcards[cell_count++] = i;
+	      break;
+	    }
+	}
+    }
+
+  results = malloc (cell_count * sizeof (*results));
+  if (results == NULL)
+    {
+      fprintf (stderr, "Cannot allocate the results of the sweep\n");
+      return 1;
+    }
+
+  rc = simulate_razz_sweep (cells, cell_count, deal_count, options, results);
+  if (rc != 0 && rc != RAZZ_CANCELLED)
+    {
+      free (results);
+      return 1;
+    }
+
+  printf ("up     games");
+  for (j = 0; j < 9; j++)
+    {
+      printf (" %6s", (options->variant == GAME_RAZZ
+		       ? ranktostr (R5 + j) : high_names[j]));
+    }
+  printf ("\n");
+  for (i = 0; i < cell_count; i++)
+    {
+      const struct razz_result *result = &results[i];
+
+      printf ("%2s %9lu", ranktostr (upcards[i]), result->game_count);
+      for (j = 0; j < 9; j++)
+	{
+	  unsigned long count = (options->variant == GAME_RAZZ
+				 ? result->rank_counts[R5 + j]
+				 : result->high_counts[j]);
+
+	  printf (" %6.4f", (result->game_count == 0
+			     ? 0 : (double) count / result->game_count));
+	}
+      printf ("\n");
+    }
+
+  free (results);
+
+  return 0;
+}
+
+/**
+ * Prints the hardware events per simulated game to stderr.
+ *
+ * @param [in] counts the events counted by the simulating threads.
+ */
+void
+print_perf_stats (const struct perf_counts *counts)
+{
+  static const char *const names[PERF_EVENT_KIND_COUNT] = {
+    "cycles", "instructions", "cache misses", "branch misses",
+  };
+  int i;
+
+  if (counts->missing_mask == (1 << PERF_EVENT_KIND_COUNT) - 1
+      || counts->game_count == 0)
+    {
+      fprintf (stderr, "perf: hardware counters are not available"
+	       " (see /proc/sys/kernel/perf_event_paranoid)\n");
+      return;
+    }
+
+  fprintf (stderr, "perf: per game");
+  for (i = 0; i < PERF_EVENT_KIND_COUNT; i++)
+    {
+      if (counts->missing_mask & (1 << i))
+	{
+	  fprintf (stderr, ", %s n/a", names[i]);
+	}
+      else
+	{
+	  fprintf (stderr, ", %s %.2f", names[i],
+		   (double) counts->values[i] / counts->game_count);
+	}
+    }
+  if ((counts->missing_mask & (1 << PERF_CYCLES | 1 << PERF_INSTRUCTIONS)) == 0
+      && counts->values[PERF_CYCLES] != 0)
+    {
+      fprintf (stderr, ", IPC %.2f", ((double) counts->values[PERF_INSTRUCTIONS]
+				      / counts->values[PERF_CYCLES]));
+    }
+  fprintf (stderr, "\n");
+}
+
+/**
+ * Prints the EV of folding and of continuing on the third street against one
+ * opponent.
+ *
+ * @param [in] decided_cards my three cards, the upcard of the opponent as the
+ *                           first opponent card and the folded cards as the
+ *                           rest.
+ * @param [in] sample_count the number of deals sampled per node.
+ * @param [in] threshold the highest upcard the opponent plays on or
+ *                       ::INVALID_RANK if the opponent never folds.
+ * @param [in] t the tracer of the solve or NULL.
+ *
+ * @return 0 if the EV is computed or non-zero otherwise.
+ */
+int
+print_ev (const struct decided_cards *decided_cards,
+	  unsigned long sample_count, enum card_rank threshold,
+	  razz_tracer *t)
+{
+  struct razz_ev_options options;
+  struct razz_ev_state state;
+  struct razz_ev_decision decision;
+  razz_ev *ev;
+  int i;
+
+  init_razz_ev_options (&options);
+  options.sample_count = sample_count;
+  options.tracer = t;
+  if (threshold != INVALID_RANK)
+    {
+      options.policy = OPPONENT_CONTINUES_ON_LOW_BOARD;
+      options.threshold = threshold;
+    }
+
+  state.my_card_count = decided_cards->my_card_count;
+  for (i = 0; i < decided_cards->my_card_count; i++)
+    {
+      state.my_ranks[i] = get_card_rank (decided_cards->my_cards[i]);
+    }
+  state.opponent_up_count = 1;
+  state.opponent_up_ranks[0] = get_card_rank (decided_cards->opponent_cards[0]);
+  state.dead_count = decided_cards->opponent_card_count - 1;
+  for (i = 1; i < decided_cards->opponent_card_count; i++)
+    {
+      state.dead_ranks[i - 1]
+	= get_card_rank (decided_cards->opponent_cards[i]);
+    }
+
+  ev = razz_ev_create (&options);
+  if (ev == NULL)
+    {
+      fprintf (stderr, "Cannot create an EV solver\n");
+      return 1;
+    }
+  if (razz_ev_solve (ev, &state, &decision))
+    {
+      fprintf (stderr, "Cannot solve the EV\n");
+      razz_ev_destroy (&ev);
+      return 1;
+    }
+  razz_ev_destroy (&ev);
+
+  printf ("    fold = %.4f\n", decision.fold_ev);
+  printf ("continue = %.4f\n", decision.continue_ev);
+
+  return 0;
+}
+
+/**
+ * Runs the reference pipeline side by side with the fast evaluators on every
+ * rank multiset and on random hands and prints the first mismatching hand.
+ *
+ * @param [in] random_count the number of random hands to check.
+ *
+ * @return 0 if every hand agrees or non-zero otherwise.
+ */
+int
+print_verification (unsigned long random_count)
+{
+  struct razz_mismatch mismatch;
+  unsigned long checked_count;
+  int i;
+
+  if (verify_razz_evaluators (1, random_count, time (NULL), &mismatch,
+			      &checked_count) == 0)
+    {
+      printf ("%lu hands agree\n", checked_count);
+      return 0;
+    }
+
+  if (mismatch.path == NULL)
+    {
+      fprintf (stderr, "Cannot run the verification\n");
+      return 1;
+    }
+
+  printf ("Hand %lu:", checked_count);
+  for (i = 0; i < 7; i++)
+    {
+      printf (" %s", cardtostr (mismatch.cards[i]));
+    }
+  printf ("\n%s: reference = %d, fast = %d\n", mismatch.path,
+	  mismatch.reference, mismatch.fast);
+
+  return 1;
+}
+
+/**
+ * Simulates sessions of consecutive hands and prints the statistics of my
+ * bankroll.
+ *
+ * @param [in] highest the highest starting card I play with.
+ * @param [in] opponent_count the number of opponents.
+ * @param [in] thread_count the number of threads or 0 for one per CPU.
+ * @param [in] seed the key of the streams of the sessions or 0.
+ * @param [in] argv the session count, the number of hands per session and
+ *                  the starting bankroll.
+ *
+ * @return 0 if the sessions are simulated or non-zero otherwise.
+ */
+int
+print_sessions (enum card_rank highest, unsigned int opponent_count,
+		unsigned int thread_count, uint64_t seed, char **argv)
+{
+  struct razz_policy policy;
+  struct session_options options;
+  struct session_stats stats;
+  int rc;
+
+  init_razz_policy_by_rank (&policy, highest, 0);
+  init_session_options (&options);
+  options.opponent_count = opponent_count;
+  options.thread_count = thread_count;
+  options.seed = seed;
+  options.session_count = strtoul (argv[0], NULL, 10);
+  options.hands_per_session = strtoul (argv[1], NULL, 10);
+  options.starting_bankroll = strtod (argv[2], NULL);
+  options.cancel_flag = &is_interrupted;
+
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  if (rc == RAZZ_CANCELLED)
+    {
+      fprintf (stderr, "Interrupted after %lu of %lu sessions\n",
+	       stats.session_count, options.session_count);
+    }
+  else if (rc != 0)
+    {
+      return 1;
+    }
+  if (stats.hand_count == 0)
+    {
+      return 1;
+    }
+
+  printf ("%14s = %lu\n", "hands", stats.hand_count);
+  printf ("%14s = %.4f\n", "played",
+	  (double) stats.played_count / stats.hand_count);
+  printf ("%14s = %.4f\n", "won of played",
+	  (stats.played_count == 0
+	   ? 0 : (double) stats.won_count / stats.played_count));
+  printf ("%14s = %.4f +- %.4f\n", "net per hand", stats.hand_net.mean,
+	  sqrt (get_running_variance (&stats.hand_net)));
+  printf ("%14s = %.2f +- %.2f\n", "final bankroll",
+	  stats.final_bankroll.mean,
+	  sqrt (get_running_variance (&stats.final_bankroll)));
+  printf ("%14s = %.2f (worst %.2f)\n", "max drawdown",
+	  stats.max_drawdown.mean, stats.max_drawdown.max);
+  printf ("%14s = %.4f\n", "risk of ruin",
+	  (double) stats.ruined_count / stats.session_count);
+
+  return 0;
+}
+
+void
+print_usage (void)
+{
+  fprintf (stderr,
+	   "Usage: razz [--lows] [--one-by-one] [--ranks-only] [--threads=N]\n"
+	   "\t[--progress] [--pin] [--no-smt] [--ev] [--ev-threshold=RANK]\n"
+	   "\t[--variant=razz|stud|hilo8] [--sweep] [--perf-stats]\n"
+	   "\t[--trace=FILE] [--store=FILE [--precision=STD_ERROR]]\n"
+	   "\t[--seed=N [--first-game=N]] [--batch=N]\n"
+	   "\t[--metrics=FILE [--metrics-interval=MS]]\n"
+	   "\tGAME_COUNT\n"
+	   "\tRANK1 RANK2 RANK3\n"
+	   "\t[OPP1_RANK [OPP2_RANK [... [OPP7_RANK]]]]\n"
+	   "   or: razz --verify[=RANDOM_COUNT]\n"
+	   "   or: razz --session=RANK [--opponents=N] [--threads=N] [--seed=N]\n"
+	   "\tSESSION_COUNT HANDS_PER_SESSION BANKROLL\n"
+	   "\n"
+	   "You specify a rank with the following symbols:\n"
+	   "\tA, 2, ..., 10, J, Q, K for ace to king\n"
+	   "A rank prefixed by S, H, D or C (e.g., SA or H10) fixes the suit\n"
+	   "of the card, which matters to the stud variants.\n"
+	   "\n"
+	   "Options:\n"
+	   "\t--lows\t\tprints the probability of every complete low\n"
+	   "\t--one-by-one\tdeals with one random draw per card instead of\n"
+	   "\t\t\tone random draw per game\n"
+	   "\t--ranks-only\tdeals from a deck of ranks without suits\n"
+	   "\t--threads=N\truns the games on N worker threads (0 for one\n"
+	   "\t\t\tper online CPU)\n"
+	   "\t--pin\t\tpins the worker threads to CPUs spreading them over\n"
+	   "\t\t\tthe sockets (implies --threads=0 if not given)\n"
+	   "\t--no-smt\tlike --pin but uses one CPU per core only\n"
+	   "\t--ev\t\tprints the EV of folding and of continuing heads-up\n"
+	   "\t\t\tagainst OPP1_RANK as the opponent upcard with the\n"
+	   "\t\t\tother opponent ranks folded, sampling GAME_COUNT deals\n"
+	   "\t\t\tper node\n"
+	   "\t--ev-threshold=RANK\tlike --ev but the opponent folds once its\n"
+	   "\t\t\tupcards pair or show a rank above RANK\n"
+	   "\t--variant=razz|stud|hilo8\tcounts the outcome of Razz (the\n"
+	   "\t\t\tdefault), seven-card stud high or stud high-low\n"
+	   "\t\t\teight or better (implies --threads=0 if not given)\n"
+	   "\t--sweep\t\tadds one more opponent upcard of every rank and\n"
+	   "\t\t\tprints a row per upcard, dealing GAME_COUNT deals\n"
+	   "\t\t\tshared by all rows\n"
+	   "\t--progress\tprints the progress to stderr every second\n"
+	   "\t--perf-stats\tprints the cycles, instructions, cache misses and\n"
+	   "\t\t\tbranch misses per game counted by perf_event_open\n"
+	   "\t\t\tto stderr at exit\n"
+	   "\t--trace=FILE\twrites the timeline of the runs, queries, chunks,\n"
+	   "\t\t\tmerges and EV cache misses of every thread to FILE\n"
+	   "\t\t\tat exit in Chrome trace-event format\n"
+	   "\t--store=FILE\treuses the games counted earlier for the same\n"
+	   "\t\t\tcards in FILE, simulates only the missing ones and\n"
+	   "\t\t\tstores the merged counts (implies --threads=0 if not\n"
+	   "\t\t\tgiven)\n"
+	   "\t--precision=STD_ERROR\twith --store, counts more games than\n"
+	   "\t\t\tGAME_COUNT if needed for every probability to have\n"
+	   "\t\t\tat most STD_ERROR as its standard error\n"
+	   "\t--seed=N\tdeals game i from the stream i of a counter-based\n"
+	   "\t\t\tgenerator keyed by N (non-zero), so the counts are\n"
+	   "\t\t\tthe same for any number of threads\n"
+	   "\t--first-game=N\twith --seed, starts at game N to resume a run\n"
+	   "\t\t\tor to run one shard of it\n"
+	   "\t--batch=N\tdeals N games at a time before evaluating them\n"
+	   "\t\t\t(%d by default) to fit the batch into the L1 or L2\n"
+	   "\t\t\tcache (implies --threads=0 if not given)\n"
+	   "\t--metrics=FILE\treplaces FILE atomically with the counters of\n"
+	   "\t\t\tthe workers and the store in Prometheus text format\n"
+	   "\t\t\tevery second and at exit (implies --threads=0 if not\n"
+	   "\t\t\tgiven)\n"
+	   "\t--metrics-interval=MS\twith --metrics, exports every MS\n"
+	   "\t\t\tmilliseconds instead\n"
+	   "\t--verify\tchecks the fast evaluators against the reference\n"
+	   "\t\t\ton every rank multiset and on RANDOM_COUNT random\n"
+	   "\t\t\thands (1000000 by default) and prints the first\n"
+	   "\t\t\tmismatching hand\n"
+	   "\t--session=RANK\tplays the unpaired starting hands up to RANK\n"
+	   "\t\t\tto the showdown and folds the rest in sessions of\n"
+	   "\t\t\tconsecutive hands with an ante of 1 and a bet of 10,\n"
+	   "\t\t\tprinting the variance of my bankroll and the risk\n"
+	   "\t\t\tof ruin\n"
+	   "\t--opponents=N\tplays the sessions against N opponents (1 by\n"
+	   "\t\t\tdefault)\n"
+	   "\n"
+	   "Interrupting the program with Ctrl-C stops the simulation and prints\n"
+	   "the outcome of the games simulated so far.\n",
+	   DEFAULT_GAME_BATCH_SIZE);
+}
+
 int
 main (int argc, char **argv, char **envp)
 {
   int i;
   int end;
+  int arg_idx = 1;
+  int show_lows = 0;
+  int use_ctx = 0;
+  int rc;
+  unsigned int thread_count = 0;
+  int pin_threads = 0;
+  int avoid_smt = 0;
+  int show_ev = 0;
+  int show_sweep = 0;
+  enum card_rank session_rank = INVALID_RANK;
+  unsigned int opponent_count = 1;
+  enum card_rank ev_threshold = INVALID_RANK;
+  struct progress_state progress = {0, 0};
+  struct perf_counts perf_counts;
+  int show_perf = 0;
+  const char *store_path = NULL;
+  const char *metrics_path = NULL;
+  unsigned long metrics_interval_ms = 0;
+  razz_store *store = NULL;
+  double std_error = 0;
+  struct simulation_options options;
   struct decided_cards decided_cards;
+  struct razz_scenario scenario;
   unsigned long game_count;
+  unsigned long counted_count = 0;
   unsigned long rank_count[K - R5 + 1] = {0};
+  static unsigned long low_count[RAZZ_LOW_INDEX_COUNT];
+  unsigned long high_count[HIGH_CATEGORY_COUNT] = {0};
+  unsigned long qualified_low_count = 0;
 
   srand48 (time (NULL));
+  init_simulation_options (&options);
 
-  if (argc < 5 || argc > 12)
+  for (; arg_idx < argc && strncmp (argv[arg_idx], "--", 2) == 0; arg_idx++)
     {
-      fprintf (stderr,
-	       "Usage: razz GAME_COUNT\n"
-	       "\tRANK1 RANK2 RANK3\n"
-	       "\t[OPP1_RANK [OPP2_RANK [... [OPP7_RANK]]]]\n"
-	       "\n"
-	       "You specify a rank with the following symbols:\n"
-	       "\tA, 2, ..., 10, J, Q, K for ace to king\n");
+      if (strcmp (argv[arg_idx], "--lows") == 0)
+	{
+	  show_lows = 1;
+	}
+      else if (strcmp (argv[arg_idx], "--one-by-one") == 0)
+	{
+	  options.deal_mode = DEAL_ONE_BY_ONE;
+	}
+      else if (strcmp (argv[arg_idx], "--ranks-only") == 0)
+	{
+	  options.deck_kind = RANK_DECK;
+	}
+      else if (strcmp (argv[arg_idx], "--progress") == 0)
+	{
+	  progress.is_shown = 1;
+	  options.progress_interval_ms = 1000;
+	}
+      else if (strcmp (argv[arg_idx], "--perf-stats") == 0)
+	{
+	  show_perf = 1;
+	}
+      else if (strncmp (argv[arg_idx], "--session=", 10) == 0)
+	{
+	  session_rank = strtorank (argv[arg_idx] + 10);
+	  if (session_rank == INVALID_RANK)
+	    {
+	      fprintf (stderr, "Invalid session rank\n");
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      else if (strncmp (argv[arg_idx], "--seed=", 7) == 0)
+	{
+	  options.counter_key = strtoull (argv[arg_idx] + 7, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--first-game=", 13) == 0)
+	{
+	  options.first_game_index = strtoull (argv[arg_idx] + 13, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--batch=", 8) == 0)
+	{
+	  use_ctx = 1;
+	  options.batch_size = strtoul (argv[arg_idx] + 8, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--opponents=", 12) == 0)
+	{
+	  opponent_count = atoi (argv[arg_idx] + 12);
+	}
+      else if (strncmp (argv[arg_idx], "--store=", 8) == 0)
+	{
+	  use_ctx = 1;
+	  store_path = argv[arg_idx] + 8;
+	}
+      else if (strncmp (argv[arg_idx], "--precision=", 12) == 0)
+	{
+	  std_error = strtod (argv[arg_idx] + 12, NULL);
+	  if (!(std_error > 0))
+	    {
+	      fprintf (stderr, "Invalid standard error\n");
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      else if (strncmp (argv[arg_idx], "--metrics=", 10) == 0)
+	{
+	  use_ctx = 1;
+	  metrics_path = argv[arg_idx] + 10;
+	}
+      else if (strncmp (argv[arg_idx], "--metrics-interval=", 19) == 0)
+	{
+	  metrics_interval_ms = strtoul (argv[arg_idx] + 19, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--trace=", 8) == 0)
+	{
+	  trace_path = argv[arg_idx] + 8;
+	}
+      else if (strcmp (argv[arg_idx], "--sweep") == 0)
+	{
+	  show_sweep = 1;
+	}
+      else if (strcmp (argv[arg_idx], "--ev") == 0)
+	{
+	  show_ev = 1;
+	}
+      else if (strncmp (argv[arg_idx], "--ev-threshold=", 15) == 0)
+	{
+	  show_ev = 1;
+	  ev_threshold = strtorank (argv[arg_idx] + 15);
+	  if (ev_threshold == INVALID_RANK)
+	    {
+	      fprintf (stderr, "Invalid threshold rank\n");
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      else if (strcmp (argv[arg_idx], "--verify") == 0)
+	{
+	  exit (print_verification (1000000) ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+      else if (strncmp (argv[arg_idx], "--verify=", 9) == 0)
+	{
+	  exit (print_verification (strtoul (argv[arg_idx] + 9, NULL, 10))
+		? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+      else if (strncmp (argv[arg_idx], "--variant=", 10) == 0)
+	{
+	  const char *variant = argv[arg_idx] + 10;
+
+	  if (strcmp (variant, "razz") == 0)
+	    {
+	      options.variant = GAME_RAZZ;
+	    }
+	  else if (strcmp (variant, "stud") == 0)
+	    {
+	      use_ctx = 1;
+	      options.variant = GAME_STUD_HIGH;
+	    }
+	  else if (strcmp (variant, "hilo8") == 0)
+	    {
+	      use_ctx = 1;
+	      options.variant = GAME_STUD_HILO8;
+	    }
+	  else
+	    {
+	      fprintf (stderr, "Unknown variant %s\n", variant);
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      else if (strcmp (argv[arg_idx], "--pin") == 0)
+	{
+	  use_ctx = 1;
+	  pin_threads = 1;
+	}
+      else if (strcmp (argv[arg_idx], "--no-smt") == 0)
+	{
+	  use_ctx = 1;
+	  pin_threads = 1;
+	  avoid_smt = 1;
+	}
+      else if (strncmp (argv[arg_idx], "--threads=", 10) == 0)
+	{
+	  use_ctx = 1;
+	  thread_count = atoi (argv[arg_idx] + 10);
+	}
+      else
+	{
+	  fprintf (stderr, "Unknown option %s\n", argv[arg_idx]);
+	  print_usage ();
+	  exit (EXIT_FAILURE);
+	}
+    }
+
+  if (session_rank != INVALID_RANK)
+    {
+      if (argc - arg_idx != 3)
+	{
+	  print_usage ();
+	  exit (EXIT_FAILURE);
+	}
+      signal (SIGINT, interrupt_handler);
+      exit (print_sessions (session_rank, opponent_count, thread_count,
+			    options.counter_key, &argv[arg_idx])
+	    ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  if (argc - arg_idx < 4 || argc - arg_idx > 11)
+    {
+      print_usage ();
+      exit (EXIT_FAILURE);
+    }
+  if (std_error > 0 && store_path == NULL)
+    {
+      fprintf (stderr, "--precision needs --store\n");
+      exit (EXIT_FAILURE);
+    }
+  if (store_path != NULL && show_lows)
+    {
+      fprintf (stderr, "--store keeps no low counts for --lows\n");
       exit (EXIT_FAILURE);
     }
 
   if (process_args (&game_count, &decided_cards,
-		    argc - 1, &argv[1]))
+		    argc - arg_idx, &argv[arg_idx]))
     {
       exit (EXIT_FAILURE);
     }
 
-  if (simulate_razz_game (&decided_cards, game_count, rank_count, listener))
+  if (trace_path != NULL)
     {
+      tracer = razz_tracer_create (0);
+      if (tracer == NULL)
+	{
+	  fprintf (stderr, "Cannot create the tracer\n");
+	  exit (EXIT_FAILURE);
+	}
+      options.tracer = tracer;
+      atexit (write_trace);
+    }
+
+  if (show_ev)
+    {
+      if (decided_cards.opponent_card_count == 0)
+	{
+	  fprintf (stderr, "--ev needs the opponent upcard\n");
+	  exit (EXIT_FAILURE);
+	}
+      exit (print_ev (&decided_cards, game_count, ev_threshold, tracer)
+	    ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  rc = pack_decided_cards (&decided_cards, &scenario);
+  release_decided_cards (&decided_cards);
+  if (rc != 0)
+    {
+      fprintf (stderr, "Cannot pack the decided cards\n");
       exit (EXIT_FAILURE);
     }
 
-  for (i = 0; i < decided_cards.my_card_count; i++)
+  options.progress_listener = progress_printer;
+  options.progress_arg = &progress;
+  options.cancel_flag = &is_interrupted;
+  if (show_perf)
     {
-      destroy_card (&decided_cards.my_cards[i]);
+      memset (&perf_counts, 0, sizeof (perf_counts));
+      options.perf_counts = &perf_counts;
     }
-  for (i = 0; i < decided_cards.opponent_card_count; i++)
+  signal (SIGINT, interrupt_handler);
+
+  if (show_sweep)
+    {
+      rc = print_sweep (&scenario, game_count, &options);
+      if (progress.is_shown)
+	{
+	  fprintf (stderr, "\n");
+	}
+      exit (rc ? EXIT_FAILURE : EXIT_SUCCESS);
+    }
+
+  if (use_ctx)
+    {
+      if (store_path != NULL)
+	{
+	  store = razz_store_open (store_path);
+	  if (store == NULL)
+	    {
+	      exit (EXIT_FAILURE);
+	    }
+	}
+      counted_count = game_count;
+      rc = simulate_with_ctx (&scenario, &counted_count, &options,
+			      store, std_error,
+			      metrics_path, metrics_interval_ms,
+			      thread_count, pin_threads, avoid_smt,
+			      rank_count, low_count, high_count,
+			      &qualified_low_count);
+      razz_store_close (&store);
+    }
+  else if (show_lows)
+    {
+      rc = simulate_razz_scenario (&scenario, game_count, &options,
+				   low_count, NULL, low_index_listener);
+    }
+  else
+    {
+      rc = simulate_razz_scenario (&scenario, game_count, &options,
+				   rank_count, listener, NULL);
+    }
+
+  if (progress.is_shown)
+    {
+      fprintf (stderr, "\n");
+    }
+  if (rc == RAZZ_CANCELLED)
+    {
+      fprintf (stderr, "Interrupted after %lu of %lu games\n",
+	       progress.game_count, game_count);
+      game_count = use_ctx ? counted_count : progress.game_count;
+    }
+  else if (use_ctx)
+    {
+      game_count = counted_count;
+    }
+  else if (rc != 0)
+    {
+      exit (EXIT_FAILURE);
+    }
+  if (game_count == 0)
+    {
+      exit (EXIT_FAILURE);
+    }
+  if (show_perf)
+    {
+      print_perf_stats (&perf_counts);
+    }
+
+  if (options.variant != GAME_RAZZ)
+    {
+      print_high_distribution (high_count, game_count);
+      if (options.variant == GAME_STUD_HILO8)
+	{
+	  printf ("%15s = %.4f\n", "8-or-better low",
+		  (double) qualified_low_count / game_count);
+	}
+      exit (EXIT_SUCCESS);
+    }
+
+  if (show_lows)
     {
-      destroy_card (&decided_cards.opponent_cards[i]);
+      print_low_distribution (low_count, game_count);
+      exit (EXIT_SUCCESS);
     }
 
   end = K - R5 + 1;
@@ -0,0 +1,1481 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "razz_simulation.h"
+#include "razz_kernel.h"
+#include "cpu_topology.h"
+#include "perf_counters.h"
+
+/** The default number of games a worker runs at once. */
+#define DEFAULT_CHUNK_SIZE 65536
+
+/** The initial number of ranges a deque of chunks can hold. */
+#define INITIAL_DEQUE_CAPACITY 16
+
+/**
+ * The outcome counts of the chunks of a query run by the workers of one
+ * socket. It is allocated by the first worker of the socket that finishes a
+ * chunk of the query, so its memory is local to the socket. The counts are
+ * added atomically, so the workers never wait for each other to merge.
+ */
+struct socket_partial
+{
+  struct razz_result *result; /**< The outcome counts or NULL. */
+};
+
+/** A run split into chunks of games spread over the deques of a context. */
+struct razz_query
+{
+  struct razz_plan plan; /**< The prepared scenario. */
+  unsigned long game_count; /**< The total number of games to run. */
+  unsigned long chunk_count; /**< The total number of chunks. */
+  unsigned long done_chunk_count; /**< The number of finished chunks. */
+  unsigned long done_game_count; /**< The games of the finished chunks. */
+  unsigned int partial_count; /**< The number of socket partials. */
+  struct socket_partial *partials; /**< The partial result of every socket. */
+  int is_chunk_signalled; /**< Non-zero to signal every finished chunk. */
+  int is_finished; /**< Non-zero once the partials are merged. */
+  int is_withdrawn; /**< Non-zero if the remaining chunks are to be skipped. */
+  int event_fd; /**< The eventfd notified on completion or -1. */
+  uint64_t queue_ns; /**< When the query was queued. */
+  struct razz_ctx_impl *ctx; /**< The context running the query. */
+  struct razz_result *result; /**< The result to merge the partials into. */
+  pthread_mutex_t lock; /**< Protects the finished flag and the result. */
+  pthread_cond_t done; /**< Signalled when the query is finished. */
+};
+
+/** A range of chunks of a query that have not been taken yet. */
+struct chunk_range
+{
+  struct razz_query *q; /**< The query of the chunks. */
+  unsigned long first; /**< The first chunk of the range. */
+  unsigned long end; /**< One past the last chunk of the range. */
+};
+
+/**
+ * The chunks waiting to be run by a worker. The owner takes chunks from the
+ * bottom while the other workers steal from the top, so the owner works on
+ * the newest query and the thieves help with the oldest one.
+ */
+struct chunk_deque
+{
+  pthread_mutex_t lock; /**< Protects the ranges. */
+  struct chunk_range *ranges; /**< The ring buffer of ranges. */
+  unsigned int capacity; /**< The number of ranges the buffer can hold. */
+  unsigned int top; /**< The index of the top range. */
+  unsigned int len; /**< The number of ranges in the buffer. */
+};
+
+/** A worker thread of a context. */
+struct razz_worker
+{
+  struct razz_ctx_impl *ctx; /**< The context owning the worker. */
+  pthread_t thread; /**< The thread running the worker. */
+  unsigned int idx; /**< The index of the worker in the context. */
+  int cpu; /**< The CPU the worker is pinned to or -1. */
+  unsigned int package; /**< The index of the socket of the worker. */
+  uint64_t seed; /**< The seed of the random stream of the worker. */
+  struct chunk_deque deque; /**< The chunks waiting for the worker. */
+  struct razz_scratch scratch; /**< The random stream and working deck. */
+  struct razz_result *result; /**<
+			       * The outcome counts of the current chunk, which
+			       * like the scratch is allocated by the worker
+			       * itself so that its memory is local to the CPU.
+			       */
+  struct perf_group perf; /**<
+			   * The counters of the worker, which are opened by
+			   * the first chunk asking for them.
+			   */
+  int perf_state; /**<
+		   * 0 if the counters have not been opened, 1 if they are
+		   * open or -1 if they cannot be.
+		   */
+  razz_tracer *named_tracer; /**< The last tracer the worker is named in. */
+  unsigned long game_count; /**< The games run by the worker. */
+  unsigned long chunk_count; /**< The chunks run by the worker. */
+  uint64_t busy_ns; /**< The time spent running chunks. */
+};
+
+/** A simulation context. */
+struct razz_ctx_impl
+{
+  struct razz_ctx_options options; /**< The options of the context. */
+  pthread_mutex_t lock; /**< Protects the work epoch and the stop flag. */
+  pthread_cond_t work; /**< Signalled when chunks are pushed or on stop. */
+  pthread_cond_t ready; /**< Signalled when a worker has started. */
+  unsigned int started_count; /**< The number of workers done starting. */
+  int is_failed; /**< Non-zero if a worker cannot start. */
+  unsigned int package_count; /**< The number of sockets used. */
+  unsigned long work_epoch; /**<
+			     * Incremented whenever chunks are pushed, so that
+			     * an idle worker knows whether it has missed any.
+			     */
+  unsigned int next_worker; /**< The worker to get the first chunks next. */
+  int is_stopping; /**< Non-zero when the workers should exit. */
+  unsigned int worker_count; /**< The number of started workers. */
+  struct razz_worker *workers; /**< The workers of the context. */
+  unsigned long queued_query_count; /**< The queries queued so far. */
+  unsigned long finished_query_count; /**< The queries finished so far. */
+  unsigned long pending_chunk_count; /**< The chunks not finished yet. */
+  /** The queries finished in each latency bucket. */
+  unsigned long latency_counts[RAZZ_LATENCY_BUCKET_COUNT + 1];
+  uint64_t latency_sum_ns; /**< The total latency of the queries. */
+};
+
+/** A query submitted to run in the background. */
+struct razz_job_impl
+{
+  struct razz_ctx_impl *ctx; /**< The context running the query. */
+  struct razz_query query; /**< The query of the job. */
+  struct razz_result result; /**< The outcome counts of the query. */
+  int event_fd; /**< The eventfd notified when the query is finished. */
+};
+
+void
+init_razz_ctx_options (struct razz_ctx_options *options)
+{
+  options->thread_count = 0;
+  options->chunk_size = DEFAULT_CHUNK_SIZE;
+  options->seed = 0;
+  options->pin_threads = 0;
+  options->avoid_smt = 0;
+  init_simulation_options (&options->simulation);
+}
+
+/**
+ * Initializes an empty deque of chunks.
+ *
+ * @param [out] d the deque to be initialized.
+ *
+ * @return 0 if the deque is initialized or non-zero if there is no memory.
+ */
+static int
+init_chunk_deque (struct chunk_deque *d)
+{
+  d->ranges = malloc (INITIAL_DEQUE_CAPACITY * sizeof (*d->ranges));
+  if (d->ranges == NULL)
+    {
+      return 1;
+    }
+  d->capacity = INITIAL_DEQUE_CAPACITY;
+  d->top = 0;
+  d->len = 0;
+  pthread_mutex_init (&d->lock, NULL);
+
+  return 0;
+}
+
+/**
+ * Reclaims the memory space that was allocated for a deque of chunks.
+ *
+ * @param [in] d the deque to be released.
+ */
+static void
+release_chunk_deque (struct chunk_deque *d)
+{
+  if (d->ranges == NULL)
+    {
+      return;
+    }
+
+  pthread_mutex_destroy (&d->lock);
+  free (d->ranges);
+  d->ranges = NULL;
+}
+
+/**
+ * Pushes a range of chunks to the bottom of a deque.
+ *
+ * @param [in] d the deque to be pushed to.
+ * @param [in] r the range to be pushed.
+ *
+ * @return 0 if the range is pushed or non-zero if the deque cannot grow.
+ */
+static int
+push_chunk_range (struct chunk_deque *d, const struct chunk_range *r)
+{
+  pthread_mutex_lock (&d->lock);
+  if (d->len == d->capacity)
+    {
+      struct chunk_range *ranges;
+      unsigned int i;
+
+      ranges = malloc (2 * d->capacity * sizeof (*ranges));
+      if (ranges == NULL)
+	{
+	  pthread_mutex_unlock (&d->lock);
+	  return 1;
+	}
+      for (i = 0; i < d->len; i++)
+	{
+	  ranges[i] = d->ranges[(d->top + i) % d->capacity];
+	}
+      free (d->ranges);
+      d->ranges = ranges;
+      d->capacity *= 2;
+      d->top = 0;
+    }
+  d->ranges[(d->top + d->len) % d->capacity] = *r;
+  d->len++;
+  pthread_mutex_unlock (&d->lock);
+
+  return 0;
+}
+
+/**
+ * Checks whether or not the remaining chunks of a query are to be skipped.
+ *
+ * @param [in] q the query to be checked.
+ *
+ * @return non-zero if the query is withdrawn or cancelled.
+ */
+static int
+is_query_skipped (struct razz_query *q)
+{
+  return (__atomic_load_n (&q->is_withdrawn, __ATOMIC_RELAXED)
+	  || is_cancelled (&q->plan.options));
+}
+
+/**
+ * Takes one chunk from the bottom of the deque of its owner. All remaining
+ * chunks of a withdrawn or cancelled query are taken at once.
+ *
+ * @param [in] d the deque to take from.
+ * @param [out] r the taken chunks.
+ *
+ * @return non-zero if a chunk is taken or 0 if the deque is empty.
+ */
+static int
+pop_chunk (struct chunk_deque *d, struct chunk_range *r)
+{
+  struct chunk_range *bottom;
+
+  pthread_mutex_lock (&d->lock);
+  if (d->len == 0)
+    {
+      pthread_mutex_unlock (&d->lock);
+      return 0;
+    }
+
+  bottom = &d->ranges[(d->top + d->len - 1) % d->capacity];
+  r->q = bottom->q;
+  r->end = bottom->end;
+  if (is_query_skipped (bottom->q))
+    {
+      r->first = bottom->first;
+    }
+  else
+    {
+      r->first = bottom->end - 1;
+    }
+  bottom->end = r->first;
+  if (bottom->first == bottom->end)
+    {
+      d->len--;
+    }
+  pthread_mutex_unlock (&d->lock);
+
+  return 1;
+}
+
+/**
+ * Steals chunks from the top of the deque of another worker. Half of the top
+ * range is stolen, or the whole range if it has one chunk left or its query
+ * is withdrawn or cancelled.
+ *
+ * @param [in] d the deque to steal from.
+ * @param [out] r the stolen chunks.
+ *
+ * @return non-zero if a chunk is stolen or 0 if the deque is empty.
+ */
+static int
+steal_chunks (struct chunk_deque *d, struct chunk_range *r)
+{
+  struct chunk_range *top;
+  unsigned long half;
+
+  pthread_mutex_lock (&d->lock);
+  if (d->len == 0)
+    {
+      pthread_mutex_unlock (&d->lock);
+      return 0;
+    }
+
+  top = &d->ranges[d->top];
+  *r = *top;
+  half = (top->end - top->first) / 2;
+  if (half == 0 || is_query_skipped (top->q))
+    {
+      d->top = (d->top + 1) % d->capacity;
+      d->len--;
+    }
+  else
+    {
+      r->end = r->first + half;
+      top->first = r->end;
+    }
+  pthread_mutex_unlock (&d->lock);
+
+  return 1;
+}
+
+/**
+ * Tells the idle workers of a context that there are chunks to take.
+ *
+ * @param [in] ctx the context whose workers are told.
+ */
+static void
+announce_work (struct razz_ctx_impl *ctx)
+{
+  pthread_mutex_lock (&ctx->lock);
+  ctx->work_epoch++;
+  pthread_cond_broadcast (&ctx->work);
+  pthread_mutex_unlock (&ctx->lock);
+}
+
+/**
+ * Takes the next chunks to run for a worker from its own deque or else from
+ * the deque of another worker. When more than one chunk is stolen, all but
+ * the first are pushed to the own deque of the worker.
+ *
+ * @param [in] w the worker taking the chunks.
+ * @param [out] r the chunks to run, which are more than one only if their
+ *                query is withdrawn or cancelled.
+ *
+ * @return non-zero if a chunk is taken or 0 if every deque is empty.
+ */
+static int
+take_chunks (struct razz_worker *w, struct chunk_range *r)
+{
+  struct razz_ctx_impl *ctx = w->ctx;
+  unsigned int i;
+
+  if (pop_chunk (&w->deque, r))
+    {
+      return 1;
+    }
+
+  for (i = 1; i < ctx->options.thread_count; i++)
+    {
+      struct razz_worker *victim;
+      struct chunk_range rest;
+
+      victim = &ctx->workers[(w->idx + i) % ctx->options.thread_count];
+      if (!steal_chunks (&victim->deque, r))
+	{
+	  continue;
+	}
+
+      if (r->end - r->first > 1 && !is_query_skipped (r->q))
+	{
+	  rest.q = r->q;
+	  rest.first = r->first + 1;
+	  rest.end = r->end;
+	  if (push_chunk_range (&w->deque, &rest) == 0)
+	    {
+	      r->end = rest.first;
+	      announce_work (ctx);
+	    }
+	}
+
+      return 1;
+    }
+
+  return 0;
+}
+
+/**
+ * Computes the number of games in a chunk of a query.
+ *
+ * @param [in] ctx the context running the query.
+ * @param [in] q the query of the chunk.
+ * @param [in] chunk the index of the chunk.
+ *
+ * @return the number of games.
+ */
+static unsigned long
+get_chunk_game_count (const struct razz_ctx_impl *ctx,
+		      const struct razz_query *q, unsigned long chunk)
+{
+  if (chunk == q->chunk_count - 1)
+    {
+      return q->game_count - chunk * ctx->options.chunk_size;
+    }
+
+  return ctx->options.chunk_size;
+}
+
+/**
+ * Adds the outcome counts of a result to another result atomically.
+ *
+ * @param [in,out] dst the result to add to.
+ * @param [in] src the result to be added.
+ */
+static void
+merge_razz_result_atomically (struct razz_result *dst,
+			      const struct razz_result *src)
+{
+  unsigned int i;
+
+  __atomic_fetch_add (&dst->game_count, src->game_count, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&dst->invalid_rank_count, src->invalid_rank_count,
+		      __ATOMIC_RELAXED);
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      if (src->rank_counts[i] != 0)
+	{
+	  __atomic_fetch_add (&dst->rank_counts[i], src->rank_counts[i],
+			      __ATOMIC_RELAXED);
+	}
+    }
+  for (i = 0; i < RAZZ_LOW_INDEX_COUNT; i++)
+    {
+      if (src->low_counts[i] != 0)
+	{
+	  __atomic_fetch_add (&dst->low_counts[i], src->low_counts[i],
+			      __ATOMIC_RELAXED);
+	}
+    }
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      if (src->high_counts[i] != 0)
+	{
+	  __atomic_fetch_add (&dst->high_counts[i], src->high_counts[i],
+			      __ATOMIC_RELAXED);
+	}
+    }
+  __atomic_fetch_add (&dst->qualified_low_count, src->qualified_low_count,
+		      __ATOMIC_RELAXED);
+}
+
+/**
+ * Reads the outcome counts of a result that may be added to atomically at
+ * the same time and adds them to another result.
+ *
+ * @param [in,out] dst the result to add to.
+ * @param [in] src the result to be read.
+ */
+static void
+collect_razz_result (struct razz_result *dst, const struct razz_result *src)
+{
+  unsigned int i;
+
+  dst->game_count += __atomic_load_n (&src->game_count, __ATOMIC_RELAXED);
+  dst->invalid_rank_count += __atomic_load_n (&src->invalid_rank_count,
+					      __ATOMIC_RELAXED);
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      dst->rank_counts[i] += __atomic_load_n (&src->rank_counts[i],
+					      __ATOMIC_RELAXED);
+    }
+  for (i = 0; i < RAZZ_LOW_INDEX_COUNT; i++)
+    {
+      dst->low_counts[i] += __atomic_load_n (&src->low_counts[i],
+					     __ATOMIC_RELAXED);
+    }
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      dst->high_counts[i] += __atomic_load_n (&src->high_counts[i],
+					      __ATOMIC_RELAXED);
+    }
+  dst->qualified_low_count += __atomic_load_n (&src->qualified_low_count,
+					       __ATOMIC_RELAXED);
+}
+
+/**
+ * Adds the partial results of every socket of a query to a result.
+ *
+ * @param [in] q the query whose partials are added.
+ * @param [in,out] result the result to add the partials to.
+ */
+static void
+collect_partials (struct razz_query *q, struct razz_result *result)
+{
+  unsigned int i;
+
+  for (i = 0; i < q->partial_count; i++)
+    {
+      const struct razz_result *partial;
+
+      partial = __atomic_load_n (&q->partials[i].result, __ATOMIC_ACQUIRE);
+      if (partial != NULL)
+	{
+	  collect_razz_result (result, partial);
+	}
+    }
+}
+
+/**
+ * Adds the outcome counts of a chunk to the partial result of the socket of
+ * a worker without taking any lock.
+ *
+ * @param [in] q the query of the chunk.
+ * @param [in] w the worker that ran the chunk.
+ */
+static void
+merge_into_partial (struct razz_query *q, const struct razz_worker *w)
+{
+  struct socket_partial *p = &q->partials[w->package];
+  struct razz_result *partial;
+
+  partial = __atomic_load_n (&p->result, __ATOMIC_ACQUIRE);
+  if (partial == NULL)
+    {
+      struct razz_result *expected = NULL;
+
+      partial = malloc (sizeof (*partial));
+      if (partial == NULL)
+	{
+	  /* Fall back to the result of the query, which is not read until
+	     every chunk is finished */
+	  merge_razz_result_atomically (q->result, w->result);
+	  return;
+	}
+      clear_razz_result (partial);
+
+      if (!__atomic_compare_exchange_n (&p->result, &expected, partial, 0,
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+	  free (partial);
+	  partial = expected;
+	}
+    }
+
+  merge_razz_result_atomically (partial, w->result);
+}
+
+/**
+ * Marks the completion of a query by merging the partial results of the
+ * sockets, waking up its waiter and notifying its eventfd. The lock of the
+ * query must be held.
+ *
+ * @param [in] q the query whose chunks are all finished.
+ */
+static void
+finish_query (struct razz_query *q)
+{
+  struct razz_ctx_impl *ctx = q->ctx;
+  uint64_t one = 1;
+  uint64_t latency_ns = razz_trace_now () - q->queue_ns;
+  unsigned int bucket = 0;
+
+  while (bucket < RAZZ_LATENCY_BUCKET_COUNT
+	 && latency_ns > RAZZ_LATENCY_BUCKET_BOUND_US (bucket) * 1000)
+    {
+      bucket++;
+    }
+  __atomic_fetch_add (&ctx->latency_counts[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&ctx->latency_sum_ns, latency_ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&ctx->finished_query_count, 1, __ATOMIC_RELEASE);
+
+  razz_trace_span (q->plan.options.tracer, "ctx", "query", q->queue_ns,
+		   q->game_count);
+  collect_partials (q, q->result);
+  q->is_finished = 1;
+  pthread_cond_broadcast (&q->done);
+  if (q->event_fd != -1 && write (q->event_fd, &one, sizeof (one)) == -1)
+    {
+      perror ("Cannot notify the completion of a query");
+    }
+}
+
+/**
+ * Adds to a counter of a worker, which only the worker itself writes, so that
+ * a concurrent reader sees either the old or the new count.
+ *
+ * @param [in,out] counter the counter of the worker.
+ * @param [in] increment the amount to be added.
+ */
+static void
+add_worker_count (unsigned long *counter, unsigned long increment)
+{
+  __atomic_store_n (counter, *counter + increment, __ATOMIC_RELAXED);
+}
+
+/**
+ * Runs a range of chunks taken by a worker and merges their outcome counts.
+ * The chunks of a withdrawn or cancelled query are skipped.
+ *
+ * @param [in] w the worker running the chunks.
+ * @param [in] r the chunks to be run.
+ */
+static void
+run_chunks (struct razz_worker *w, const struct chunk_range *r)
+{
+  struct razz_query *q = r->q;
+  razz_tracer *tracer = q->plan.options.tracer;
+  unsigned long chunk;
+  unsigned long chunk_count = r->end - r->first;
+  uint64_t busy_start_ns = razz_trace_now ();
+
+  if (tracer != NULL && w->named_tracer != tracer)
+    {
+      char name[32];
+
+      snprintf (name, sizeof (name), "worker %u", w->idx);
+      razz_trace_thread_name (tracer, name);
+      w->named_tracer = tracer;
+    }
+
+  for (chunk = r->first; chunk < r->end && !is_query_skipped (q); chunk++)
+    {
+      struct perf_counts *perf_counts = q->plan.options.perf_counts;
+      uint64_t before[PERF_EVENT_KIND_COUNT];
+      uint64_t after[PERF_EVENT_KIND_COUNT];
+      int is_counted = 0;
+      uint64_t start_ns = tracer == NULL ? 0 : razz_trace_now ();
+
+      if (perf_counts != NULL)
+	{
+	  if (w->perf_state == 0)
+	    {
+	      w->perf_state = open_perf_group (&w->perf) ? -1 : 1;
+	    }
+	  is_counted = (w->perf_state == 1
+			&& read_perf_group (&w->perf, before) == 0);
+	}
+
+      clear_razz_result (w->result);
+      w->scratch.next_game = (q->plan.options.first_game_index
+			      + chunk * w->ctx->options.chunk_size);
+      run_razz_plan (&q->plan, &w->scratch,
+		     get_chunk_game_count (w->ctx, q, chunk), w->result);
+
+      if (perf_counts != NULL)
+	{
+	  is_counted = is_counted && read_perf_group (&w->perf, after) == 0;
+	  add_perf_counts (perf_counts, is_counted ? &w->perf : NULL,
+			   before, after, w->result->game_count);
+	}
+      razz_trace_span (tracer, "ctx", "chunk", start_ns,
+		       w->result->game_count);
+
+      start_ns = tracer == NULL ? 0 : razz_trace_now ();
+      merge_into_partial (q, w);
+      razz_trace_span (tracer, "ctx", "merge", start_ns, w->package);
+      __atomic_fetch_add (&q->done_game_count, w->result->game_count,
+			  __ATOMIC_RELAXED);
+      add_worker_count (&w->game_count, w->result->game_count);
+      add_worker_count (&w->chunk_count, 1);
+    }
+  __atomic_store_n (&w->busy_ns,
+		    w->busy_ns + (razz_trace_now () - busy_start_ns),
+		    __ATOMIC_RELAXED);
+  __atomic_fetch_sub (&w->ctx->pending_chunk_count, chunk_count,
+		      __ATOMIC_RELAXED);
+
+  if (q->is_chunk_signalled)
+    {
+      /* The waiter may free the query once it is finished, so the count
+	 and the signal have to be under the lock */
+      pthread_mutex_lock (&q->lock);
+      q->done_chunk_count += chunk_count;
+      if (q->done_chunk_count == q->chunk_count)
+	{
+	  finish_query (q);
+	}
+      else
+	{
+	  pthread_cond_signal (&q->done);
+	}
+      pthread_mutex_unlock (&q->lock);
+    }
+  else if (__atomic_add_fetch (&q->done_chunk_count, chunk_count,
+			       __ATOMIC_ACQ_REL) == q->chunk_count)
+    {
+      pthread_mutex_lock (&q->lock);
+      finish_query (q);
+      pthread_mutex_unlock (&q->lock);
+    }
+}
+
+/**
+ * Pins a worker to its CPU and allocates its scratch state from there, then
+ * reports to the context whether or not the worker has started.
+ *
+ * @param [in] w the worker to be started.
+ *
+ * @return 0 if the worker has started or non-zero if it cannot.
+ */
+static int
+start_worker (struct razz_worker *w)
+{
+  struct razz_ctx_impl *ctx = w->ctx;
+  int rc = 0;
+
+  if (w->cpu != -1)
+    {
+      cpu_set_t mask;
+
+      CPU_ZERO (&mask);
+      CPU_SET (w->cpu, &mask);
+      if (pthread_setaffinity_np (pthread_self (), sizeof (mask), &mask))
+	{
+	  fprintf (stderr, "Cannot pin a worker to CPU %d\n", w->cpu);
+	}
+    }
+
+  w->result = malloc (sizeof (*w->result));
+  if (w->result == NULL)
+    {
+      rc = 1;
+    }
+  else if (init_razz_scratch (&w->scratch, w->seed))
+    {
+      free (w->result);
+      w->result = NULL;
+      rc = 1;
+    }
+  else
+    {
+      clear_razz_result (w->result);
+    }
+
+  pthread_mutex_lock (&ctx->lock);
+  ctx->started_count++;
+  if (rc)
+    {
+      ctx->is_failed = 1;
+    }
+  pthread_cond_broadcast (&ctx->ready);
+  pthread_mutex_unlock (&ctx->lock);
+
+  return rc;
+}
+
+/** The body of a worker thread. */
+static void *
+work (void *arg)
+{
+  struct razz_worker *w = arg;
+  struct razz_ctx_impl *ctx = w->ctx;
+  struct chunk_range r;
+  unsigned long seen_epoch;
+
+  if (start_worker (w))
+    {
+      return NULL;
+    }
+
+  for (;;)
+    {
+      seen_epoch = __atomic_load_n (&ctx->work_epoch, __ATOMIC_ACQUIRE);
+      if (take_chunks (w, &r))
+	{
+	  run_chunks (w, &r);
+	  continue;
+	}
+
+      pthread_mutex_lock (&ctx->lock);
+      while (ctx->work_epoch == seen_epoch && !ctx->is_stopping)
+	{
+	  pthread_cond_wait (&ctx->work, &ctx->lock);
+	}
+      if (ctx->is_stopping)
+	{
+	  pthread_mutex_unlock (&ctx->lock);
+	  break;
+	}
+      pthread_mutex_unlock (&ctx->lock);
+    }
+
+  if (w->perf_state != 0)
+    {
+      close_perf_group (&w->perf);
+    }
+  release_razz_scratch (&w->scratch);
+  free (w->result);
+
+  return NULL;
+}
+
+/**
+ * Decides the CPU and the socket of every worker of a context.
+ *
+ * @param [in,out] ctx the context whose workers are placed.
+ *
+ * @return 0 if the workers are placed or non-zero if the topology cannot be
+ *         discovered.
+ */
+static int
+place_workers (struct razz_ctx_impl *ctx)
+{
+  struct cpu_topology t;
+  unsigned int *cpus;
+  unsigned int i;
+
+  ctx->package_count = 1;
+  if (!ctx->options.pin_threads)
+    {
+      for (i = 0; i < ctx->options.thread_count; i++)
+	{
+	  ctx->workers[i].cpu = -1;
+	  ctx->workers[i].package = 0;
+	}
+      return 0;
+    }
+
+  if (read_cpu_topology (&t))
+    {
+      return 1;
+    }
+
+  cpus = malloc (ctx->options.thread_count * sizeof (*cpus));
+  if (cpus == NULL)
+    {
+      release_cpu_topology (&t);
+      return 1;
+    }
+
+  assign_worker_cpus (&t, ctx->options.avoid_smt, ctx->options.thread_count,
+		      cpus);
+  for (i = 0; i < ctx->options.thread_count; i++)
+    {
+      ctx->workers[i].cpu = t.cpus[cpus[i]].cpu;
+      ctx->workers[i].package = t.cpus[cpus[i]].package;
+    }
+  ctx->package_count = t.package_count;
+
+  free (cpus);
+  release_cpu_topology (&t);
+
+  return 0;
+}
+
+razz_ctx *
+razz_ctx_create (const struct razz_ctx_options *options)
+{
+  struct razz_ctx_impl *ctx;
+  unsigned int i;
+  long cpu_count;
+
+  ctx = calloc (1, sizeof (*ctx));
+  if (ctx == NULL)
+    {
+      return NULL;
+    }
+
+  if (options == NULL)
+    {
+      init_razz_ctx_options (&ctx->options);
+    }
+  else
+    {
+      ctx->options = *options;
+    }
+  if (ctx->options.thread_count == 0 && ctx->options.pin_threads)
+    {
+      struct cpu_topology t;
+
+      if (read_cpu_topology (&t) == 0)
+	{
+	  ctx->options.thread_count = count_worker_cpus (&t,
+							 ctx->options.avoid_smt);
+	  release_cpu_topology (&t);
+	}
+    }
+  if (ctx->options.thread_count == 0)
+    {
+      cpu_count = sysconf (_SC_NPROCESSORS_ONLN);
+      ctx->options.thread_count = (cpu_count > 0 ? cpu_count : 1);
+    }
+  if (ctx->options.chunk_size == 0)
+    {
+      ctx->options.chunk_size = DEFAULT_CHUNK_SIZE;
+    }
+  if (ctx->options.seed == 0)
+    {
+      ctx->options.seed = ((uint64_t) lrand48 () << 31) ^ lrand48 ();
+    }
+
+  pthread_mutex_init (&ctx->lock, NULL);
+  pthread_cond_init (&ctx->work, NULL);
+  pthread_cond_init (&ctx->ready, NULL);
+
+  ctx->workers = calloc (ctx->options.thread_count, sizeof (*ctx->workers));
+  if (ctx->workers == NULL || place_workers (ctx))
+    {
+      razz_ctx_destroy (&ctx);
+      return NULL;
+    }
+  for (i = 0; i < ctx->options.thread_count; i++)
+    {
+      if (init_chunk_deque (&ctx->workers[i].deque))
+	{
+	  razz_ctx_destroy (&ctx);
+	  return NULL;
+	}
+    }
+
+  for (i = 0; i < ctx->options.thread_count; i++)
+    {
+      struct razz_worker *w = &ctx->workers[i];
+
+      w->ctx = ctx;
+      w->idx = i;
+      w->seed = ctx->options.seed + i * 0x9E3779B97F4A7C15ULL;
+      if (pthread_create (&w->thread, NULL, work, w))
+	{
+	  break;
+	}
+      ctx->worker_count++;
+    }
+
+  pthread_mutex_lock (&ctx->lock);
+  while (ctx->started_count != ctx->worker_count)
+    {
+      pthread_cond_wait (&ctx->ready, &ctx->lock);
+    }
+  pthread_mutex_unlock (&ctx->lock);
+
+  if (ctx->is_failed || ctx->worker_count != ctx->options.thread_count)
+    {
+      razz_ctx_destroy (&ctx);
+      return NULL;
+    }
+
+  return ctx;
+}
+
+/**
+ * Prepares a query and spreads its chunks over the deques of the workers of
+ * a context.
+ *
+ * @param [in] ctx the context whose workers run the query.
+ * @param [out] q the query to be prepared.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated, which must
+ *                        not be 0.
+ * @param [in] options the options of the run.
+ * @param [out] result the result to merge the chunks into.
+ * @param [in] event_fd the eventfd to notify on completion or -1.
+ *
+ * @return 0 if the query is queued or non-zero if it cannot be.
+ */
+static int
+queue_query (struct razz_ctx_impl *ctx, struct razz_query *q,
+	     const struct razz_scenario *scenario, unsigned long game_count,
+	     const struct simulation_options *options,
+	     struct razz_result *result, int event_fd)
+{
+  pthread_condattr_t attr;
+  struct chunk_range *ranges;
+  unsigned int range_count;
+  unsigned int first_worker;
+  unsigned int i;
+
+  clear_razz_result (result);
+  q->queue_ns = razz_trace_now ();
+  q->ctx = ctx;
+  q->game_count = game_count;
+  q->chunk_count = ((game_count + ctx->options.chunk_size - 1)
+		    / ctx->options.chunk_size);
+
+  /* Give every worker an equal share starting from a rotating worker so
+     that small queries do not all land on the same deque */
+  range_count = ctx->options.thread_count;
+  if (q->chunk_count < range_count)
+    {
+      range_count = q->chunk_count;
+    }
+  ranges = malloc (range_count * sizeof (*ranges));
+  if (ranges == NULL)
+    {
+      return 1;
+    }
+  for (i = 0; i < range_count; i++)
+    {
+      ranges[i].q = q;
+      ranges[i].first = q->chunk_count * i / range_count;
+      ranges[i].end = q->chunk_count * (i + 1) / range_count;
+    }
+
+  q->partial_count = ctx->package_count;
+  q->partials = calloc (q->partial_count, sizeof (*q->partials));
+  if (q->partials == NULL)
+    {
+      free (ranges);
+      return 1;
+    }
+  if (prepare_razz_plan (&q->plan, scenario, options))
+    {
+      fprintf (stderr, "Cannot prepare the scenario\n");
+      free (q->partials);
+      free (ranges);
+      return 1;
+    }
+  q->done_chunk_count = 0;
+  q->done_game_count = 0;
+  q->is_chunk_signalled = (event_fd == -1
+			   && options->progress_listener != NULL);
+  q->is_finished = 0;
+  q->is_withdrawn = 0;
+  q->event_fd = event_fd;
+  q->result = result;
+  pthread_mutex_init (&q->lock, NULL);
+  pthread_condattr_init (&attr);
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+  pthread_cond_init (&q->done, &attr);
+  pthread_condattr_destroy (&attr);
+
+  __atomic_fetch_add (&ctx->queued_query_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&ctx->pending_chunk_count, q->chunk_count,
+		      __ATOMIC_RELAXED);
+
+  pthread_mutex_lock (&ctx->lock);
+  first_worker = ctx->next_worker;
+  ctx->next_worker = (first_worker + range_count) % ctx->options.thread_count;
+  pthread_mutex_unlock (&ctx->lock);
+
+  for (i = 0; i < range_count; i++)
+    {
+      struct razz_worker *w;
+
+      w = &ctx->workers[(first_worker + i) % ctx->options.thread_count];
+      if (push_chunk_range (&w->deque, &ranges[i]))
+	{
+	  /* Account for the chunks that will never be taken. The workers of
+	     a signalled query add to the count under the lock without an
+	     atomic operation, so the lock has to be held here as well */
+	  __atomic_fetch_sub (&ctx->pending_chunk_count,
+			      ranges[i].end - ranges[i].first,
+			      __ATOMIC_RELAXED);
+	  pthread_mutex_lock (&q->lock);
+	  q->is_withdrawn = 1;
+	  if (__atomic_add_fetch (&q->done_chunk_count,
+				  ranges[i].end - ranges[i].first,
+				  __ATOMIC_ACQ_REL) == q->chunk_count)
+	    {
+	      finish_query (q);
+	    }
+	  pthread_mutex_unlock (&q->lock);
+	}
+    }
+  free (ranges);
+
+  announce_work (ctx);
+
+  return 0;
+}
+
+/**
+ * Reclaims the resources of a finished query.
+ *
+ * @param [in] q the query whose chunks are all finished.
+ */
+static void
+release_query (struct razz_query *q)
+{
+  unsigned int i;
+
+  for (i = 0; i < q->partial_count; i++)
+    {
+      free (q->partials[i].result);
+    }
+  free (q->partials);
+  pthread_cond_destroy (&q->done);
+  pthread_mutex_destroy (&q->lock);
+  release_razz_plan (&q->plan);
+}
+
+/**
+ * Makes the workers skip the chunks of a query that have not been started.
+ *
+ * @param [in] q the query to be withdrawn.
+ */
+static void
+withdraw_query (struct razz_query *q)
+{
+  __atomic_store_n (&q->is_withdrawn, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Computes the point in time a number of milliseconds from now on the clock
+ * of the condition variables of the queries.
+ *
+ * @param [out] deadline the point in time.
+ * @param [in] timeout_ms the number of milliseconds from now.
+ */
+static void
+get_deadline (struct timespec *deadline, unsigned long timeout_ms)
+{
+  clock_gettime (CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += timeout_ms / 1000;
+  deadline->tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (deadline->tv_nsec >= 1000000000)
+    {
+      deadline->tv_sec++;
+      deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/**
+ * Waits on the condition variable of a query for at most a number of
+ * milliseconds.
+ *
+ * @param [in] q the query whose lock is held.
+ * @param [in] timeout_ms the longest time to wait or 0 to wait without any
+ *                        time limit.
+ */
+static void
+wait_for_chunk (struct razz_query *q, unsigned long timeout_ms)
+{
+  struct timespec deadline;
+
+  if (timeout_ms == 0)
+    {
+      pthread_cond_wait (&q->done, &q->lock);
+      return;
+    }
+
+  get_deadline (&deadline, timeout_ms);
+  while (pthread_cond_timedwait (&q->done, &q->lock, &deadline) == EINTR)
+    {
+    }
+}
+
+int
+razz_ctx_run (razz_ctx *ctx, const struct decided_cards *scenario,
+	      unsigned long game_count, struct razz_result *result)
+{
+  return razz_ctx_run_with_options (ctx, scenario, game_count,
+				    &ctx->options.simulation, result);
+}
+
+int
+razz_ctx_run_with_options (razz_ctx *ctx, const struct decided_cards *scenario,
+			   unsigned long game_count,
+			   const struct simulation_options *options,
+			   struct razz_result *result)
+{
+  struct razz_scenario packed;
+
+  if (pack_decided_cards (scenario, &packed))
+    {
+      clear_razz_result (result);
+      fprintf (stderr, "Duplicated decided cards\n");
+      return 1;
+    }
+
+  return razz_ctx_run_scenario (ctx, &packed, game_count, options, result);
+}
+
+int
+razz_ctx_run_scenario (razz_ctx *ctx, const struct razz_scenario *scenario,
+		       unsigned long game_count,
+		       const struct simulation_options *options,
+		       struct razz_result *result)
+{
+  int rc = 0;
+  unsigned long timeout_ms;
+  struct razz_query q;
+  struct progress_tracker tracker;
+  struct razz_result *snapshot = NULL;
+
+  clear_razz_result (result);
+  if (game_count == 0)
+    {
+      return 0;
+    }
+
+  if (options == NULL)
+    {
+      options = &ctx->options.simulation;
+    }
+  timeout_ms = options->progress_interval_ms;
+  start_progress (&tracker, options, game_count);
+
+  if (queue_query (ctx, &q, scenario, game_count, options, result, -1))
+    {
+      return 1;
+    }
+
+  pthread_mutex_lock (&q.lock);
+  while (!q.is_finished)
+    {
+      unsigned long done_game_count;
+
+      wait_for_chunk (&q, timeout_ms);
+
+      done_game_count = __atomic_load_n (&q.done_game_count,
+					 __ATOMIC_RELAXED);
+      if (!q.is_finished && is_progress_due (&tracker, done_game_count, 0))
+	{
+	  if (snapshot == NULL)
+	    {
+	      snapshot = malloc (sizeof (*snapshot));
+	    }
+	  if (snapshot != NULL)
+	    {
+	      clear_razz_result (snapshot);
+	      collect_partials (&q, snapshot);
+	      pthread_mutex_unlock (&q.lock);
+	      report_progress (&tracker, snapshot->game_count, snapshot);
+	      pthread_mutex_lock (&q.lock);
+	    }
+	}
+    }
+  if (result->game_count != game_count)
+    {
+      rc = RAZZ_CANCELLED;
+    }
+  pthread_mutex_unlock (&q.lock);
+
+  poll_progress (&tracker, result->game_count, result, 1);
+
+  free (snapshot);
+  release_query (&q);
+
+  return rc;
+}
+
+razz_job *
+razz_submit (razz_ctx *ctx, const struct decided_cards *scenario,
+	     unsigned long game_count,
+	     const struct simulation_options *options)
+{
+  struct razz_scenario packed;
+
+  if (pack_decided_cards (scenario, &packed))
+    {
+      return NULL;
+    }
+
+  return razz_submit_scenario (ctx, &packed, game_count, options);
+}
+
+razz_job *
+razz_submit_scenario (razz_ctx *ctx, const struct razz_scenario *scenario,
+		      unsigned long game_count,
+		      const struct simulation_options *options)
+{
+  struct razz_job_impl *job;
+
+  if (game_count == 0)
+    {
+      return NULL;
+    }
+
+  job = malloc (sizeof (*job));
+  if (job == NULL)
+    {
+      return NULL;
+    }
+  job->ctx = ctx;
+
+  job->event_fd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (job->event_fd == -1)
+    {
+      free (job);
+      return NULL;
+    }
+
+  if (queue_query (ctx, &job->query, scenario, game_count,
+		   options == NULL ? &ctx->options.simulation : options,
+		   &job->result, job->event_fd))
+    {
+      close (job->event_fd);
+      free (job);
+      return NULL;
+    }
+
+  return job;
+}
+
+int
+razz_job_fd (const razz_job *job)
+{
+  return job->event_fd;
+}
+
+int
+razz_poll (razz_job *job, unsigned long *game_count)
+{
+  struct razz_query *q = &job->query;
+  int is_done;
+
+  pthread_mutex_lock (&q->lock);
+  is_done = q->is_finished;
+  pthread_mutex_unlock (&q->lock);
+  if (game_count != NULL)
+    {
+      *game_count = __atomic_load_n (&q->done_game_count, __ATOMIC_RELAXED);
+    }
+
+  return is_done;
+}
+
+int
+razz_wait (razz_job *job, long timeout_ms)
+{
+  struct razz_query *q = &job->query;
+  struct timespec deadline;
+  int is_done;
+
+  if (timeout_ms > 0)
+    {
+      get_deadline (&deadline, timeout_ms);
+    }
+
+  pthread_mutex_lock (&q->lock);
+  while (!q->is_finished)
+    {
+      if (timeout_ms < 0)
+	{
+	  pthread_cond_wait (&q->done, &q->lock);
+	}
+      else if (timeout_ms == 0
+	       || pthread_cond_timedwait (&q->done, &q->lock,
+					  &deadline) == ETIMEDOUT)
+	{
+	  break;
+	}
+    }
+  is_done = q->is_finished;
+  pthread_mutex_unlock (&q->lock);
+
+  return is_done;
+}
+
+void
+razz_cancel (razz_job *job)
+{
+  withdraw_query (&job->query);
+}
+
+int
+razz_job_result (razz_job *job, struct razz_result *result)
+{
+  if (!razz_poll (job, NULL))
+    {
+      return 1;
+    }
+
+  *result = job->result;
+
+  return (job->result.game_count == job->query.game_count
+	  ? 0 : RAZZ_CANCELLED);
+}
+
+void
+razz_job_destroy (razz_job **job_ptr)
+{
+  struct razz_job_impl *job = *job_ptr;
+
+  if (job == NULL)
+    {
+      return;
+    }
+
+  razz_cancel (job);
+  razz_wait (job, -1);
+
+  release_query (&job->query);
+  close (job->event_fd);
+  free (job);
+
+  *job_ptr = NULL;
+}
+
+void
+razz_ctx_get_metrics (razz_ctx *ctx, struct razz_ctx_metrics *metrics)
+{
+  unsigned int i;
+
+  metrics->worker_count = ctx->worker_count;
+  metrics->game_count = 0;
+  for (i = 0; i < ctx->worker_count; i++)
+    {
+      metrics->game_count += __atomic_load_n (&ctx->workers[i].game_count,
+					      __ATOMIC_RELAXED);
+    }
+  /* A query is counted as queued before its chunks are pushed and as
+     finished after they are all run, so reading the finished count first
+     keeps it from exceeding the queued count read afterwards */
+  metrics->finished_query_count = __atomic_load_n (&ctx->finished_query_count,
+						   __ATOMIC_ACQUIRE);
+  metrics->queued_query_count = __atomic_load_n (&ctx->queued_query_count,
+						 __ATOMIC_RELAXED);
+  metrics->pending_chunk_count = __atomic_load_n (&ctx->pending_chunk_count,
+						  __ATOMIC_RELAXED);
+  for (i = 0; i <= RAZZ_LATENCY_BUCKET_COUNT; i++)
+    {
+      metrics->latency_counts[i] = __atomic_load_n (&ctx->latency_counts[i],
+						    __ATOMIC_RELAXED);
+    }
+  metrics->latency_sum = __atomic_load_n (&ctx->latency_sum_ns,
+					  __ATOMIC_RELAXED) / 1e9;
+}
+
+void
+razz_ctx_get_worker_metrics (razz_ctx *ctx, unsigned int worker,
+			     struct razz_worker_metrics *metrics)
+{
+  struct razz_worker *w = &ctx->workers[worker];
+
+  metrics->game_count = __atomic_load_n (&w->game_count, __ATOMIC_RELAXED);
+  metrics->chunk_count = __atomic_load_n (&w->chunk_count, __ATOMIC_RELAXED);
+  metrics->busy_time = __atomic_load_n (&w->busy_ns, __ATOMIC_RELAXED) / 1e9;
+}
+
+void
+razz_ctx_destroy (razz_ctx **ctx_ptr)
+{
+  struct razz_ctx_impl *ctx = *ctx_ptr;
+  unsigned int i;
+
+  if (ctx == NULL)
+    {
+      return;
+    }
+
+  pthread_mutex_lock (&ctx->lock);
+  ctx->is_stopping = 1;
+  pthread_cond_broadcast (&ctx->work);
+  pthread_mutex_unlock (&ctx->lock);
+
+  for (i = 0; i < ctx->worker_count; i++)
+    {
+      pthread_join (ctx->workers[i].thread, NULL);
+    }
+  if (ctx->workers != NULL)
+    {
+      for (i = 0; i < ctx->options.thread_count; i++)
+	{
+	  release_chunk_deque (&ctx->workers[i].deque);
+	}
+    }
+
+  pthread_cond_destroy (&ctx->ready);
+  pthread_cond_destroy (&ctx->work);
+  pthread_mutex_destroy (&ctx->lock);
+  free (ctx->workers);
+  free (ctx);
+
+  *ctx_ptr = NULL;
+}
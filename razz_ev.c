@@ -0,0 +1,816 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "razz_ev.h"
+#include "razz_simulation.h"
+#include "rng.h"
+
+/** The number of cards each player holds at the showdown. */
+#define SHOWDOWN_CARD_COUNT 7
+
+/** The initial number of entries of the memo, which is a power of two. */
+#define INITIAL_MEMO_CAPACITY 4096
+
+/** 5^13, the number of codes of the rank counts of a hand. */
+#define RANK_COUNT_CODE_COUNT 1220703125ULL
+
+/** The number of hidden cards the opponent holds at the showdown. */
+#define HIDDEN_CARD_COUNT (SHOWDOWN_CARD_COUNT - RAZZ_UPCARD_COUNT)
+
+/** The number of multisets of three ranks, which is C(13 + 2, 3). */
+#define HIDDEN_DEAL_COUNT 455
+
+/** The low index marking a hidden deal that is impossible. */
+#define NO_LOW 0xFFFF
+
+/** A memoized decision node. */
+struct memo_entry
+{
+  uint64_t key; /**< The code of the node or 0 if the entry is empty. */
+  double value; /**< The EV of playing the node optimally. */
+};
+
+/**
+ * The Razz low of the opponent for every hidden deal given its upcards. It
+ * does not depend on any other card, so it is kept for the life of a solver.
+ */
+struct showdown_entry
+{
+  uint64_t key; /**< The code of the opponent upcards or 0 if empty. */
+  uint16_t *lows; /**< The low index of each hidden deal or ::NO_LOW. */
+};
+
+/** A solver. */
+struct razz_ev_impl
+{
+  struct razz_ev_options options; /**< The options of the solver. */
+  rng *rng; /**< The generator of the sampled deals. */
+  uint8_t dead_counts[RANK_COUNT]; /**< The dead cards the memo is for. */
+  uint8_t street; /**< The street the memo is for or 0 if it is empty. */
+  double pots[SHOWDOWN_CARD_COUNT + 1]; /**< The pot before each street. */
+  struct memo_entry *memo; /**< The open-addressing table of nodes. */
+  unsigned long memo_capacity; /**< The number of entries of the memo. */
+  unsigned long memo_count; /**< The number of used entries. */
+  uint8_t hidden_deals[HIDDEN_DEAL_COUNT][HIDDEN_CARD_COUNT]; /**<
+							     * The ranks of
+							     * every hidden
+							     * deal in
+							     * ascending order.
+							     */
+  struct showdown_entry *showdowns; /**< The table of opponent lows. */
+  unsigned long showdown_capacity; /**< The number of entries of the table. */
+  unsigned long showdown_count; /**< The number of used entries. */
+  int is_failed; /**< Non-zero if the query has run out of memory. */
+  unsigned long node_count; /**< The nodes evaluated by the query. */
+  unsigned long memo_hit_count; /**< The nodes found by the query. */
+};
+
+void
+init_razz_ev_options (struct razz_ev_options *options)
+{
+  options->pot = 1;
+  options->small_bet = 1;
+  options->big_bet = 2;
+  options->policy = OPPONENT_ALWAYS_CONTINUES;
+  options->threshold = K;
+  options->exact_street_count = 2;
+  options->sample_count = 16;
+  options->seed = 0;
+  options->tracer = NULL;
+}
+
+razz_ev *
+razz_ev_create (const struct razz_ev_options *options)
+{
+  struct razz_ev_impl *ev;
+  int a, b, c, n;
+
+  ev = calloc (1, sizeof (*ev));
+  if (ev == NULL)
+    {
+      return NULL;
+    }
+
+  if (options == NULL)
+    {
+      init_razz_ev_options (&ev->options);
+    }
+  else
+    {
+      ev->options = *options;
+    }
+  if (ev->options.sample_count == 0
+      || ev->options.exact_street_count > RAZZ_EV_MAX_EXACT_STREET_COUNT)
+    {
+      free (ev);
+      return NULL;
+    }
+  if (ev->options.seed == 0)
+    {
+      ev->options.seed = ((uint64_t) lrand48 () << 31) ^ lrand48 ();
+    }
+
+  ev->rng = create_rng (ev->options.seed);
+  ev->memo_capacity = INITIAL_MEMO_CAPACITY;
+  ev->memo = calloc (ev->memo_capacity, sizeof (*ev->memo));
+  ev->showdown_capacity = INITIAL_MEMO_CAPACITY;
+  ev->showdowns = calloc (ev->showdown_capacity, sizeof (*ev->showdowns));
+  if (ev->rng == NULL || ev->memo == NULL || ev->showdowns == NULL)
+    {
+      razz_ev_destroy (&ev);
+      return NULL;
+    }
+
+  n = 0;
+  for (a = 0; a < RANK_COUNT; a++)
+    {
+      for (b = a; b < RANK_COUNT; b++)
+	{
+	  for (c = b; c < RANK_COUNT; c++)
+	    {
+	      ev->hidden_deals[n][0] = a;
+	      ev->hidden_deals[n][1] = b;
+	      ev->hidden_deals[n][2] = c;
+	      n++;
+	    }
+	}
+    }
+
+  return ev;
+}
+
+void
+razz_ev_destroy (razz_ev **ev_ptr)
+{
+  struct razz_ev_impl *ev = *ev_ptr;
+  unsigned long i;
+
+  if (ev == NULL)
+    {
+      return;
+    }
+
+  destroy_rng (&ev->rng);
+  free (ev->memo);
+  if (ev->showdowns != NULL)
+    {
+      for (i = 0; i < ev->showdown_capacity; i++)
+	{
+	  free (ev->showdowns[i].lows);
+	}
+    }
+  free (ev->showdowns);
+  free (ev);
+
+  *ev_ptr = NULL;
+}
+
+/**
+ * Encodes the rank counts of a hand as a number in base 5.
+ *
+ * @param [in] counts the number of cards of each rank.
+ *
+ * @return the code, which is below ::RANK_COUNT_CODE_COUNT.
+ */
+static uint64_t
+encode_rank_counts (const uint8_t counts[RANK_COUNT])
+{
+  uint64_t code = 0;
+  int r;
+
+  for (r = 0; r < RANK_COUNT; r++)
+    {
+      code = code * 5 + counts[r];
+    }
+
+  return code;
+}
+
+/**
+ * Computes the key of a decision node. Both hands are reduced to their rank
+ * counts, so all deals that differ only in suits or in the order of the cards
+ * share the same key. The street is implied by the number of my cards.
+ *
+ * @param [in] my_counts the rank counts of my cards.
+ * @param [in] opponent_counts the rank counts of the opponent upcards.
+ *
+ * @return the key, which is never 0 because I hold at least three cards.
+ */
+static uint64_t
+get_node_key (const uint8_t my_counts[RANK_COUNT],
+	      const uint8_t opponent_counts[RANK_COUNT])
+{
+  return (encode_rank_counts (my_counts) * RANK_COUNT_CODE_COUNT
+	  + encode_rank_counts (opponent_counts));
+}
+
+/**
+ * Finds the entry of a key in the memo.
+ *
+ * @param [in] ev the solver whose memo is searched.
+ * @param [in] key the key to be found.
+ *
+ * @return the entry holding the key or the empty entry where it belongs.
+ */
+static struct memo_entry *
+find_memo_entry (struct razz_ev_impl *ev, uint64_t key)
+{
+  unsigned long mask = ev->memo_capacity - 1;
+  unsigned long i = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;
+
+  while (ev->memo[i].key != 0 && ev->memo[i].key != key)
+    {
+      i = (i + 1) & mask;
+    }
+
+  return &ev->memo[i];
+}
+
+/**
+ * Stores the value of a decision node in the memo growing the memo when it
+ * is half full. A full memo that cannot grow simply stops memoizing.
+ *
+ * @param [in] ev the solver whose memo is stored into.
+ * @param [in] key the key of the node.
+ * @param [in] value the value of the node.
+ */
+static void
+memoize (struct razz_ev_impl *ev, uint64_t key, double value)
+{
+  struct memo_entry *e;
+
+  if (2 * (ev->memo_count + 1) > ev->memo_capacity)
+    {
+      struct memo_entry *old = ev->memo;
+      unsigned long old_capacity = ev->memo_capacity;
+      unsigned long i;
+
+      ev->memo = calloc (2 * old_capacity, sizeof (*ev->memo));
+      if (ev->memo == NULL)
+	{
+	  ev->memo = old;
+	  return;
+	}
+      ev->memo_capacity = 2 * old_capacity;
+      for (i = 0; i < old_capacity; i++)
+	{
+	  if (old[i].key != 0)
+	    {
+	      *find_memo_entry (ev, old[i].key) = old[i];
+	    }
+	}
+      free (old);
+    }
+
+  e = find_memo_entry (ev, key);
+  if (e->key == 0)
+    {
+      e->key = key;
+      ev->memo_count++;
+    }
+  e->value = value;
+}
+
+/**
+ * Fills a rank deck with the cards that neither I hold nor the opponent
+ * shows nor are dead.
+ *
+ * @param [in] ev the solver holding the dead cards.
+ * @param [in] my_counts the rank counts of my cards.
+ * @param [in] opponent_counts the rank counts of the opponent upcards.
+ * @param [out] deck the unseen cards.
+ */
+static void
+fill_unseen_deck (const struct razz_ev_impl *ev,
+		  const uint8_t my_counts[RANK_COUNT],
+		  const uint8_t opponent_counts[RANK_COUNT],
+		  struct rank_deck *deck)
+{
+  int r;
+
+  deck->card_count = 0;
+  for (r = 0; r < RANK_COUNT; r++)
+    {
+      deck->rank_counts[r] = (SUIT_COUNT - ev->dead_counts[r] - my_counts[r]
+			      - opponent_counts[r]);
+      deck->card_count += deck->rank_counts[r];
+    }
+}
+
+/**
+ * Finds the entry of a key in a table of opponent lows.
+ *
+ * @param [in] table the table to be searched.
+ * @param [in] capacity the number of entries of the table.
+ * @param [in] key the key to be found.
+ *
+ * @return the entry holding the key or the empty entry where it belongs.
+ */
+static struct showdown_entry *
+find_showdown_entry (struct showdown_entry *table, unsigned long capacity,
+		     uint64_t key)
+{
+  unsigned long mask = capacity - 1;
+  unsigned long i = (key * 0x9E3779B97F4A7C15ULL) >> 32 & mask;
+
+  while (table[i].key != 0 && table[i].key != key)
+    {
+      i = (i + 1) & mask;
+    }
+
+  return &table[i];
+}
+
+/**
+ * Returns the low index of the opponent for every hidden deal given its
+ * upcards, computing them on the first request.
+ *
+ * @param [in] ev the solver.
+ * @param [in] opponent_counts the rank counts of the four opponent upcards.
+ *
+ * @return the low indices or NULL if there is no memory.
+ */
+static const uint16_t *
+get_opponent_lows (struct razz_ev_impl *ev,
+		   const uint8_t opponent_counts[RANK_COUNT])
+{
+  uint64_t key = encode_rank_counts (opponent_counts) + 1;
+  uint64_t start_ns;
+  struct showdown_entry *e;
+  uint8_t counts[RANK_COUNT];
+  int i, j;
+
+  e = find_showdown_entry (ev->showdowns, ev->showdown_capacity, key);
+  if (e->key == key)
+    {
+      return e->lows;
+    }
+  start_ns = ev->options.tracer == NULL ? 0 : razz_trace_now ();
+
+  if (2 * (ev->showdown_count + 1) > ev->showdown_capacity)
+    {
+      struct showdown_entry *table;
+      unsigned long capacity = 2 * ev->showdown_capacity;
+      unsigned long k;
+
+      table = calloc (capacity, sizeof (*table));
+      if (table == NULL)
+	{
+	  return NULL;
+	}
+      for (k = 0; k < ev->showdown_capacity; k++)
+	{
+	  if (ev->showdowns[k].key != 0)
+	    {
+	      *find_showdown_entry (table, capacity,
+				    ev->showdowns[k].key) = ev->showdowns[k];
+	    }
+	}
+      free (ev->showdowns);
+      ev->showdowns = table;
+      ev->showdown_capacity = capacity;
+      e = find_showdown_entry (ev->showdowns, ev->showdown_capacity, key);
+    }
+
+  e->lows = malloc (HIDDEN_DEAL_COUNT * sizeof (*e->lows));
+  if (e->lows == NULL)
+    {
+      return NULL;
+    }
+  e->key = key;
+  ev->showdown_count++;
+
+  for (i = 0; i < HIDDEN_DEAL_COUNT; i++)
+    {
+      const uint8_t *deal = ev->hidden_deals[i];
+
+      memcpy (counts, opponent_counts, sizeof (counts));
+      for (j = 0; j < HIDDEN_CARD_COUNT; j++)
+	{
+	  counts[deal[j]]++;
+	}
+      e->lows[i] = NO_LOW;
+      if (counts[deal[0]] <= SUIT_COUNT && counts[deal[1]] <= SUIT_COUNT
+	  && counts[deal[2]] <= SUIT_COUNT)
+	{
+	  e->lows[i] = get_razz_low_index_of_counts (counts);
+	}
+    }
+  razz_trace_span (ev->options.tracer, "ev", "showdown miss", start_ns,
+		   ev->showdown_count);
+
+  return e->lows;
+}
+
+/**
+ * Counts the ways a hidden deal can be dealt from the unseen cards.
+ *
+ * @param [in] deal the ranks of the hidden deal in ascending order.
+ * @param [in] deck the unseen cards.
+ *
+ * @return the number of ways.
+ */
+static double
+count_hidden_deal_ways (const uint8_t deal[HIDDEN_CARD_COUNT],
+			const struct rank_deck *deck)
+{
+  double a = deck->rank_counts[deal[0]];
+  double b = deck->rank_counts[deal[1]];
+  double c = deck->rank_counts[deal[2]];
+
+  if (deal[0] == deal[2])
+    {
+      return a * (a - 1) * (a - 2) / 6;
+    }
+  if (deal[0] == deal[1])
+    {
+      return a * (a - 1) / 2 * c;
+    }
+  if (deal[1] == deal[2])
+    {
+      return a * b * (b - 1) / 2;
+    }
+
+  return a * b * c;
+}
+
+/**
+ * Computes my share of the pot at the showdown when the opponent shows four
+ * upcards and its three hidden cards are unseen.
+ *
+ * @param [in] ev the solver.
+ * @param [in] my_counts the rank counts of my seven cards.
+ * @param [in] opponent_counts the rank counts of the opponent upcards.
+ *
+ * @return the probability of winning with a tie counting half or 0 if there
+ *         is no memory, in which case the solver is marked as failed.
+ */
+static double
+get_showdown_equity (struct razz_ev_impl *ev,
+		     const uint8_t my_counts[RANK_COUNT],
+		     const uint8_t opponent_counts[RANK_COUNT])
+{
+  struct rank_deck deck;
+  const uint16_t *lows;
+  unsigned int my_low;
+  double total = 0;
+  double wins = 0;
+  int i;
+
+  lows = get_opponent_lows (ev, opponent_counts);
+  if (lows == NULL)
+    {
+      ev->is_failed = 1;
+      return 0;
+    }
+
+  fill_unseen_deck (ev, my_counts, opponent_counts, &deck);
+  my_low = get_razz_low_index_of_counts (my_counts);
+  for (i = 0; i < HIDDEN_DEAL_COUNT; i++)
+    {
+      double ways;
+
+      if (lows[i] == NO_LOW)
+	{
+	  continue;
+	}
+
+      ways = count_hidden_deal_ways (ev->hidden_deals[i], &deck);
+      total += ways;
+      if (my_low < lows[i])
+	{
+	  wins += ways;
+	}
+      else if (my_low == lows[i])
+	{
+	  wins += ways / 2;
+	}
+    }
+
+  return wins / total;
+}
+
+/**
+ * Decides whether the opponent continues on a street.
+ *
+ * @param [in] ev the solver holding the policy.
+ * @param [in] opponent_counts the rank counts of the opponent upcards.
+ *
+ * @return non-zero if the opponent continues.
+ */
+static int
+does_opponent_continue (const struct razz_ev_impl *ev,
+			const uint8_t opponent_counts[RANK_COUNT])
+{
+  int r;
+
+  if (ev->options.policy == OPPONENT_ALWAYS_CONTINUES)
+    {
+      return 1;
+    }
+
+  for (r = 0; r < RANK_COUNT; r++)
+    {
+      if (opponent_counts[r] > 1
+	  || (opponent_counts[r] == 1 && r > ev->options.threshold))
+	{
+	  return 0;
+	}
+    }
+
+  return 1;
+}
+
+/**
+ * Returns the bet of a street.
+ *
+ * @param [in] ev the solver holding the bets.
+ * @param [in] street the street from 3 to 7.
+ *
+ * @return the bet.
+ */
+static double
+get_street_bet (const struct razz_ev_impl *ev, int street)
+{
+  return street <= 4 ? ev->options.small_bet : ev->options.big_bet;
+}
+
+static double
+get_continue_ev (struct razz_ev_impl *ev, int street,
+		 uint8_t my_counts[RANK_COUNT],
+		 uint8_t opponent_counts[RANK_COUNT]);
+
+/**
+ * Computes the EV of playing a decision node optimally, which is the better
+ * of folding and continuing.
+ *
+ * @param [in] ev the solver.
+ * @param [in] street the street of the node.
+ * @param [in,out] my_counts the rank counts of my cards, which are restored
+ *                           before returning.
+ * @param [in,out] opponent_counts the rank counts of the opponent upcards,
+ *                                 which are restored before returning.
+ *
+ * @return the EV of the node.
+ */
+static double
+get_node_value (struct razz_ev_impl *ev, int street,
+		uint8_t my_counts[RANK_COUNT],
+		uint8_t opponent_counts[RANK_COUNT])
+{
+  uint64_t key = get_node_key (my_counts, opponent_counts);
+  struct memo_entry *e = find_memo_entry (ev, key);
+  uint64_t start_ns;
+  double value;
+
+  if (e->key == key)
+    {
+      ev->memo_hit_count++;
+      return e->value;
+    }
+
+  start_ns = ev->options.tracer == NULL ? 0 : razz_trace_now ();
+  value = get_continue_ev (ev, street, my_counts, opponent_counts);
+  if (value < 0)
+    {
+      value = 0;
+    }
+  memoize (ev, key, value);
+  razz_trace_span (ev->options.tracer, "ev", "memo miss", start_ns, street);
+
+  return value;
+}
+
+/**
+ * Computes the EV of the next street averaged over the cards dealt on it,
+ * either by enumerating every deal or by sampling.
+ *
+ * @param [in] ev the solver.
+ * @param [in] street the street being left.
+ * @param [in,out] my_counts the rank counts of my cards.
+ * @param [in,out] opponent_counts the rank counts of the opponent upcards.
+ *
+ * @return the average EV of the decision nodes of the next street.
+ */
+static double
+get_chance_value (struct razz_ev_impl *ev, int street,
+		  uint8_t my_counts[RANK_COUNT],
+		  uint8_t opponent_counts[RANK_COUNT])
+{
+  struct rank_deck deck;
+  int next = street + 1;
+  int is_opponent_dealt = (next < SHOWDOWN_CARD_COUNT);
+  double sum = 0;
+  double weight_sum = 0;
+  unsigned int i;
+  int me;
+  int opp;
+
+  fill_unseen_deck (ev, my_counts, opponent_counts, &deck);
+
+  if (next <= SHOWDOWN_CARD_COUNT - (int) ev->options.exact_street_count)
+    {
+      for (i = 0; i < ev->options.sample_count; i++)
+	{
+	  struct rank_deck d = deck;
+
+	  me = deal_rank_from_rank_deck (&d, ev->rng);
+	  my_counts[me]++;
+	  if (is_opponent_dealt)
+	    {
+	      opp = deal_rank_from_rank_deck (&d, ev->rng);
+	      opponent_counts[opp]++;
+	    }
+	  sum += get_node_value (ev, next, my_counts, opponent_counts);
+	  if (is_opponent_dealt)
+	    {
+	      opponent_counts[opp]--;
+	    }
+	  my_counts[me]--;
+	}
+
+      return sum / ev->options.sample_count;
+    }
+
+  for (me = 0; me < RANK_COUNT; me++)
+    {
+      double my_weight = deck.rank_counts[me];
+
+      if (my_weight == 0)
+	{
+	  continue;
+	}
+
+      my_counts[me]++;
+      deck.rank_counts[me]--;
+      if (!is_opponent_dealt)
+	{
+	  sum += my_weight * get_node_value (ev, next, my_counts,
+					     opponent_counts);
+	  weight_sum += my_weight;
+	}
+      else
+	{
+	  for (opp = 0; opp < RANK_COUNT; opp++)
+	    {
+	      double weight = my_weight * deck.rank_counts[opp];
+
+	      if (weight == 0)
+		{
+		  continue;
+		}
+
+	      opponent_counts[opp]++;
+	      sum += weight * get_node_value (ev, next, my_counts,
+					      opponent_counts);
+	      weight_sum += weight;
+	      opponent_counts[opp]--;
+	    }
+	}
+      deck.rank_counts[me]++;
+      my_counts[me]--;
+    }
+
+  return sum / weight_sum;
+}
+
+/**
+ * Computes the EV of continuing at a decision node and then playing every
+ * later node optimally.
+ *
+ * @param [in] ev the solver.
+ * @param [in] street the street of the node.
+ * @param [in,out] my_counts the rank counts of my cards.
+ * @param [in,out] opponent_counts the rank counts of the opponent upcards.
+ *
+ * @return the EV of continuing.
+ */
+static double
+get_continue_ev (struct razz_ev_impl *ev, int street,
+		 uint8_t my_counts[RANK_COUNT],
+		 uint8_t opponent_counts[RANK_COUNT])
+{
+  double bet = get_street_bet (ev, street);
+  double pot = ev->pots[street];
+
+  ev->node_count++;
+
+  if (!does_opponent_continue (ev, opponent_counts))
+    {
+      return pot;
+    }
+
+  if (street == SHOWDOWN_CARD_COUNT)
+    {
+      return (-bet + (pot + 2 * bet)
+	      * get_showdown_equity (ev, my_counts, opponent_counts));
+    }
+
+  return -bet + get_chance_value (ev, street, my_counts, opponent_counts);
+}
+
+/**
+ * Adds ranks to rank counts checking that no rank has more than four cards.
+ *
+ * @param [in,out] counts the rank counts to be added to.
+ * @param [in] ranks the ranks to be added.
+ * @param [in] count the number of ranks.
+ * @param [in] total the rank counts of all cards seen so far, which are
+ *                   checked and updated.
+ *
+ * @return 0 if the ranks are valid or non-zero otherwise.
+ */
+static int
+add_ranks (uint8_t counts[RANK_COUNT], const enum card_rank *ranks, int count,
+	   uint8_t total[RANK_COUNT])
+{
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      if (ranks[i] < ACE || ranks[i] >= RANK_COUNT
+	  || total[ranks[i]] == SUIT_COUNT)
+	{
+	  return 1;
+	}
+      counts[ranks[i]]++;
+      total[ranks[i]]++;
+    }
+
+  return 0;
+}
+
+int
+razz_ev_solve (razz_ev *ev, const struct razz_ev_state *state,
+	       struct razz_ev_decision *decision)
+{
+  uint8_t my_counts[RANK_COUNT] = {0};
+  uint8_t opponent_counts[RANK_COUNT] = {0};
+  uint8_t dead_counts[RANK_COUNT] = {0};
+  uint8_t total[RANK_COUNT] = {0};
+  int street = state->my_card_count;
+  int expected_up_count = street - 2;
+  uint64_t start_ns;
+  int s;
+
+  if (expected_up_count > RAZZ_UPCARD_COUNT)
+    {
+      expected_up_count = RAZZ_UPCARD_COUNT;
+    }
+  if (street < 3 || street > SHOWDOWN_CARD_COUNT
+      || state->opponent_up_count != expected_up_count
+      || state->dead_count > RAZZ_DEAD_CARD_COUNT
+      || add_ranks (my_counts, state->my_ranks, state->my_card_count, total)
+      || add_ranks (opponent_counts, state->opponent_up_ranks,
+		    state->opponent_up_count, total)
+      || add_ranks (dead_counts, state->dead_ranks, state->dead_count, total))
+    {
+      return 1;
+    }
+
+  /* The memo holds values for one set of dead cards and one starting pot */
+  if (ev->street != street
+      || memcmp (ev->dead_counts, dead_counts, sizeof (dead_counts)) != 0)
+    {
+      memset (ev->memo, 0, ev->memo_capacity * sizeof (*ev->memo));
+      ev->memo_count = 0;
+      memcpy (ev->dead_counts, dead_counts, sizeof (dead_counts));
+      ev->street = street;
+      ev->pots[street] = ev->options.pot;
+      for (s = street + 1; s <= SHOWDOWN_CARD_COUNT; s++)
+	{
+	  ev->pots[s] = ev->pots[s - 1] + 2 * get_street_bet (ev, s - 1);
+	}
+    }
+
+  ev->is_failed = 0;
+  ev->node_count = 0;
+  ev->memo_hit_count = 0;
+  start_ns = ev->options.tracer == NULL ? 0 : razz_trace_now ();
+
+  decision->fold_ev = 0;
+  decision->continue_ev = get_continue_ev (ev, street, my_counts,
+					   opponent_counts);
+  razz_trace_span (ev->options.tracer, "ev", "solve", start_ns,
+		   ev->node_count);
+  decision->node_count = ev->node_count;
+  decision->memo_hit_count = ev->memo_hit_count;
+
+  return ev->is_failed;
+}
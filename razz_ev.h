@@ -0,0 +1,179 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_ev.h
+ * @brief The expected value of continuing a heads-up Razz hand.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+#include "card.h"
+#include "razz_trace.h"
+
+#ifndef RAZZ_EV_H
+#define RAZZ_EV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of upcards an opponent shows by the last street. */
+#define RAZZ_UPCARD_COUNT 4
+
+/** The highest number of cards that can be dead. */
+#define RAZZ_DEAD_CARD_COUNT 52
+
+/**
+ * A heads-up hand as seen by me on a street. On the n-th street, I hold n
+ * cards and the opponent shows n - 2 upcards, except on the seventh street
+ * where the opponent still shows four. Only ranks matter in Razz, so suits
+ * are not given.
+ */
+struct razz_ev_state
+{
+  uint8_t my_card_count; /**< The number of my cards from 3 to 7. */
+  enum card_rank my_ranks[7]; /**< The ranks of my cards. */
+  uint8_t opponent_up_count; /**< The number of the opponent upcards. */
+  enum card_rank opponent_up_ranks[RAZZ_UPCARD_COUNT]; /**<
+							* The ranks of the
+							* opponent upcards.
+							*/
+  uint8_t dead_count; /**< The number of folded cards seen. */
+  enum card_rank dead_ranks[RAZZ_DEAD_CARD_COUNT]; /**<
+						    * The ranks of the folded
+						    * cards seen.
+						    */
+};
+
+/** How the opponent decides whether to continue on a street. */
+enum opponent_policy
+  {
+    OPPONENT_ALWAYS_CONTINUES, /**< The opponent never folds. */
+    OPPONENT_CONTINUES_ON_LOW_BOARD, /**<
+				      * The opponent continues only while its
+				      * upcards are unpaired and none is above
+				      * the threshold rank.
+				      */
+  };
+
+/**
+ * The most streets whose cards can be enumerated exactly, which are the
+ * fourth to the seventh streets.
+ */
+#define RAZZ_EV_MAX_EXACT_STREET_COUNT 4
+
+/**
+ * The betting model and the solving method. The model is fixed-limit stud:
+ * on every street I act first, and if I continue I put in the bet of the
+ * street and the opponent either calls according to its policy or folds
+ * leaving me the pot. There are no raises.
+ */
+struct razz_ev_options
+{
+  double pot; /**< The pot before the betting on the current street. */
+  double small_bet; /**< The bet on the third and the fourth streets. */
+  double big_bet; /**< The bet on the fifth to the seventh streets. */
+  enum opponent_policy policy; /**< How the opponent continues. */
+  enum card_rank threshold; /**< The highest upcard the opponent plays on. */
+  unsigned int exact_street_count; /**<
+				    * The number of the last streets whose
+				    * cards are enumerated exactly, which is
+				    * at most
+				    * ::RAZZ_EV_MAX_EXACT_STREET_COUNT. The
+				    * cards of the earlier streets are sampled.
+				    */
+  unsigned int sample_count; /**<
+			      * The number of deals sampled per node, which
+			      * must not be 0.
+			      */
+  uint64_t seed; /**< The seed of the sampling or 0 to use lrand48(). */
+  razz_tracer *tracer; /**<
+			* The tracer of the solves and of the lookups that
+			* miss the memo or the showdown table, or NULL.
+			*/
+};
+
+/** The value of each choice on the current street. */
+struct razz_ev_decision
+{
+  double fold_ev; /**< The EV of folding now, which is always 0. */
+  double continue_ev; /**<
+		       * The EV of continuing now and then playing every later
+		       * street optimally. Money already in the pot is sunk.
+		       */
+  unsigned long node_count; /**< The number of decision nodes evaluated. */
+  unsigned long memo_hit_count; /**< The number of nodes found memoized. */
+};
+
+/**
+ * Fills the options with a pot of one small bet, a big bet of two small bets,
+ * an opponent that always continues, exact enumeration of the last two
+ * streets and 16 sampled deals per earlier node. A query from the fifth
+ * street on is then exact and takes a few milliseconds, while a query on the
+ * third street takes a few hundred.
+ *
+ * @param [out] options the options to be filled.
+ */
+void
+init_razz_ev_options (struct razz_ev_options *options);
+
+/**
+ * A solver that memoizes the value of every decision node it evaluates on
+ * the rank counts of both hands. The memo is kept across queries that share
+ * the same dead cards, so related queries are answered from it.
+ */
+typedef struct razz_ev_impl razz_ev;
+
+/**
+ * Creates a solver. The returned solver has to be freed with
+ * razz_ev_destroy().
+ *
+ * @param [in] options the options of the solver or NULL for the defaults.
+ *
+ * @return the solver or NULL if the options are invalid or there is no
+ *         memory.
+ */
+razz_ev *
+razz_ev_create (const struct razz_ev_options *options);
+
+/**
+ * Computes the EV of folding and of continuing on the current street.
+ *
+ * @param [in] ev the solver.
+ * @param [in] state the hand on the current street.
+ * @param [out] decision the EV of each choice.
+ *
+ * @return 0 if the EV is computed or non-zero if the state is invalid or
+ *         there is no memory.
+ */
+int
+razz_ev_solve (razz_ev *ev, const struct razz_ev_state *state,
+	       struct razz_ev_decision *decision);
+
+/**
+ * Reclaims the memory space that was allocated for a solver as well as
+ * setting the pointer to NULL as a safe guard.
+ *
+ * @param [in] ev the solver to be destroyed.
+ */
+void
+razz_ev_destroy (razz_ev **ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_EV_H */
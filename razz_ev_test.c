@@ -0,0 +1,159 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "razz_ev.h"
+
+static int
+is_close (double a, double b)
+{
+  return a - b < 1e-9 && b - a < 1e-9;
+}
+
+static void
+set_state (struct razz_ev_state *s, const enum card_rank *mine, int my_count,
+	   const enum card_rank *ups, int up_count)
+{
+  memset (s, 0, sizeof (*s));
+  s->my_card_count = my_count;
+  memcpy (s->my_ranks, mine, my_count * sizeof (*mine));
+  s->opponent_up_count = up_count;
+  memcpy (s->opponent_up_ranks, ups, up_count * sizeof (*ups));
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct razz_ev_options options;
+  struct razz_ev_state state;
+  struct razz_ev_decision decision;
+  struct razz_ev_decision again;
+  razz_ev *ev;
+  int rc;
+
+  init_razz_ev_options (&options);
+  options.pot = 10;
+  options.seed = 3;
+  ev = razz_ev_create (&options);
+  assert (ev != NULL);
+
+  /* The showdown */
+  {
+    const enum card_rank wheel[] = {ACE, R2, R3, R4, R5, K, K};
+    const enum card_rank kings[] = {K, K, K, K, Q, Q, Q};
+    const enum card_rank rough[] = {R6, R7, R8, R9};
+    const enum card_rank smooth[] = {ACE, R2, R3, R4};
+
+    set_state (&state, wheel, 7, rough, 4);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc == 0);
+    assert (decision.fold_ev == 0);
+    assert (is_close (decision.continue_ev, -2 + (10 + 2 * 2)));
+
+    set_state (&state, kings, 7, smooth, 4);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc == 0);
+    assert (is_close (decision.continue_ev, -2));
+  }
+
+  /* Invalid states */
+  {
+    const enum card_rank aces[] = {ACE, ACE, ACE, ACE, ACE};
+    const enum card_rank ups[] = {R2, R3, R4};
+    const enum card_rank low[] = {ACE, R2, R3};
+
+    set_state (&state, aces, 5, ups, 3);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc != 0);
+    set_state (&state, low, 3, ups, 3);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc != 0);
+  }
+
+  /* Memoized subtrees */
+  {
+    const enum card_rank mine[] = {ACE, R2, R3, K, R7, R8};
+    const enum card_rank ups[] = {K, R4, R5, R6};
+
+    set_state (&state, mine, 6, ups, 4);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc == 0);
+    assert (decision.continue_ev >= -options.big_bet);
+    rc = razz_ev_solve (ev, &state, &again);
+    assert (rc == 0);
+    assert (again.continue_ev == decision.continue_ev);
+    assert (again.node_count < decision.node_count);
+    assert (again.memo_hit_count > 0);
+  }
+
+  razz_ev_destroy (&ev);
+  assert (ev == NULL);
+
+  /* Exact counting agrees however many streets are enumerated */
+  {
+    const enum card_rank mine[] = {ACE, R2, R3, K, R7};
+    const enum card_rank ups[] = {K, R4, R5};
+
+    set_state (&state, mine, 5, ups, 3);
+    options.exact_street_count = 2;
+    ev = razz_ev_create (&options);
+    assert (ev != NULL);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc == 0);
+    razz_ev_destroy (&ev);
+
+    options.exact_street_count = RAZZ_EV_MAX_EXACT_STREET_COUNT;
+    ev = razz_ev_create (&options);
+    assert (ev != NULL);
+    rc = razz_ev_solve (ev, &state, &again);
+    assert (rc == 0);
+    razz_ev_destroy (&ev);
+
+    options.exact_street_count = RAZZ_EV_MAX_EXACT_STREET_COUNT + 1;
+    ev = razz_ev_create (&options);
+    assert (ev == NULL);
+    options.exact_street_count = 2;
+    options.sample_count = 0;
+    ev = razz_ev_create (&options);
+    assert (ev == NULL);
+    options.sample_count = 16;
+
+    assert (is_close (again.continue_ev, decision.continue_ev));
+    assert (decision.continue_ev > 0);
+  }
+
+  /* An opponent that folds a rough board */
+  {
+    const enum card_rank mine[] = {K, Q, J, R10};
+    const enum card_rank ups[] = {K, R2};
+
+    options.policy = OPPONENT_CONTINUES_ON_LOW_BOARD;
+    options.threshold = R8;
+    ev = razz_ev_create (&options);
+    assert (ev != NULL);
+    set_state (&state, mine, 4, ups, 2);
+    rc = razz_ev_solve (ev, &state, &decision);
+    assert (rc == 0);
+    assert (decision.continue_ev == options.pot);
+    razz_ev_destroy (&ev);
+  }
+
+  exit (EXIT_SUCCESS);
+}
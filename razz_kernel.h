@@ -0,0 +1,252 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_kernel.h
+ * @brief The internal game loop shared by the simulation front ends.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <time.h>
+#include "card.h"
+#include "rng.h"
+#include "razz_simulation.h"
+
+#ifndef RAZZ_KERNEL_H
+#define RAZZ_KERNEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of cards each person is dealt in one round of Razz game. */
+#define RAZZ_CARD_IN_HAND_COUNT 7
+
+struct razz_plan;
+struct razz_scratch;
+
+/**
+ * Runs a number of games of a plan with a simulation loop specialized for the
+ * variant and the deck of the plan.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in] scratch the per-thread state of the running thread.
+ * @param [in] game_count the number of games to run.
+ * @param [in,out] result the result to which the outcomes are added.
+ */
+typedef void (*plan_runner) (const struct razz_plan *plan,
+			     struct razz_scratch *scratch,
+			     unsigned long game_count,
+			     struct razz_result *result);
+
+/**
+ * A scenario prepared for simulation. A plan is immutable once prepared, so
+ * any number of threads can run the same plan at once.
+ */
+struct razz_plan
+{
+  struct simulation_options options; /**< How the games are run. */
+  plan_runner run_games; /**< The loop chosen once for the whole query. */
+  card_deck *template_deck; /**< The suited deck stripped of known cards. */
+  struct rank_deck rank_template; /**< The rank deck stripped likewise. */
+  uint8_t my_rank_counts[RANK_COUNT]; /**< The rank counts of my cards. */
+  uint16_t my_suit_masks[SUIT_COUNT]; /**< The ranks of my cards by suit. */
+  uint16_t my_rank_mask; /**< The distinct ranks of my cards. */
+  uint8_t missing_count; /**< The number of cards dealt to me per game. */
+};
+
+/**
+ * The games of a batch in structure-of-arrays form. A plan runner deals the
+ * whole batch into the card columns first, then evaluates the columns into the
+ * outcome arrays and finally accumulates the outcomes, so that every stage is
+ * a tight loop over arrays instead of one game doing everything in turn.
+ */
+struct razz_batch
+{
+  unsigned int capacity; /**< The number of games each array holds. */
+  uint8_t *dealt[RAZZ_CARD_IN_HAND_COUNT]; /**<
+					    * The j-th card dealt to me in
+					    * every game as its ::card_rank
+					    * or, if the suits matter, as its
+					    * ::card_suit_rank.
+					    */
+  uint16_t *rank_masks; /**< The distinct ranks of my hand in every game. */
+  uint16_t *low_indices; /**< The Razz low index of every game. */
+  uint8_t *ranks; /**<
+		   * The Razz rank of every game or ::RANK_COUNT if the low is
+		   * paired.
+		   */
+};
+
+/** The per-thread state needed to run a plan. */
+struct razz_scratch
+{
+  rng *rng; /**< The random stream of the thread. */
+  rng *counter_rng; /**< The generator of plans with a counter key. */
+  uint64_t next_game; /**<
+		       * The index of the next game in the streams of the
+		       * counter key, which is set before running a plan.
+		       */
+  card_deck *deck; /**< The working suited deck. */
+  struct razz_batch batch; /**< The games being run. */
+};
+
+/**
+ * Prepares a scenario for simulation. The plan has to be released with
+ * release_razz_plan().
+ *
+ * @param [out] plan the plan to be prepared.
+ * @param [in] scenario the known cards of the scenario.
+ * @param [in] options the options of the simulation or NULL for the default.
+ *
+ * @return 0 if the plan is prepared or non-zero if it cannot be prepared.
+ */
+int
+prepare_razz_plan (struct razz_plan *plan,
+		   const struct razz_scenario *scenario,
+		   const struct simulation_options *options);
+
+/**
+ * Releases the resources held by a plan.
+ *
+ * @param [in] plan the plan to be released.
+ */
+void
+release_razz_plan (struct razz_plan *plan);
+
+/**
+ * Prepares the per-thread state to run plans. The scratch has to be released
+ * with release_razz_scratch().
+ *
+ * @param [out] scratch the scratch to be prepared.
+ * @param [in] seed the seed of the random stream of the scratch.
+ *
+ * @return 0 if the scratch is prepared or non-zero if it cannot be prepared.
+ */
+int
+init_razz_scratch (struct razz_scratch *scratch, uint64_t seed);
+
+/**
+ * Releases the resources held by a scratch.
+ *
+ * @param [in] scratch the scratch to be released.
+ */
+void
+release_razz_scratch (struct razz_scratch *scratch);
+
+/**
+ * Runs a number of games of a plan adding their outcomes to the result.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in] scratch the per-thread state of the running thread.
+ * @param [in] game_count the number of games to run.
+ * @param [in,out] result the result to which the outcomes are added.
+ */
+void
+run_razz_plan (const struct razz_plan *plan, struct razz_scratch *scratch,
+	       unsigned long game_count, struct razz_result *result);
+
+/**
+ * Adds the counts of a result into another result.
+ *
+ * @param [in,out] dst the result to be added to.
+ * @param [in] src the result to be added.
+ */
+void
+merge_razz_result (struct razz_result *dst, const struct razz_result *src);
+
+/** The number of games between two checks of the progress and cancel flag. */
+#define PROGRESS_CHECK_PERIOD 1024
+
+/** The state needed to report the progress of a simulation. */
+struct progress_tracker
+{
+  const struct simulation_options *options; /**< The progress options. */
+  unsigned long total_game_count; /**< The number of games requested. */
+  struct timespec start; /**< The time the simulation started. */
+  struct timespec last_report; /**< The time of the last report. */
+  unsigned long last_report_game_count; /**< The games at the last report. */
+  unsigned long check_period; /**<
+			       * The number of games between two checks of the
+			       * progress and the cancel flag.
+			       */
+};
+
+/**
+ * Starts tracking the progress of a simulation.
+ *
+ * @param [out] t the tracker to be started.
+ * @param [in] options the options carrying the progress listener and the
+ *                     cancel flag.
+ * @param [in] total_game_count the number of games requested.
+ */
+void
+start_progress (struct progress_tracker *t,
+		const struct simulation_options *options,
+		unsigned long total_game_count);
+
+/**
+ * Checks whether or not the progress should be reported.
+ *
+ * @param [in] t the tracker of the simulation.
+ * @param [in] game_count the number of games simulated so far.
+ * @param [in] is_final non-zero if the simulation has ended.
+ *
+ * @return non-zero if there is a progress listener and either the simulation
+ *         has ended or a reporting interval has passed.
+ */
+int
+is_progress_due (const struct progress_tracker *t, unsigned long game_count,
+		 int is_final);
+
+/**
+ * Reports the progress to the progress listener unconditionally.
+ *
+ * @param [in,out] t the tracker of the simulation.
+ * @param [in] game_count the number of games simulated so far.
+ * @param [in] partial the outcome counts so far or NULL.
+ */
+void
+report_progress (struct progress_tracker *t, unsigned long game_count,
+		 const struct razz_result *partial);
+
+/**
+ * Reports the progress if a reporting interval has passed.
+ *
+ * @param [in,out] t the tracker of the simulation.
+ * @param [in] game_count the number of games simulated so far.
+ * @param [in] partial the outcome counts so far or NULL.
+ * @param [in] is_final non-zero to report regardless of the intervals.
+ */
+void
+poll_progress (struct progress_tracker *t, unsigned long game_count,
+	       const struct razz_result *partial, int is_final);
+
+/**
+ * Checks whether or not a simulation has been cancelled.
+ *
+ * @param [in] options the options carrying the cancel flag.
+ *
+ * @return non-zero if the cancel flag is set.
+ */
+int
+is_cancelled (const struct simulation_options *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_KERNEL_H */
@@ -0,0 +1,324 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_metrics.c
+ * @brief The counters of the simulator in Prometheus text format.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "razz_metrics.h"
+
+/** An exporter of the counters to a file. */
+struct razz_metrics_exporter_impl
+{
+  char *path; /**< The file the counters are written to. */
+  unsigned long interval_ms; /**< The time between two exports. */
+  razz_ctx *ctx; /**< The context whose counters are exported or NULL. */
+  razz_store *store; /**< The store whose counters are exported or NULL. */
+  pthread_t thread; /**< The thread doing the exports. */
+  pthread_mutex_t lock; /**< Protects the stop flag. */
+  pthread_cond_t stop; /**< Signalled when the exporter is to stop. */
+  int is_stopping; /**< Non-zero when the thread should exit. */
+};
+
+/**
+ * Prints the HELP and TYPE lines of a metric.
+ *
+ * @param [in] f the stream to print to.
+ * @param [in] name the name of the metric.
+ * @param [in] type the type of the metric.
+ * @param [in] help the description of the metric.
+ */
+static void
+print_metric_header (FILE *f, const char *name, const char *type,
+		     const char *help)
+{
+  fprintf (f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * Prints the counters of a context and of each of its workers.
+ *
+ * @param [in] f the stream to print to.
+ * @param [in] ctx the context.
+ */
+static void
+print_ctx_metrics (FILE *f, razz_ctx *ctx)
+{
+  struct razz_ctx_metrics m;
+  struct razz_worker_metrics wm;
+  unsigned long cumulative_count = 0;
+  unsigned int i;
+
+  razz_ctx_get_metrics (ctx, &m);
+
+  print_metric_header (f, "razz_workers", "gauge",
+		       "The number of worker threads.");
+  fprintf (f, "razz_workers %u\n", m.worker_count);
+  print_metric_header (f, "razz_games_total", "counter",
+		       "The games run by all workers.");
+  fprintf (f, "razz_games_total %lu\n", m.game_count);
+  print_metric_header (f, "razz_queries_queued_total", "counter",
+		       "The queries queued on the workers.");
+  fprintf (f, "razz_queries_queued_total %lu\n", m.queued_query_count);
+  print_metric_header (f, "razz_queries_finished_total", "counter",
+		       "The queries whose games are all done.");
+  fprintf (f, "razz_queries_finished_total %lu\n", m.finished_query_count);
+  print_metric_header (f, "razz_queries_pending", "gauge",
+		       "The queries queued but not finished yet.");
+  fprintf (f, "razz_queries_pending %lu\n",
+	   m.queued_query_count - m.finished_query_count);
+  print_metric_header (f, "razz_chunks_pending", "gauge",
+		       "The chunks of games queued but not finished yet.");
+  fprintf (f, "razz_chunks_pending %lu\n", m.pending_chunk_count);
+
+  print_metric_header (f, "razz_worker_games_total", "counter",
+		       "The games run by a worker.");
+  for (i = 0; i < m.worker_count; i++)
+    {
+      razz_ctx_get_worker_metrics (ctx, i, &wm);
+      fprintf (f, "razz_worker_games_total{worker=\"%u\"} %lu\n",
+	       i, wm.game_count);
+    }
+  print_metric_header (f, "razz_worker_chunks_total", "counter",
+		       "The chunks of games run by a worker.");
+  for (i = 0; i < m.worker_count; i++)
+    {
+      razz_ctx_get_worker_metrics (ctx, i, &wm);
+      fprintf (f, "razz_worker_chunks_total{worker=\"%u\"} %lu\n",
+	       i, wm.chunk_count);
+    }
+  print_metric_header (f, "razz_worker_busy_seconds_total", "counter",
+		       "The time a worker spent running chunks.");
+  for (i = 0; i < m.worker_count; i++)
+    {
+      razz_ctx_get_worker_metrics (ctx, i, &wm);
+      fprintf (f, "razz_worker_busy_seconds_total{worker=\"%u\"} %.9f\n",
+	       i, wm.busy_time);
+    }
+
+  print_metric_header (f, "razz_query_latency_seconds", "histogram",
+		       "The time from queueing a query to finishing it.");
+  for (i = 0; i < RAZZ_LATENCY_BUCKET_COUNT; i++)
+    {
+      cumulative_count += m.latency_counts[i];
+      fprintf (f, "razz_query_latency_seconds_bucket{le=\"%g\"} %lu\n",
+	       RAZZ_LATENCY_BUCKET_BOUND_US (i) / 1e6, cumulative_count);
+    }
+  cumulative_count += m.latency_counts[RAZZ_LATENCY_BUCKET_COUNT];
+  fprintf (f, "razz_query_latency_seconds_bucket{le=\"+Inf\"} %lu\n",
+	   cumulative_count);
+  fprintf (f, "razz_query_latency_seconds_sum %.9f\n", m.latency_sum);
+  fprintf (f, "razz_query_latency_seconds_count %lu\n", cumulative_count);
+}
+
+/**
+ * Prints the counters of the top-ups of a store.
+ *
+ * @param [in] f the stream to print to.
+ * @param [in] store the store.
+ */
+static void
+print_store_metrics (FILE *f, razz_store *store)
+{
+  struct razz_store_metrics m;
+
+  razz_store_get_metrics (store, &m);
+
+  print_metric_header (f, "razz_store_top_ups_total", "counter",
+		       "The top-ups served by the store without simulation"
+		       " (hit) or not (miss).");
+  fprintf (f, "razz_store_top_ups_total{result=\"hit\"} %lu\n", m.hit_count);
+  fprintf (f, "razz_store_top_ups_total{result=\"miss\"} %lu\n",
+	   m.miss_count);
+  print_metric_header (f, "razz_store_reused_games_total", "counter",
+		       "The stored games used by the top-ups.");
+  fprintf (f, "razz_store_reused_games_total %lu\n", m.reused_game_count);
+  print_metric_header (f, "razz_store_simulated_games_total", "counter",
+		       "The games simulated by the top-ups.");
+  fprintf (f, "razz_store_simulated_games_total %lu\n",
+	   m.simulated_game_count);
+}
+
+int
+razz_metrics_print (FILE *f, razz_ctx *ctx, razz_store *store)
+{
+  if (ctx != NULL)
+    {
+      print_ctx_metrics (f, ctx);
+    }
+  if (store != NULL)
+    {
+      print_store_metrics (f, store);
+    }
+
+  return ferror (f);
+}
+
+int
+razz_metrics_write (const char *path, razz_ctx *ctx, razz_store *store)
+{
+  size_t tmp_path_size = strlen (path) + 32;
+  char *tmp_path;
+  FILE *f;
+  int rc;
+
+  tmp_path = malloc (tmp_path_size);
+  if (tmp_path == NULL)
+    {
+      return 1;
+    }
+  /* The collector ignores files not ending in .prom, and the process ID
+     keeps several processes exporting to the same file apart */
+  snprintf (tmp_path, tmp_path_size, "%s.%ld.tmp", path, (long) getpid ());
+
+  f = fopen (tmp_path, "w");
+  if (f == NULL)
+    {
+      free (tmp_path);
+      return 1;
+    }
+  rc = razz_metrics_print (f, ctx, store);
+  if (fclose (f) != 0)
+    {
+      rc = 1;
+    }
+  if (rc == 0 && rename (tmp_path, path) != 0)
+    {
+      rc = 1;
+    }
+  if (rc != 0)
+    {
+      unlink (tmp_path);
+    }
+  free (tmp_path);
+
+  return rc;
+}
+
+/** The body of the exporting thread. */
+static void *
+export_metrics (void *arg)
+{
+  struct razz_metrics_exporter_impl *e = arg;
+  struct timespec deadline;
+
+  clock_gettime (CLOCK_MONOTONIC, &deadline);
+  pthread_mutex_lock (&e->lock);
+  while (!e->is_stopping)
+    {
+      deadline.tv_sec += e->interval_ms / 1000;
+      deadline.tv_nsec += (e->interval_ms % 1000) * 1000000;
+      if (deadline.tv_nsec >= 1000000000)
+	{
+	  deadline.tv_sec++;
+	  deadline.tv_nsec -= 1000000000;
+	}
+      while (!e->is_stopping
+	     && pthread_cond_timedwait (&e->stop, &e->lock, &deadline) == 0)
+	{
+	}
+      if (e->is_stopping)
+	{
+	  break;
+	}
+
+      pthread_mutex_unlock (&e->lock);
+      if (razz_metrics_write (e->path, e->ctx, e->store))
+	{
+	  fprintf (stderr, "Cannot export the metrics to %s\n", e->path);
+	}
+      pthread_mutex_lock (&e->lock);
+    }
+  pthread_mutex_unlock (&e->lock);
+
+  return NULL;
+}
+
+razz_metrics_exporter *
+razz_metrics_exporter_create (const char *path, unsigned long interval_ms,
+			      razz_ctx *ctx, razz_store *store)
+{
+  struct razz_metrics_exporter_impl *e;
+  pthread_condattr_t attr;
+
+  e = calloc (1, sizeof (*e));
+  if (e == NULL)
+    {
+      return NULL;
+    }
+  e->path = strdup (path);
+  if (e->path == NULL)
+    {
+      free (e);
+      return NULL;
+    }
+  e->interval_ms = (interval_ms == 0
+		    ? DEFAULT_METRICS_INTERVAL_MS : interval_ms);
+  e->ctx = ctx;
+  e->store = store;
+  pthread_mutex_init (&e->lock, NULL);
+  pthread_condattr_init (&attr);
+  pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+  pthread_cond_init (&e->stop, &attr);
+  pthread_condattr_destroy (&attr);
+
+  if (pthread_create (&e->thread, NULL, export_metrics, e))
+    {
+      pthread_cond_destroy (&e->stop);
+      pthread_mutex_destroy (&e->lock);
+      free (e->path);
+      free (e);
+      return NULL;
+    }
+
+  return e;
+}
+
+void
+razz_metrics_exporter_destroy (razz_metrics_exporter **exporter_ptr)
+{
+  struct razz_metrics_exporter_impl *e = *exporter_ptr;
+
+  if (e == NULL)
+    {
+      return;
+    }
+
+  pthread_mutex_lock (&e->lock);
+  e->is_stopping = 1;
+  pthread_cond_signal (&e->stop);
+  pthread_mutex_unlock (&e->lock);
+  pthread_join (e->thread, NULL);
+
+  if (razz_metrics_write (e->path, e->ctx, e->store))
+    {
+      fprintf (stderr, "Cannot export the metrics to %s\n", e->path);
+    }
+
+  pthread_cond_destroy (&e->stop);
+  pthread_mutex_destroy (&e->lock);
+  free (e->path);
+  free (e);
+
+  *exporter_ptr = NULL;
+}
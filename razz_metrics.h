@@ -0,0 +1,103 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_metrics.h
+ * @brief The counters of the simulator in Prometheus text format.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdio.h>
+#include "razz_simulation.h"
+#include "razz_store.h"
+
+#ifndef RAZZ_METRICS_H
+#define RAZZ_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of milliseconds between two exports by default. */
+#define DEFAULT_METRICS_INTERVAL_MS 1000
+
+/**
+ * Prints the counters of a context and a store in the Prometheus text
+ * exposition format.
+ *
+ * @param [in] f the stream to print to.
+ * @param [in] ctx the context whose counters are printed or NULL.
+ * @param [in] store the store whose counters are printed or NULL.
+ *
+ * @return 0 if the counters are printed or non-zero otherwise.
+ */
+int
+razz_metrics_print (FILE *f, razz_ctx *ctx, razz_store *store);
+
+/**
+ * Replaces a file with the counters of a context and a store. The counters
+ * are written to a temporary file in the same directory that is then renamed
+ * over the file, so a reader like the textfile collector of the Prometheus
+ * node exporter never sees a partial file.
+ *
+ * @param [in] path the file, whose name should end in .prom for the textfile
+ *                  collector.
+ * @param [in] ctx the context whose counters are written or NULL.
+ * @param [in] store the store whose counters are written or NULL.
+ *
+ * @return 0 if the file is replaced or non-zero otherwise.
+ */
+int
+razz_metrics_write (const char *path, razz_ctx *ctx, razz_store *store);
+
+/**
+ * A thread replacing a file with the counters of a context and a store at a
+ * regular interval.
+ */
+typedef struct razz_metrics_exporter_impl razz_metrics_exporter;
+
+/**
+ * Starts exporting the counters of a context and a store to a file. The
+ * returned exporter has to be stopped with razz_metrics_exporter_destroy()
+ * before the context and the store are.
+ *
+ * @param [in] path the file, which is copied.
+ * @param [in] interval_ms the number of milliseconds between two exports or 0
+ *                         for ::DEFAULT_METRICS_INTERVAL_MS.
+ * @param [in] ctx the context whose counters are exported or NULL.
+ * @param [in] store the store whose counters are exported or NULL.
+ *
+ * @return the exporter or NULL if it cannot be started.
+ */
+razz_metrics_exporter *
+razz_metrics_exporter_create (const char *path, unsigned long interval_ms,
+			      razz_ctx *ctx, razz_store *store);
+
+/**
+ * Stops an exporter after a last export, so the file holds the final
+ * counters, and reclaims the memory space that was allocated for it as well
+ * as setting the pointer to NULL as a safe guard. Passing a pointer to NULL
+ * is safe but not a NULL pointer.
+ *
+ * @param [in] exporter_ptr the pointer pointing to the exporter to be freed.
+ */
+void
+razz_metrics_exporter_destroy (razz_metrics_exporter **exporter_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_METRICS_H */
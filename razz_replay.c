@@ -0,0 +1,757 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "card.h"
+#include "razz_simulation.h"
+#include "razz_store.h"
+#include "razz_metrics.h"
+
+/** The number of streets read before they are evaluated together. */
+#define DEFAULT_REPLAY_BATCH_SIZE 65536
+
+/** The number of games simulated per distinct scenario by default. */
+#define DEFAULT_REPLAY_GAME_COUNT 20000
+
+/** The number of jobs kept in flight on the context. */
+#define REPLAY_JOB_WINDOW 64
+
+/** The number of ranks whose probability is annotated, from 5 to K. */
+#define REPLAY_RANK_COUNT (K - R5 + 1)
+
+/** A source of history lines, either a mapped file or a stream. */
+struct history_reader
+{
+  const char *map; /**< The mapped file or NULL to read the stream. */
+  size_t size; /**< The size of the mapped file. */
+  size_t pos; /**< The offset of the next line in the mapped file. */
+  FILE *stream; /**< The stream if the file cannot be mapped. */
+  char *line; /**< The buffer of the line read from the stream. */
+  size_t line_capacity; /**< The size of the line buffer. */
+};
+
+/** A street of the history in the current batch. */
+struct history_street
+{
+  size_t id_offset; /**< The offset of the hand ID in the ID arena. */
+  size_t id_len; /**< The length of the hand ID. */
+  int my_card_count; /**< The street or 0 if the line is invalid. */
+  unsigned int unique_idx; /**< The distinct scenario of the street. */
+};
+
+/** A distinct scenario of the current batch. */
+struct unique_scenario
+{
+  struct razz_scenario scenario; /**< The canonical scenario. */
+  double probabilities[REPLAY_RANK_COUNT]; /**<
+					    * The probability of every rank
+					    * or negative if it cannot be
+					    * simulated.
+					    */
+};
+
+/** The streets of a batch and their distinct scenarios. */
+struct history_batch
+{
+  struct history_street *streets; /**< The streets in the input order. */
+  unsigned int street_count; /**< The number of streets read. */
+  unsigned int capacity; /**< The most streets of a batch. */
+  char *ids; /**< The arena of the hand IDs. */
+  size_t ids_len; /**< The used bytes of the ID arena. */
+  size_t ids_capacity; /**< The size of the ID arena. */
+  struct unique_scenario *uniques; /**< The distinct scenarios. */
+  unsigned int unique_count; /**< The number of distinct scenarios. */
+  unsigned int *slots; /**<
+			* The open-addressing table from a scenario to the
+			* index of its distinct scenario plus one or 0.
+			*/
+  unsigned int slot_mask; /**< The number of slots minus one. */
+};
+
+/**
+ * Opens the history, mapping it if it is a regular file.
+ *
+ * @param [out] r the reader to be opened.
+ * @param [in] path the file or "-" for the standard input.
+ *
+ * @return 0 if the history is opened or non-zero otherwise.
+ */
+static int
+open_history (struct history_reader *r, const char *path)
+{
+  struct stat st;
+  int fd;
+
+  memset (r, 0, sizeof (*r));
+  if (strcmp (path, "-") == 0)
+    {
+      r->stream = stdin;
+      return 0;
+    }
+
+  fd = open (path, O_RDONLY);
+  if (fd == -1)
+    {
+      perror ("Cannot open the history");
+      return 1;
+    }
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0)
+    {
+      r->map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (r->map != MAP_FAILED)
+	{
+	  r->size = st.st_size;
+	  madvise ((void *) r->map, r->size, MADV_SEQUENTIAL);
+	  close (fd);
+	  return 0;
+	}
+      r->map = NULL;
+    }
+
+  r->stream = fdopen (fd, "r");
+  if (r->stream == NULL)
+    {
+      close (fd);
+      return 1;
+    }
+
+  return 0;
+}
+
+/**
+ * Reads the next line of the history without its newline.
+ *
+ * @param [in] r the reader.
+ * @param [out] line the line, which is valid until the next read.
+ * @param [out] len the length of the line.
+ *
+ * @return 0 if a line is read or non-zero at the end of the history.
+ */
+static int
+read_history_line (struct history_reader *r, const char **line, size_t *len)
+{
+  ssize_t n;
+
+  if (r->map != NULL)
+    {
+      const char *end;
+
+      if (r->pos == r->size)
+	{
+	  return 1;
+	}
+      *line = r->map + r->pos;
+      end = memchr (*line, '\n', r->size - r->pos);
+      *len = (end == NULL ? r->size - r->pos : (size_t) (end - *line));
+      r->pos += *len + (end != NULL);
+      return 0;
+    }
+
+  n = getline (&r->line, &r->line_capacity, r->stream);
+  if (n == -1)
+    {
+      return 1;
+    }
+  if (n > 0 && r->line[n - 1] == '\n')
+    {
+      n--;
+    }
+  *line = r->line;
+  *len = n;
+
+  return 0;
+}
+
+/**
+ * Unmaps or closes the history.
+ *
+ * @param [in] r the reader to be closed.
+ */
+static void
+close_history (struct history_reader *r)
+{
+  if (r->map != NULL)
+    {
+      munmap ((void *) r->map, r->size);
+    }
+  else if (r->stream != NULL && r->stream != stdin)
+    {
+      fclose (r->stream);
+    }
+  free (r->line);
+}
+
+/**
+ * Parses a card of the history given either as a rank, which takes the first
+ * suit whose card is not known yet, or as a suited card like SA or H10.
+ *
+ * @param [in] token the card.
+ * @param [in] len the length of the card.
+ * @param [in] known_mask the cards already known in the street.
+ * @param [out] csr the card.
+ *
+ * @return 0 if the card is parsed or non-zero otherwise.
+ */
+static int
+parse_history_card (const char *token, size_t len, uint64_t known_mask,
+		    enum card_suit_rank *csr)
+{
+  static const char suits[] = "SHDC";
+  const char *suit;
+  char str[4];
+  enum card_rank rank;
+  int cs;
+
+  if (len == 0 || len >= sizeof (str))
+    {
+      return 1;
+    }
+  memcpy (str, token, len);
+  str[len] = '\0';
+
+  rank = strtorank (str);
+  if (rank != INVALID_RANK)
+    {
+      for (cs = SPADE; cs < SUIT_COUNT; cs++)
+	{
+	  *csr = cs * RANK_COUNT + rank;
+	  if (!(known_mask & RAZZ_CARD_BIT (*csr)))
+	    {
+	      return 0;
+	    }
+	}
+      return 1;
+    }
+
+  suit = strchr (suits, str[0]);
+  if (suit == NULL || str[0] == '\0'
+      || (rank = strtorank (str + 1)) == INVALID_RANK)
+    {
+      return 1;
+    }
+  *csr = (suit - suits) * RANK_COUNT + rank;
+
+  return (known_mask & RAZZ_CARD_BIT (*csr)) != 0;
+}
+
+/**
+ * Parses the cards of a street, which are my three to seven cards, then
+ * optionally a slash followed by the other cards seen (e.g., the upcards of
+ * the opponents and the folded cards).
+ *
+ * @param [in] text the cards.
+ * @param [in] len the length of the cards.
+ * @param [out] scenario the scenario of the street.
+ *
+ * @return the number of my cards or 0 if the cards are invalid.
+ */
+static int
+parse_history_street (const char *text, size_t len,
+		      struct razz_scenario *scenario)
+{
+  const char *end = text + len;
+  int is_mine = 1;
+  int my_card_count = 0;
+
+  scenario->known_mask = 0;
+  scenario->my_mask = 0;
+  while (text < end)
+    {
+      const char *token;
+      enum card_suit_rank csr;
+
+      while (text < end && (*text == ' ' || *text == '\t' || *text == '\r'))
+	{
+	  text++;
+	}
+      if (text == end)
+	{
+	  break;
+	}
+      if (*text == '/')
+	{
+	  if (!is_mine)
+	    {
+	      return 0;
+	    }
+	  is_mine = 0;
+	  text++;
+	  continue;
+	}
+
+      token = text;
+      while (text < end && *text != ' ' && *text != '\t' && *text != '\r'
+	     && *text != '/')
+	{
+	  text++;
+	}
+      if (parse_history_card (token, text - token, scenario->known_mask,
+			      &csr))
+	{
+	  return 0;
+	}
+      scenario->known_mask |= RAZZ_CARD_BIT (csr);
+      if (is_mine)
+	{
+	  scenario->my_mask |= RAZZ_CARD_BIT (csr);
+	  my_card_count++;
+	}
+    }
+
+  if (my_card_count < 3 || !is_valid_razz_scenario (scenario))
+    {
+      return 0;
+    }
+
+  return my_card_count;
+}
+
+/**
+ * Finds or adds the distinct scenario of a street of a batch.
+ *
+ * @param [in,out] b the batch.
+ * @param [in] scenario the scenario of the street.
+ *
+ * @return the index of the distinct scenario.
+ */
+static unsigned int
+find_unique_scenario (struct history_batch *b,
+		      const struct razz_scenario *scenario)
+{
+  struct razz_scenario canonical;
+  uint64_t h;
+  unsigned int i;
+
+  canonicalize_razz_scenario (scenario, GAME_RAZZ, &canonical);
+  h = ((canonical.known_mask * 0x9E3779B97F4A7C15ULL)
+       ^ (canonical.my_mask * 0xC2B2AE3D27D4EB4FULL));
+  for (i = (h >> 32) & b->slot_mask; b->slots[i] != 0;
+       i = (i + 1) & b->slot_mask)
+    {
+      const struct razz_scenario *u = &b->uniques[b->slots[i] - 1].scenario;
+
+      if (u->known_mask == canonical.known_mask
+	  && u->my_mask == canonical.my_mask)
+	{
+	  return b->slots[i] - 1;
+	}
+    }
+
+  b->uniques[b->unique_count].scenario = canonical;
+  b->slots[i] = ++b->unique_count;
+
+  return b->unique_count - 1;
+}
+
+/**
+ * Reads the next street of the history into a batch. Blank lines and lines
+ * starting with # are skipped.
+ *
+ * @param [in] r the reader.
+ * @param [in,out] b the batch.
+ * @param [in] line_no the number of lines read so far, which is advanced.
+ *
+ * @return 0 if a street is read, 1 at the end of the history or -1 if the
+ *         batch cannot grow.
+ */
+static int
+read_history_street (struct history_reader *r, struct history_batch *b,
+		     unsigned long *line_no)
+{
+  struct history_street *s = &b->streets[b->street_count];
+  struct razz_scenario scenario;
+  const char *line;
+  const char *colon;
+  size_t len;
+
+  do
+    {
+      if (read_history_line (r, &line, &len))
+	{
+	  return 1;
+	}
+      ++*line_no;
+    }
+  while (len == 0 || line[0] == '#' || (len == 1 && line[0] == '\r'));
+
+  colon = memchr (line, ':', len);
+  s->id_len = (colon == NULL ? 0 : (size_t) (colon - line));
+  if (b->ids_len + s->id_len > b->ids_capacity)
+    {
+      size_t capacity = 2 * (b->ids_capacity + s->id_len);
+      char *ids = realloc (b->ids, capacity);
+
+      if (ids == NULL)
+	{
+	  return -1;
+	}
+      b->ids = ids;
+      b->ids_capacity = capacity;
+    }
+  memcpy (b->ids + b->ids_len, line, s->id_len);
+  s->id_offset = b->ids_len;
+  b->ids_len += s->id_len;
+
+  s->my_card_count = 0;
+  if (colon != NULL)
+    {
+      s->my_card_count = parse_history_street (colon + 1,
+					       len - s->id_len - 1,
+					       &scenario);
+    }
+  if (s->my_card_count == 0)
+    {
+      fprintf (stderr, "Invalid street on line %lu\n", *line_no);
+    }
+  else
+    {
+      s->unique_idx = find_unique_scenario (b, &scenario);
+    }
+  b->street_count++;
+
+  return 0;
+}
+
+/**
+ * Records the rank probabilities of a finished job in its distinct scenario.
+ *
+ * @param [in] job the job.
+ * @param [out] u the distinct scenario of the job.
+ * @param [in] result the buffer of the outcome counts.
+ */
+static void
+collect_job (razz_job *job, struct unique_scenario *u,
+	     struct razz_result *result)
+{
+  int i;
+
+  razz_wait (job, -1);
+  if (razz_job_result (job, result) != 0 || result->game_count == 0)
+    {
+      u->probabilities[0] = -1;
+      return;
+    }
+
+  for (i = 0; i < REPLAY_RANK_COUNT; i++)
+    {
+      u->probabilities[i] = ((double) result->rank_counts[R5 + i]
+			     / result->game_count);
+    }
+}
+
+/**
+ * Simulates the distinct scenarios of a batch keeping a window of jobs in
+ * flight, then writes the annotation of every street in the input order.
+ *
+ * @param [in] ctx the context running the jobs.
+ * @param [in,out] b the batch.
+ * @param [in] game_count the number of games per distinct scenario.
+ * @param [in] options the options of the jobs.
+ * @param [in] result the buffer of the outcome counts.
+ *
+ * @return 0 if the batch is annotated or non-zero otherwise.
+ */
+static int
+annotate_batch (razz_ctx *ctx, struct history_batch *b,
+		unsigned long game_count,
+		const struct simulation_options *options,
+		struct razz_result *result)
+{
+  razz_job *jobs[REPLAY_JOB_WINDOW];
+  unsigned int submitted = 0;
+  unsigned int collected = 0;
+  unsigned int i;
+  int j;
+
+  while (collected < b->unique_count)
+    {
+      while (submitted < b->unique_count
+	     && submitted - collected < REPLAY_JOB_WINDOW)
+	{
+	  jobs[submitted % REPLAY_JOB_WINDOW]
+	    = razz_submit_scenario (ctx, &b->uniques[submitted].scenario,
+				    game_count, options);
+	  if (jobs[submitted % REPLAY_JOB_WINDOW] == NULL)
+	    {
+	      fprintf (stderr, "Cannot submit a street\n");
+	      while (collected < submitted)
+		{
+		  razz_job_destroy (&jobs[collected++ % REPLAY_JOB_WINDOW]);
+		}
+	      return 1;
+	    }
+	  submitted++;
+	}
+
+      collect_job (jobs[collected % REPLAY_JOB_WINDOW],
+		   &b->uniques[collected], result);
+      razz_job_destroy (&jobs[collected % REPLAY_JOB_WINDOW]);
+      collected++;
+    }
+
+  for (i = 0; i < b->street_count; i++)
+    {
+      const struct history_street *s = &b->streets[i];
+      const struct unique_scenario *u;
+
+      fwrite (b->ids + s->id_offset, 1, s->id_len, stdout);
+      if (s->my_card_count == 0
+	  || (u = &b->uniques[s->unique_idx])->probabilities[0] < 0)
+	{
+	  fputs ("\t-\n", stdout);
+	  continue;
+	}
+      printf ("\t%d", s->my_card_count);
+      for (j = 0; j < REPLAY_RANK_COUNT; j++)
+	{
+	  printf ("\t%.4f", u->probabilities[j]);
+	}
+      putchar ('\n');
+    }
+
+  return ferror (stdout) ? 1 : 0;
+}
+
+/**
+ * Allocates the buffers of a batch.
+ *
+ * @param [out] b the batch to be allocated.
+ * @param [in] capacity the most streets of the batch.
+ *
+ * @return 0 if the batch is allocated or non-zero otherwise.
+ */
+static int
+init_history_batch (struct history_batch *b, unsigned int capacity)
+{
+  unsigned int slot_count = 2;
+
+  while (slot_count < 2 * capacity)
+    {
+      slot_count *= 2;
+    }
+
+  memset (b, 0, sizeof (*b));
+  b->capacity = capacity;
+  b->slot_mask = slot_count - 1;
+  b->streets = malloc (capacity * sizeof (*b->streets));
+  b->uniques = malloc (capacity * sizeof (*b->uniques));
+  b->slots = calloc (slot_count, sizeof (*b->slots));
+
+  return b->streets == NULL || b->uniques == NULL || b->slots == NULL;
+}
+
+/**
+ * Empties a batch for the next streets.
+ *
+ * @param [in,out] b the batch.
+ */
+static void
+reset_history_batch (struct history_batch *b)
+{
+  memset (b->slots, 0, (b->slot_mask + 1) * sizeof (*b->slots));
+  b->street_count = 0;
+  b->unique_count = 0;
+  b->ids_len = 0;
+}
+
+/**
+ * Frees the buffers of a batch.
+ *
+ * @param [in] b the batch.
+ */
+static void
+release_history_batch (struct history_batch *b)
+{
+  free (b->streets);
+  free (b->uniques);
+  free (b->slots);
+  free (b->ids);
+}
+
+void
+print_usage (void)
+{
+  fprintf (stderr,
+	   "Usage: razz_replay [--games=N] [--threads=N] [--batch=N]\n"
+	   "\t[--seed=N] [--metrics=FILE [--metrics-interval=MS]]\n"
+	   "\t[HISTORY]\n"
+	   "\n"
+	   "Annotates every street of a Razz hand history with the probability\n"
+	   "of each rank from 5 to K that my hand ends up with. A street is a\n"
+	   "line of the form\n"
+	   "\tHAND_ID: MY_CARDS [/ SEEN_CARDS]\n"
+	   "where MY_CARDS are my three to seven cards and SEEN_CARDS are the\n"
+	   "other cards seen so far. A card is a rank (A, 2, ..., 10, J, Q, K)\n"
+	   "or a suited card (e.g., SA or H10). Blank lines and lines starting\n"
+	   "with # are skipped. The annotations are written to stdout in the\n"
+	   "order of the streets as\n"
+	   "\tHAND_ID<TAB>STREET<TAB>P(5)<TAB>...<TAB>P(K)\n"
+	   "or HAND_ID<TAB>- for an invalid street. HISTORY is read from stdin\n"
+	   "if it is - or not given.\n"
+	   "\n"
+	   "Options:\n"
+	   "\t--games=N\tsimulates N games per distinct street (%d by\n"
+	   "\t\t\tdefault)\n"
+	   "\t--threads=N\truns the games on N worker threads (0 for one\n"
+	   "\t\t\tper online CPU, the default)\n"
+	   "\t--batch=N\treads N streets at a time, simulating each\n"
+	   "\t\t\tdistinct street of a batch only once (%d by\n"
+	   "\t\t\tdefault)\n"
+	   "\t--seed=N\tdeals the games of every street from the same\n"
+	   "\t\t\tcounter-based streams keyed by N, so the annotations\n"
+	   "\t\t\tare reproducible\n"
+	   "\t--metrics=FILE\treplaces FILE atomically with the counters of\n"
+	   "\t\t\tthe workers in Prometheus text format every second\n"
+	   "\t\t\tand at exit\n"
+	   "\t--metrics-interval=MS\twith --metrics, exports every MS\n"
+	   "\t\t\tmilliseconds instead\n",
+	   DEFAULT_REPLAY_GAME_COUNT, DEFAULT_REPLAY_BATCH_SIZE);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct razz_ctx_options ctx_options;
+  struct history_reader reader;
+  struct history_batch batch;
+  struct razz_result *result;
+  unsigned long game_count = DEFAULT_REPLAY_GAME_COUNT;
+  unsigned long batch_size = DEFAULT_REPLAY_BATCH_SIZE;
+  unsigned long line_no = 0;
+  const char *path = "-";
+  const char *metrics_path = NULL;
+  unsigned long metrics_interval_ms = 0;
+  razz_metrics_exporter *exporter = NULL;
+  razz_ctx *ctx;
+  int arg_idx;
+  int rc = 0;
+
+  init_razz_ctx_options (&ctx_options);
+  for (arg_idx = 1; arg_idx < argc; arg_idx++)
+    {
+      if (strncmp (argv[arg_idx], "--games=", 8) == 0)
+	{
+	  game_count = strtoul (argv[arg_idx] + 8, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--threads=", 10) == 0)
+	{
+	  ctx_options.thread_count = atoi (argv[arg_idx] + 10);
+	}
+      else if (strncmp (argv[arg_idx], "--batch=", 8) == 0)
+	{
+	  batch_size = strtoul (argv[arg_idx] + 8, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--seed=", 7) == 0)
+	{
+	  ctx_options.simulation.counter_key = strtoull (argv[arg_idx] + 7,
+							 NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--metrics=", 10) == 0)
+	{
+	  metrics_path = argv[arg_idx] + 10;
+	}
+      else if (strncmp (argv[arg_idx], "--metrics-interval=", 19) == 0)
+	{
+	  metrics_interval_ms = strtoul (argv[arg_idx] + 19, NULL, 10);
+	}
+      else if (strncmp (argv[arg_idx], "--", 2) == 0
+	       || arg_idx != argc - 1)
+	{
+	  print_usage ();
+	  exit (EXIT_FAILURE);
+	}
+      else
+	{
+	  path = argv[arg_idx];
+	}
+    }
+  if (game_count == 0 || batch_size == 0 || batch_size > (1UL << 28))
+    {
+      print_usage ();
+      exit (EXIT_FAILURE);
+    }
+
+  if (open_history (&reader, path))
+    {
+      exit (EXIT_FAILURE);
+    }
+  result = malloc (sizeof (*result));
+  if (result == NULL || init_history_batch (&batch, batch_size))
+    {
+      fprintf (stderr, "Cannot allocate the batch\n");
+      exit (EXIT_FAILURE);
+    }
+  ctx = razz_ctx_create (&ctx_options);
+  if (ctx == NULL)
+    {
+      fprintf (stderr, "Cannot create a simulation context\n");
+      exit (EXIT_FAILURE);
+    }
+  if (metrics_path != NULL)
+    {
+      exporter = razz_metrics_exporter_create (metrics_path,
+					       metrics_interval_ms, ctx, NULL);
+      if (exporter == NULL)
+	{
+	  fprintf (stderr, "Cannot start exporting the metrics\n");
+	  exit (EXIT_FAILURE);
+	}
+    }
+
+  while (rc == 0)
+    {
+      int read_rc = 0;
+
+      reset_history_batch (&batch);
+      while (batch.street_count < batch.capacity
+	     && (read_rc = read_history_street (&reader, &batch,
+						&line_no)) == 0)
+	{
+	}
+      if (read_rc == -1)
+	{
+	  fprintf (stderr, "Cannot allocate the hand IDs\n");
+	  rc = 1;
+	  break;
+	}
+      if (batch.street_count == 0)
+	{
+	  break;
+	}
+      rc = annotate_batch (ctx, &batch, game_count,
+			   &ctx_options.simulation, result);
+    }
+
+  razz_metrics_exporter_destroy (&exporter);
+  razz_ctx_destroy (&ctx);
+  release_history_batch (&batch);
+  free (result);
+  close_history (&reader);
+  if (fflush (stdout) != 0)
+    {
+      rc = 1;
+    }
+
+  exit (rc ? EXIT_FAILURE : EXIT_SUCCESS);
+}
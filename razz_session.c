@@ -0,0 +1,471 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_session.c
+ * @brief The bankroll over sessions of consecutive Razz hands.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rng.h"
+#include "razz_session.h"
+
+/** The number of cards in a complete Razz hand. */
+#define RAZZ_CARD_IN_HAND_COUNT 7
+
+/** The number of hands between two checks of the cancel flag. */
+#define SESSION_CHECK_PERIOD 1024
+
+/** The state shared by the threads running the sessions. */
+struct session_run
+{
+  const struct razz_policy *policy; /**< The starting hands I play. */
+  const struct session_options *options; /**< The model of the hands. */
+  uint64_t seed; /**< The key of the streams of the sessions. */
+  unsigned long next_session; /**< The next session to be taken. */
+  int is_cancelled; /**< Non-zero once the cancel flag is seen. */
+  pthread_mutex_t lock; /**< Protects the statistics. */
+  struct session_stats *stats; /**< The statistics of every thread merged. */
+};
+
+/** A thread running sessions. */
+struct session_worker
+{
+  struct session_run *run; /**< The shared state. */
+  pthread_t thread; /**< The thread. */
+  int rc; /**< Non-zero if the thread cannot run. */
+};
+
+unsigned int
+get_razz_start_index (const enum card_rank ranks[3])
+{
+  unsigned int a = ranks[0];
+  unsigned int b = ranks[1];
+  unsigned int c = ranks[2];
+  unsigned int t;
+
+  if (a > b)
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+  if (b > c)
+    {
+      t = b;
+      b = c;
+      c = t;
+    }
+  if (a > b)
+    {
+      t = a;
+      a = b;
+      b = t;
+    }
+
+  return (a * RANK_COUNT + b) * RANK_COUNT + c;
+}
+
+void
+init_razz_policy_by_rank (struct razz_policy *policy, enum card_rank highest,
+			  int plays_pairs)
+{
+  enum card_rank ranks[3];
+
+  memset (policy->is_played, 0, sizeof (policy->is_played));
+  if (highest == INVALID_RANK)
+    {
+      return;
+    }
+
+  for (ranks[0] = ACE; ranks[0] <= highest; ranks[0]++)
+    {
+      for (ranks[1] = ranks[0]; ranks[1] <= highest; ranks[1]++)
+	{
+	  for (ranks[2] = ranks[1]; ranks[2] <= highest; ranks[2]++)
+	    {
+	      if (plays_pairs
+		  || (ranks[0] != ranks[1] && ranks[1] != ranks[2]))
+		{
+		  policy->is_played[get_razz_start_index (ranks)] = 1;
+		}
+	    }
+	}
+    }
+}
+
+void
+init_session_options (struct session_options *options)
+{
+  options->opponent_count = 1;
+  options->ante = 1;
+  options->bet = 10;
+  options->starting_bankroll = 1000;
+  options->hands_per_session = 10000;
+  options->session_count = 1000;
+  options->thread_count = 0;
+  options->seed = 0;
+  options->cancel_flag = NULL;
+}
+
+/**
+ * Adds a sample to running statistics using Welford's update.
+ *
+ * @param [in,out] stats the statistics.
+ * @param [in] x the sample.
+ */
+static void
+add_running_sample (struct running_stats *stats, double x)
+{
+  double delta = x - stats->mean;
+
+  if (stats->count == 0 || x < stats->min)
+    {
+      stats->min = x;
+    }
+  if (stats->count == 0 || x > stats->max)
+    {
+      stats->max = x;
+    }
+  stats->count++;
+  stats->mean += delta / stats->count;
+  stats->m2 += delta * (x - stats->mean);
+}
+
+/**
+ * Merges running statistics into others using the pairwise update of Chan
+ * et al.
+ *
+ * @param [in,out] dst the statistics to be merged into.
+ * @param [in] src the statistics to be merged.
+ */
+static void
+merge_running_stats (struct running_stats *dst,
+		     const struct running_stats *src)
+{
+  unsigned long count = dst->count + src->count;
+  double delta = src->mean - dst->mean;
+
+  if (src->count == 0)
+    {
+      return;
+    }
+  if (dst->count == 0)
+    {
+      *dst = *src;
+      return;
+    }
+
+  dst->m2 += src->m2 + delta * delta * dst->count * src->count / count;
+  dst->mean += delta * src->count / count;
+  dst->count = count;
+  if (src->min < dst->min)
+    {
+      dst->min = src->min;
+    }
+  if (src->max > dst->max)
+    {
+      dst->max = src->max;
+    }
+}
+
+double
+get_running_variance (const struct running_stats *stats)
+{
+  if (stats->count < 2)
+    {
+      return 0;
+    }
+
+  return stats->m2 / (stats->count - 1);
+}
+
+/**
+ * Deals the seven cards of a player and evaluates them.
+ *
+ * @param [in,out] deck the deck to deal from.
+ * @param [in] r the random stream.
+ * @param [in,out] rank_counts the rank counts of the cards already dealt to
+ *                             the player, to which the cards are added.
+ * @param [in] card_count the number of cards already dealt to the player.
+ *
+ * @return the Razz low index of the player.
+ */
+static unsigned int
+complete_player (struct rank_deck *deck, rng *r,
+		 uint8_t rank_counts[RANK_COUNT], int card_count)
+{
+  for (; card_count < RAZZ_CARD_IN_HAND_COUNT; card_count++)
+    {
+      rank_counts[deal_rank_from_rank_deck (deck, r)]++;
+    }
+
+  return get_razz_low_index_of_counts (rank_counts);
+}
+
+/**
+ * Plays one hand.
+ *
+ * @param [in] policy the starting hands I play.
+ * @param [in] options the model of the hand.
+ * @param [in] r the random stream.
+ * @param [in,out] stats the statistics to which the hand is added.
+ *
+ * @return my net result of the hand.
+ */
+static double
+play_hand (const struct razz_policy *policy,
+	   const struct session_options *options, rng *r,
+	   struct session_stats *stats)
+{
+  struct rank_deck deck;
+  uint8_t my_counts[RANK_COUNT] = {0};
+  enum card_rank start[3];
+  double stake = options->ante + options->bet;
+  unsigned int my_low;
+  unsigned int tie_count = 1;
+  unsigned int i;
+
+  init_rank_deck (&deck);
+  for (i = 0; i < 3; i++)
+    {
+      start[i] = deal_rank_from_rank_deck (&deck, r);
+      my_counts[start[i]]++;
+    }
+  if (!policy->is_played[get_razz_start_index (start)])
+    {
+      return -options->ante;
+    }
+  stats->played_count++;
+
+  /* The order in which the cards are dealt does not change the chances, so
+     the opponents are dealt one after another and a lost pot stops early */
+  my_low = complete_player (&deck, r, my_counts, 3);
+  for (i = 0; i < options->opponent_count; i++)
+    {
+      uint8_t counts[RANK_COUNT] = {0};
+      unsigned int low = complete_player (&deck, r, counts, 0);
+
+      if (low < my_low)
+	{
+	  return -stake;
+	}
+      if (low == my_low)
+	{
+	  tie_count++;
+	}
+    }
+  stats->won_count++;
+
+  return stake * (options->opponent_count + 1) / tie_count - stake;
+}
+
+/**
+ * Plays a session and adds it to the statistics of a thread.
+ *
+ * @param [in] run the shared state.
+ * @param [in] r the random stream.
+ * @param [in,out] stats the statistics of the thread.
+ *
+ * @return 0 if the session is finished or non-zero if it is cancelled.
+ */
+static int
+play_session (struct session_run *run, rng *r, struct session_stats *stats)
+{
+  const struct session_options *options = run->options;
+  double stake = options->ante + options->bet;
+  double bankroll = options->starting_bankroll;
+  double peak = bankroll;
+  double max_drawdown = 0;
+  unsigned long hand;
+
+  for (hand = 0; hand < options->hands_per_session; hand++)
+    {
+      double net;
+
+      if (bankroll < stake)
+	{
+	  stats->ruined_count++;
+	  break;
+	}
+      if (hand % SESSION_CHECK_PERIOD == SESSION_CHECK_PERIOD - 1
+	  && options->cancel_flag != NULL && *options->cancel_flag)
+	{
+	  return 1;
+	}
+
+      net = play_hand (run->policy, options, r, stats);
+      stats->hand_count++;
+      add_running_sample (&stats->hand_net, net);
+      bankroll += net;
+      if (bankroll > peak)
+	{
+	  peak = bankroll;
+	}
+      else if (peak - bankroll > max_drawdown)
+	{
+	  max_drawdown = peak - bankroll;
+	}
+    }
+
+  stats->session_count++;
+  add_running_sample (&stats->final_bankroll, bankroll);
+  add_running_sample (&stats->max_drawdown, max_drawdown);
+
+  return 0;
+}
+
+/**
+ * Merges the statistics of a thread into those of the sessions.
+ *
+ * @param [in,out] dst the statistics of the sessions.
+ * @param [in] src the statistics of a thread.
+ */
+static void
+merge_session_stats (struct session_stats *dst,
+		     const struct session_stats *src)
+{
+  dst->session_count += src->session_count;
+  dst->ruined_count += src->ruined_count;
+  dst->hand_count += src->hand_count;
+  dst->played_count += src->played_count;
+  dst->won_count += src->won_count;
+  merge_running_stats (&dst->hand_net, &src->hand_net);
+  merge_running_stats (&dst->final_bankroll, &src->final_bankroll);
+  merge_running_stats (&dst->max_drawdown, &src->max_drawdown);
+}
+
+/** The body of a thread running sessions. */
+static void *
+run_sessions (void *arg)
+{
+  struct session_worker *w = arg;
+  struct session_run *run = w->run;
+  struct session_stats stats;
+  unsigned long session;
+  rng *r;
+
+  r = create_counter_rng (run->seed);
+  if (r == NULL)
+    {
+      w->rc = 1;
+      return NULL;
+    }
+
+  memset (&stats, 0, sizeof (stats));
+  while (!__atomic_load_n (&run->is_cancelled, __ATOMIC_RELAXED)
+	 && ((session = __atomic_fetch_add (&run->next_session, 1,
+					    __ATOMIC_RELAXED))
+	     < run->options->session_count))
+    {
+      /* Every session has its own stream, so whichever thread plays it
+	 deals the same cards */
+      rng_seek (r, run->seed, session);
+      if (play_session (run, r, &stats))
+	{
+	  __atomic_store_n (&run->is_cancelled, 1, __ATOMIC_RELAXED);
+	}
+    }
+  destroy_rng (&r);
+
+  pthread_mutex_lock (&run->lock);
+  merge_session_stats (run->stats, &stats);
+  pthread_mutex_unlock (&run->lock);
+
+  return NULL;
+}
+
+int
+simulate_razz_sessions (const struct razz_policy *policy,
+			const struct session_options *options,
+			struct session_stats *stats)
+{
+  struct session_run run;
+  struct session_worker *workers;
+  unsigned int thread_count = options->thread_count;
+  unsigned int started_count;
+  uint64_t seed = options->seed;
+  int rc = 0;
+  unsigned int i;
+
+  memset (stats, 0, sizeof (*stats));
+  if (options->opponent_count < 1
+      || options->opponent_count > SESSION_MAX_OPPONENT_COUNT
+      || !(options->ante >= 0) || !(options->bet >= 0))
+    {
+      fprintf (stderr, "Invalid session options\n");
+      return 1;
+    }
+
+  if (thread_count == 0)
+    {
+      long cpu_count = sysconf (_SC_NPROCESSORS_ONLN);
+
+      thread_count = (cpu_count > 0 ? cpu_count : 1);
+    }
+  if (seed == 0)
+    {
+      seed = ((uint64_t) lrand48 () << 31) ^ lrand48 ();
+    }
+
+  workers = calloc (thread_count, sizeof (*workers));
+  if (workers == NULL)
+    {
+      return 1;
+    }
+
+  run.policy = policy;
+  run.options = options;
+  run.seed = seed;
+  run.next_session = 0;
+  run.is_cancelled = 0;
+  run.stats = stats;
+  pthread_mutex_init (&run.lock, NULL);
+
+  for (started_count = 0; started_count < thread_count; started_count++)
+    {
+      struct session_worker *w = &workers[started_count];
+
+      w->run = &run;
+      if (pthread_create (&w->thread, NULL, run_sessions, w))
+	{
+	  fprintf (stderr, "Cannot start a session thread\n");
+	  rc = 1;
+	  break;
+	}
+    }
+  for (i = 0; i < started_count; i++)
+    {
+      pthread_join (workers[i].thread, NULL);
+      if (workers[i].rc)
+	{
+	  rc = 1;
+	}
+    }
+  pthread_mutex_destroy (&run.lock);
+  free (workers);
+
+  if (rc == 0 && run.is_cancelled)
+    {
+      rc = RAZZ_CANCELLED;
+    }
+
+  return rc;
+}
@@ -0,0 +1,177 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_session.h
+ * @brief The bankroll over sessions of consecutive Razz hands.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+#include "card.h"
+#include "razz_simulation.h"
+
+#ifndef RAZZ_SESSION_H
+#define RAZZ_SESSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of entries of a starting-hand policy table. */
+#define RAZZ_START_INDEX_COUNT (RANK_COUNT * RANK_COUNT * RANK_COUNT)
+
+/** The most opponents whose seven cards still fit in one deck with mine. */
+#define SESSION_MAX_OPPONENT_COUNT 6
+
+/**
+ * Determines the entry of three starting cards in a policy table. The order
+ * of the cards does not matter.
+ *
+ * @param [in] ranks the ranks of my three starting cards.
+ *
+ * @return the index below ::RAZZ_START_INDEX_COUNT.
+ */
+unsigned int
+get_razz_start_index (const enum card_rank ranks[3]);
+
+/** Which starting hands are played to the showdown. */
+struct razz_policy
+{
+  uint8_t is_played[RAZZ_START_INDEX_COUNT]; /**<
+					      * Non-zero at the start index of
+					      * a starting hand that is played
+					      * or zero if it is folded.
+					      */
+};
+
+/**
+ * Fills a policy that plays the starting hands whose highest card is at most
+ * a rank.
+ *
+ * @param [out] policy the policy to be filled.
+ * @param [in] highest the highest rank played or ::INVALID_RANK to fold
+ *                     every starting hand.
+ * @param [in] plays_pairs non-zero to also play the paired starting hands
+ *                         within the rank.
+ */
+void
+init_razz_policy_by_rank (struct razz_policy *policy, enum card_rank highest,
+			  int plays_pairs);
+
+/**
+ * The model of the hands of a session. Every hand costs me the ante. If I
+ * play my starting hand, every player puts in the bet as well and all of
+ * the opponents go to the showdown, where the best lows split the pot. A
+ * session ends early with ruin once my bankroll cannot cover the ante and
+ * the bet of the next hand.
+ */
+struct session_options
+{
+  unsigned int opponent_count; /**<
+				* The number of opponents from 1 to
+				* ::SESSION_MAX_OPPONENT_COUNT.
+				*/
+  double ante; /**< The ante of every player. */
+  double bet; /**< The bet of every player in a played hand. */
+  double starting_bankroll; /**< My bankroll at the start of a session. */
+  unsigned long hands_per_session; /**< The number of hands of a session. */
+  unsigned long session_count; /**< The number of sessions. */
+  unsigned int thread_count; /**<
+			      * The number of threads running sessions
+			      * independently or 0 to use one per online CPU.
+			      */
+  uint64_t seed; /**< The key of the random streams or 0 to use lrand48(). */
+  const volatile sig_atomic_t *cancel_flag; /**<
+					     * The flag that stops the
+					     * sessions early once it is set
+					     * to non-zero or NULL.
+					     */
+};
+
+/**
+ * Sets the options of the sessions to the default values: one opponent, an
+ * ante of 1, a bet of 10, a starting bankroll of 1000 and 1000 sessions of
+ * 10000 hands on one thread per online CPU.
+ *
+ * @param [out] options the options to be initialized.
+ */
+void
+init_session_options (struct session_options *options);
+
+/** The running mean, variance and range of a quantity. */
+struct running_stats
+{
+  unsigned long count; /**< The number of samples. */
+  double mean; /**< The mean of the samples. */
+  double m2; /**< The sum of the squared deviations from the mean. */
+  double min; /**< The smallest sample. */
+  double max; /**< The largest sample. */
+};
+
+/**
+ * Determines the sample variance of running statistics.
+ *
+ * @param [in] stats the statistics.
+ *
+ * @return the variance or 0 if there are fewer than two samples.
+ */
+double
+get_running_variance (const struct running_stats *stats);
+
+/**
+ * The statistics of the sessions, which take the same memory however many
+ * hands are simulated.
+ */
+struct session_stats
+{
+  unsigned long session_count; /**< The number of finished sessions. */
+  unsigned long ruined_count; /**< The number of sessions ending in ruin. */
+  unsigned long hand_count; /**< The number of hands dealt. */
+  unsigned long played_count; /**< The number of starting hands played. */
+  unsigned long won_count; /**< The number of pots won or split. */
+  struct running_stats hand_net; /**< My net result per hand. */
+  struct running_stats final_bankroll; /**< My bankroll after a session. */
+  struct running_stats max_drawdown; /**<
+				      * The largest fall of my bankroll from
+				      * its peak within a session.
+				      */
+};
+
+/**
+ * Simulates sessions of consecutive hands, each of which deals me a random
+ * starting hand. The sessions are spread over threads, but every session
+ * deals from its own stream of a counter-based generator, so the counts do
+ * not depend on the number of threads. Only the last bits of the means and
+ * variances may, as the threads merge them in any order.
+ *
+ * @param [in] policy the starting hands I play.
+ * @param [in] options the model and the number of sessions.
+ * @param [out] stats the statistics of the finished sessions.
+ *
+ * @return 0 if every session is finished, ::RAZZ_CANCELLED if the
+ *         cancel flag stops the sessions early or another non-zero value if
+ *         the options are invalid or the threads cannot be started.
+ */
+int
+simulate_razz_sessions (const struct razz_policy *policy,
+			const struct session_options *options,
+			struct session_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_SESSION_H */
@@ -0,0 +1,124 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "razz_session.h"
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct razz_policy policy;
+  struct session_options options;
+  struct session_stats stats;
+  int rc;
+
+  /* Starting-hand policies */
+  {
+    const enum card_rank a23[] = {ACE, R2, R3};
+    const enum card_rank r32a[] = {R3, R2, ACE};
+    const enum card_rank pair[] = {R2, ACE, R2};
+    const enum card_rank k_high[] = {K, ACE, R2};
+
+    assert (get_razz_start_index (a23) == get_razz_start_index (r32a));
+    assert (get_razz_start_index (a23) != get_razz_start_index (pair));
+    assert (get_razz_start_index (k_high) < RAZZ_START_INDEX_COUNT);
+
+    init_razz_policy_by_rank (&policy, R8, 0);
+    assert (policy.is_played[get_razz_start_index (a23)]);
+    assert (!policy.is_played[get_razz_start_index (pair)]);
+    assert (!policy.is_played[get_razz_start_index (k_high)]);
+
+    init_razz_policy_by_rank (&policy, R8, 1);
+    assert (policy.is_played[get_razz_start_index (pair)]);
+  }
+
+  init_session_options (&options);
+  options.seed = 5;
+  options.thread_count = 2;
+  options.session_count = 50;
+  options.hands_per_session = 2000;
+  options.starting_bankroll = 1e9;
+
+  /* Folding every hand only loses the antes */
+  init_razz_policy_by_rank (&policy, INVALID_RANK, 0);
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  assert (rc == 0);
+  assert (stats.session_count == 50);
+  assert (stats.hand_count == 100000);
+  assert (stats.played_count == 0);
+  assert (stats.ruined_count == 0);
+  assert (stats.hand_net.mean == -1);
+  assert (stats.hand_net.m2 == 0);
+  assert (stats.final_bankroll.count == 50);
+  assert (stats.final_bankroll.mean == 1e9 - 2000);
+  assert (stats.max_drawdown.max == 2000);
+
+  /* Heads-up with every hand played is a fair game */
+  init_razz_policy_by_rank (&policy, K, 1);
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  assert (rc == 0);
+  assert (stats.played_count == stats.hand_count);
+  assert (stats.won_count > stats.hand_count * 45 / 100
+	  && stats.won_count < stats.hand_count * 55 / 100);
+  assert (stats.hand_net.mean > -0.2 && stats.hand_net.mean < 0.2);
+  assert (stats.hand_net.min == -11 && stats.hand_net.max == 11);
+  assert (get_running_variance (&stats.hand_net) > 100);
+  assert (stats.final_bankroll.count == stats.session_count);
+
+  /* Playing only the best starts wins most of the showdowns */
+  init_razz_policy_by_rank (&policy, R6, 0);
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  assert (rc == 0);
+  assert (stats.played_count < stats.hand_count / 10);
+  assert (stats.won_count > stats.played_count / 2);
+
+  /* A short bankroll is ruined */
+  init_razz_policy_by_rank (&policy, K, 1);
+  options.starting_bankroll = 30;
+  options.opponent_count = 3;
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  assert (rc == 0);
+  assert (stats.session_count == 50);
+  assert (stats.ruined_count > 40);
+  assert (stats.hand_count < 100000);
+  assert (stats.final_bankroll.min >= 0 && stats.final_bankroll.min < 11);
+
+  /* The counts do not depend on the threads */
+  {
+    struct session_stats single;
+
+    options.thread_count = 1;
+    rc = simulate_razz_sessions (&policy, &options, &single);
+    assert (rc == 0);
+    assert (single.hand_count == stats.hand_count);
+    assert (single.played_count == stats.played_count);
+    assert (single.won_count == stats.won_count);
+    assert (single.ruined_count == stats.ruined_count);
+    assert (single.final_bankroll.min == stats.final_bankroll.min);
+    assert (single.max_drawdown.max == stats.max_drawdown.max);
+  }
+
+  /* Invalid options */
+  options.opponent_count = SESSION_MAX_OPPONENT_COUNT + 1;
+  rc = simulate_razz_sessions (&policy, &options, &stats);
+  assert (rc != 0);
+
+  return EXIT_SUCCESS;
+}
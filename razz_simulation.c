@@ -17,67 +17,90 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "card.h"
+#include "rng.h"
 #include "razz_simulation.h"
-
-/** The number of cards each person is dealt in one round of Razz game. */
-#define RAZZ_CARD_IN_HAND_COUNT 7
+#include "razz_kernel.h"
+#include "perf_counters.h"
 
 /**
  * Complete my hand with the predetermined cards and cards dealt from the deck.
  * The predetermined cards must not contain any duplicate.
  *
  * @param [in] my_hand the hand to be completed.
- * @param [in] decided_cards the predetermined cards for my hand.
+ * @param [in] my_cards the predetermined cards for my hand.
+ * @param [in] my_card_count the number of predetermined cards.
  * @param [in] deck the deck from which additional cards are dealt.
+ * @param [in] deal_mode how the additional cards are dealt.
  */
 static void
-complete_hand (card_hand *my_hand, const struct decided_cards *decided_cards,
-	       card_deck *deck)
+complete_hand (card_hand *my_hand, const card **my_cards, int my_card_count,
+	       card_deck *deck, enum deal_mode deal_mode)
 {
   int i;
-  int end = decided_cards->my_card_count;
+  int end = my_card_count;
+  const card *dealt_cards[RAZZ_CARD_IN_HAND_COUNT];
 
   for (i = 0; i < end; i++)
     {
-      insert_into_hand (my_hand, decided_cards->my_cards[i]);
+      insert_into_hand (my_hand, my_cards[i]);
     }
 
   end = RAZZ_CARD_IN_HAND_COUNT - end;
+  if (deal_mode == DEAL_COMBINATION)
+    {
+      deal_combination_from_deck (deck, end, dealt_cards);
+    }
+  else
+    {
+      for (i = 0; i < end; i++)
+	{
+	  dealt_cards[i] = deal_from_deck (deck);
+	}
+    }
+
   for (i = 0; i < end; i++)
     {
-      insert_into_hand (my_hand, deal_from_deck (deck));
+      insert_into_hand (my_hand, dealt_cards[i]);
     }
 }
 
-/** Removes a duplicated rank from a hand. */
+/**
+ * Removes a duplicated rank from a hand. The context points to an
+ * ::card_rank holding the rank of the previous card.
+ */
 static enum itr_action
-duplicated_rank_remover (unsigned long len, unsigned long pos, const card *c)
+duplicated_rank_remover (void *ctx, unsigned long len, unsigned long pos,
+			 const card *c)
 {
-  static enum card_rank prev_rank;
+  enum card_rank *prev_rank = ctx;
   enum card_rank curr_rank = get_card_rank (c);
 
   if (pos == 0)
     {
-      prev_rank = curr_rank;
+      *prev_rank = curr_rank;
       return CONTINUE;
     }
 
-  if (prev_rank == curr_rank)
+  if (*prev_rank == curr_rank)
     {
       return REMOVE_AND_CONTINUE;
     }
 
-  prev_rank = curr_rank;
+  *prev_rank = curr_rank;
 
   return CONTINUE;
 }
 
-/** Keeps only the first five cards in a hand. */
+/**
+ * Keeps only the first few cards in a hand. The context points to an
+ * unsigned long holding the number of cards to keep.
+ */
 static enum itr_action
-length_trimmer (unsigned long len, unsigned long pos, const card *c)
+length_trimmer (void *ctx, unsigned long len, unsigned long pos, const card *c)
 {
-  if (pos >= 5)
+  if (pos >= *(const unsigned long *) ctx)
     {
       return REMOVE_AND_CONTINUE;
     }
@@ -85,131 +108,2644 @@ length_trimmer (unsigned long len, unsigned long pos, const card *c)
   return CONTINUE;
 }
 
-/** Prints all cards in the hand. */
+/**
+ * Prints all cards in the hand. The context points to the FILE to print the
+ * cards to.
+ */
 static enum itr_action
-card_printer (unsigned long len, unsigned long pos, const card *c)
+card_printer (void *ctx, unsigned long len, unsigned long pos, const card *c)
 {
-  printf ("%4s", cardtostr (get_card_suit_rank (c)));
+  fprintf (ctx, "%4s", cardtostr (get_card_suit_rank (c)));
   return CONTINUE;
 }
 
 /**
- * Determines the Razz rank of a hand.
+ * Determines the Razz rank of a hand sorted by rank by removing the cards
+ * that do not count. This is the reference evaluator that the faster ones
+ * are verified against.
  *
  * @param [in] hand the hand whose rank is to be determined.
+ * @param [in] trace the stream to print each step to or NULL.
  *
  * @return the Razz rank of the hand between R5 and K or INVALID_RANK if the
  *         rank is worse than K.
  */
 static enum card_rank
-get_razz_rank (card_hand *hand)
+evaluate_razz_rank (card_hand *hand, FILE *trace)
 {
   enum card_rank r;
+  enum card_rank prev_rank;
   unsigned long cards_count;
+  unsigned long kept_count = 5;
 
-#ifndef NDEBUG
-  iterate_hand (hand, card_printer);
-#endif
-  iterate_hand (hand, duplicated_rank_remover);
-#ifndef NDEBUG
-  printf (" -> ");
-  iterate_hand (hand, card_printer);
-#endif
+  if (trace != NULL)
+    {
+      iterate_hand_ctx (hand, card_printer, trace);
+    }
+  iterate_hand_ctx (hand, duplicated_rank_remover, &prev_rank);
+  if (trace != NULL)
+    {
+      fprintf (trace, " -> ");
+      iterate_hand_ctx (hand, card_printer, trace);
+    }
 
   cards_count = count_cards_in_hand (hand);
   if (cards_count < 5) // too many pairs in hand
     {
-#ifndef NDEBUG
-      printf ("\n");
-#endif
+      if (trace != NULL)
+	{
+	  fprintf (trace, "\n");
+	}
       return INVALID_RANK;
     }
 
-  iterate_hand (hand, length_trimmer);
+  iterate_hand_ctx (hand, length_trimmer, &kept_count);
   r = get_max_rank_of_hand (hand);
 
+  if (trace != NULL)
+    {
+      fprintf (trace, cards_count > 5 ? "\t" : "\t\t");
+      fprintf (trace, "-> ");
+      iterate_hand_ctx (hand, card_printer, trace);
+      fprintf (trace, ": %2s\n", ranktostr (r));
+    }
+
+  return r;
+}
+
+/**
+ * Determines the Razz rank of a hand printing each step in a debug build.
+ *
+ * @param [in] hand the hand whose rank is to be determined.
+ *
+ * @return the Razz rank of the hand between R5 and K or INVALID_RANK if the
+ *         rank is worse than K.
+ */
+static enum card_rank
+get_razz_rank (card_hand *hand)
+{
 #ifndef NDEBUG
-  if (cards_count > 5)
+  return evaluate_razz_rank (hand, stdout);
+#else
+  return evaluate_razz_rank (hand, NULL);
+#endif
+}
+
+/** The binomial coefficients C(n, k) for n up to 13 and k up to 5. */
+static const unsigned short binomial[RANK_COUNT + 1][6] = {
+  {1, 0, 0, 0, 0, 0},
+  {1, 1, 0, 0, 0, 0},
+  {1, 2, 1, 0, 0, 0},
+  {1, 3, 3, 1, 0, 0},
+  {1, 4, 6, 4, 1, 0},
+  {1, 5, 10, 10, 5, 1},
+  {1, 6, 15, 20, 15, 6},
+  {1, 7, 21, 35, 35, 21},
+  {1, 8, 28, 56, 70, 56},
+  {1, 9, 36, 84, 126, 126},
+  {1, 10, 45, 120, 210, 252},
+  {1, 11, 55, 165, 330, 462},
+  {1, 12, 66, 220, 495, 792},
+  {1, 13, 78, 286, 715, 1287},
+};
+
+/**
+ * The first Razz low index of each category. The number of indices of a
+ * category is C(13, 5) for no pair, 13 * C(12, 3) for one pair,
+ * C(13, 2) * 11 for two pairs, 13 * C(12, 2) for trips and 13 * 12 for both
+ * full house and quads.
+ */
+static const unsigned short low_category_base[LOW_CATEGORY_COUNT + 1] = {
+  0, 1287, 4147, 5005, 5863, 6019, RAZZ_LOW_INDEX_COUNT,
+};
+
+/**
+ * Ranks a combination in the colexicographic order, which coincides with
+ * the Razz comparison order: the highest rank is compared first.
+ *
+ * @param [in] ranks the ranks in ascending order without any duplicate.
+ * @param [in] k the number of ranks.
+ *
+ * @return the colexicographic rank of the combination.
+ */
+static unsigned int
+rank_combination (const uint8_t *ranks, int k)
+{
+  unsigned int idx = 0;
+  int i;
+
+  for (i = 0; i < k; i++)
     {
-      printf ("\t");
+      idx += binomial[ranks[i]][i + 1];
     }
-  else
+
+  return idx;
+}
+
+/**
+ * Reverses rank_combination().
+ *
+ * @param [in] idx the colexicographic rank of the combination.
+ * @param [in] k the number of ranks.
+ * @param [out] ranks the ranks in ascending order.
+ */
+static void
+unrank_combination (unsigned int idx, int k, uint8_t *ranks)
+{
+  int c = RANK_COUNT;
+
+  for (; k > 0; k--)
     {
-      printf ("\t\t");
+      while (binomial[c][k] > idx)
+	{
+	  c--;
+	}
+      ranks[k - 1] = c;
+      idx -= binomial[c][k];
     }
-  printf ("-> ");
-  iterate_hand (hand, card_printer);
-  printf (": %2s\n",
-	  ranktostr (r));
-#endif
+}
 
-  return r;
+unsigned int
+get_razz_low_index_of_counts (const uint8_t rank_counts[RANK_COUNT])
+{
+  uint8_t ranks[RANK_COUNT]; /* the distinct ranks in ascending order */
+  uint8_t paired[RANK_COUNT]; /* the ranks having at least two cards */
+  uint8_t kickers[3];
+  int distinct_count = 0;
+  int paired_count = 0;
+  int trips = -1;
+  int i, k;
+
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      if (rank_counts[i] == 0)
+	{
+	  continue;
+	}
+
+      ranks[distinct_count++] = i;
+      if (rank_counts[i] >= 2)
+	{
+	  paired[paired_count++] = i;
+	}
+      if (rank_counts[i] >= 3 && trips == -1)
+	{
+	  trips = i;
+	}
+    }
+
+  switch (distinct_count)
+    {
+    default: /* the lowest five distinct ranks */
+      return rank_combination (ranks, 5);
+    case 4: /* the lowest pair with the other ranks as the kickers */
+      if (paired_count == 0)
+	{
+	  break;
+	}
+      for (i = 0, k = 0; i < 4; i++)
+	{
+	  if (ranks[i] != paired[0])
+	    {
+	      kickers[k++] = ranks[i] - (ranks[i] > paired[0]);
+	    }
+	}
+      return (low_category_base[LOW_ONE_PAIR]
+	      + paired[0] * binomial[RANK_COUNT - 1][3]
+	      + rank_combination (kickers, 3));
+    case 3:
+      if (paired_count >= 2) /* the lowest two pairs */
+	{
+	  for (i = 0; i < 3; i++)
+	    {
+	      if (ranks[i] != paired[0] && ranks[i] != paired[1])
+		{
+		  kickers[0] = (ranks[i] - (ranks[i] > paired[0])
+				- (ranks[i] > paired[1]));
+		}
+	    }
+	  return (low_category_base[LOW_TWO_PAIR]
+		  + rank_combination (paired, 2) * (RANK_COUNT - 2)
+		  + kickers[0]);
+	}
+      if (trips == -1)
+	{
+	  break;
+	}
+      for (i = 0, k = 0; i < 3; i++)
+	{
+	  if (ranks[i] != trips)
+	    {
+	      kickers[k++] = ranks[i] - (ranks[i] > trips);
+	    }
+	}
+      return (low_category_base[LOW_TRIPS]
+	      + trips * binomial[RANK_COUNT - 1][2]
+	      + rank_combination (kickers, 2));
+    case 2:
+      if (trips == -1)
+	{
+	  break;
+	}
+      k = (ranks[0] == trips ? ranks[1] : ranks[0]);
+      if (rank_counts[k] >= 2) /* the lowest trips with the other pair */
+	{
+	  return (low_category_base[LOW_FULL_HOUSE]
+		  + trips * (RANK_COUNT - 1) + k - (k > trips));
+	}
+      if (rank_counts[trips] < 4)
+	{
+	  break;
+	}
+      return (low_category_base[LOW_QUADS]
+	      + trips * (RANK_COUNT - 1) + k - (k > trips));
+    case 1:
+    case 0:
+      break;
+    }
+
+  return RAZZ_LOW_INDEX_COUNT;
+}
+
+/**
+ * Determines the Razz rank of the given rank counts in the same way as
+ * get_razz_rank() does for a hand.
+ *
+ * @param [in] rank_counts the number of cards of each rank.
+ *
+ * @return the Razz rank between R5 and K or INVALID_RANK if the rank is
+ *         worse than K.
+ */
+static enum card_rank
+get_razz_rank_of_counts (const uint8_t rank_counts[RANK_COUNT])
+{
+  int distinct_count = 0;
+  int i;
+
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      if (rank_counts[i] != 0 && ++distinct_count == 5)
+	{
+	  return i;
+	}
+    }
+
+  return INVALID_RANK;
+}
+
+unsigned int
+get_razz_low_index (const card_hand *hand)
+{
+  uint8_t rank_counts[RANK_COUNT];
+
+  count_ranks_in_hand (hand, rank_counts);
+
+  return get_razz_low_index_of_counts (rank_counts);
+}
+
+enum razz_low_category
+get_razz_low_ranks (unsigned int low_index, enum card_rank ranks[5])
+{
+  enum razz_low_category cat;
+  uint8_t r[5];
+  unsigned int rest;
+  int hi, lo;
+  int i;
+
+  if (low_index >= RAZZ_LOW_INDEX_COUNT)
+    {
+      return LOW_CATEGORY_COUNT;
+    }
+
+  cat = LOW_NO_PAIR;
+  while (low_index >= low_category_base[cat + 1])
+    {
+      cat++;
+    }
+  rest = low_index - low_category_base[cat];
+
+  switch (cat)
+    {
+    case LOW_NO_PAIR:
+      unrank_combination (rest, 5, r);
+      for (i = 0; i < 5; i++)
+	{
+	  ranks[i] = r[4 - i];
+	}
+      break;
+    case LOW_ONE_PAIR:
+      hi = rest / binomial[RANK_COUNT - 1][3];
+      unrank_combination (rest % binomial[RANK_COUNT - 1][3], 3, r);
+      ranks[0] = ranks[1] = hi;
+      for (i = 0; i < 3; i++)
+	{
+	  ranks[2 + i] = r[2 - i] + (r[2 - i] >= hi);
+	}
+      break;
+    case LOW_TWO_PAIR:
+      unrank_combination (rest / (RANK_COUNT - 2), 2, r);
+      lo = r[0];
+      hi = r[1];
+      ranks[0] = ranks[1] = hi;
+      ranks[2] = ranks[3] = lo;
+      ranks[4] = rest % (RANK_COUNT - 2);
+      ranks[4] += (ranks[4] >= lo);
+      ranks[4] += (ranks[4] >= hi);
+      break;
+    case LOW_TRIPS:
+      hi = rest / binomial[RANK_COUNT - 1][2];
+      unrank_combination (rest % binomial[RANK_COUNT - 1][2], 2, r);
+      ranks[0] = ranks[1] = ranks[2] = hi;
+      for (i = 0; i < 2; i++)
+	{
+	  ranks[3 + i] = r[1 - i] + (r[1 - i] >= hi);
+	}
+      break;
+    case LOW_FULL_HOUSE:
+    case LOW_QUADS:
+      hi = rest / (RANK_COUNT - 1);
+      lo = rest % (RANK_COUNT - 1);
+      lo += (lo >= hi);
+      for (i = 0; i < 5; i++)
+	{
+	  ranks[i] = hi;
+	}
+      ranks[4] = lo;
+      if (cat == LOW_FULL_HOUSE)
+	{
+	  ranks[3] = lo;
+	}
+      break;
+    default:
+      break;
+    }
+
+  return cat;
+}
+
+/**
+ * Takes the lowest card out of a mask of a ::razz_scenario.
+ *
+ * @param [in,out] mask the non-empty mask whose lowest card is taken out.
+ *
+ * @return the ::card_suit_rank of the card.
+ */
+static enum card_suit_rank
+take_lowest_card (uint64_t *mask)
+{
+  enum card_suit_rank csr = __builtin_ctzll (*mask);
+
+  *mask &= *mask - 1;
+
+  return csr;
 }
 
 /**
- * Strips the deck from decided cards. The given decided cards must not contain
- * any duplicate.
+ * Strips the deck from the known cards of a scenario.
  *
  * @param [in] deck the deck to be stripped out.
- * @param [in] decided_cards the non-duplicated cards to be stripped out.
+ * @param [in] scenario the scenario whose known cards are to be stripped out.
  */
 static void
-strip_deck (card_deck *deck, const struct decided_cards *decided_cards)
+strip_deck (card_deck *deck, const struct razz_scenario *scenario)
 {
-  int i, end;
+  uint64_t mask = scenario->known_mask;
 
-  end = decided_cards->my_card_count;
-  for (i = 0; i < end; i++)
+  while (mask != 0)
     {
-      strip_card_from_deck (get_card_suit_rank (decided_cards->my_cards[i]),
-			    deck);
+      strip_card_from_deck (take_lowest_card (&mask), deck);
     }
+}
 
-  end = decided_cards->opponent_card_count;
-  for (i = 0; i < end; i++)
+/**
+ * Strips a rank deck from the known cards of a scenario and counts the ranks
+ * of my cards.
+ *
+ * @param [out] deck the rank deck to be prepared.
+ * @param [out] my_rank_counts the rank counts of my cards.
+ * @param [in] scenario the scenario to be dealt.
+ */
+static void
+prepare_rank_template (struct rank_deck *deck,
+		       uint8_t my_rank_counts[RANK_COUNT],
+		       const struct razz_scenario *scenario)
+{
+  uint64_t mask = scenario->known_mask;
+
+  init_rank_deck (deck);
+  memset (my_rank_counts, 0, RANK_COUNT);
+  while (mask != 0)
     {
-      strip_card_from_deck (get_card_suit_rank (decided_cards->opponent_cards[i]),
-			    deck);
+      enum card_suit_rank csr = take_lowest_card (&mask);
+      enum card_rank cr = csr % RANK_COUNT;
+
+      strip_rank_from_rank_deck (cr, deck);
+      if (scenario->my_mask & RAZZ_CARD_BIT (csr))
+	{
+	  my_rank_counts[cr]++;
+	}
     }
 }
 
+/**
+ * Counts the cards of a mask of a ::razz_scenario.
+ *
+ * @param [in] mask the mask whose cards are counted.
+ *
+ * @return the number of cards.
+ */
+static int
+count_cards_in_mask (uint64_t mask)
+{
+  return __builtin_popcountll (mask);
+}
+
 int
-simulate_razz_game (const struct decided_cards *decided_cards,
-		    unsigned long game_count,
-		    void *arg,
-		    rank_listener listener)
+is_valid_razz_scenario (const struct razz_scenario *scenario)
 {
-  unsigned long i;
-  card_hand *my_hand;
-  card_deck *deck;
+  int my_card_count = count_cards_in_mask (scenario->my_mask);
 
-  my_hand = create_hand (RAZZ_CARD_IN_HAND_COUNT, sort_card_by_rank);
-  if (my_hand == NULL)
+  return ((scenario->my_mask & ~scenario->known_mask) == 0
+	  && (scenario->known_mask >> CARD_COUNT) == 0
+	  && my_card_count <= RAZZ_CARD_IN_HAND_COUNT
+	  && (CARD_COUNT - count_cards_in_mask (scenario->known_mask)
+	      >= RAZZ_CARD_IN_HAND_COUNT - my_card_count));
+}
+
+int
+pack_decided_cards (const struct decided_cards *decided_cards,
+		    struct razz_scenario *scenario)
+{
+  uint64_t bit;
+  int i;
+
+  scenario->known_mask = 0;
+  scenario->my_mask = 0;
+
+  for (i = 0; i < decided_cards->my_card_count; i++)
     {
-      fprintf (stderr, "Cannot create a hand\n");
-      return 1;
+      bit = RAZZ_CARD_BIT (get_card_suit_rank (decided_cards->my_cards[i]));
+      if (scenario->known_mask & bit)
+	{
+	  return 1;
+	}
+      scenario->known_mask |= bit;
+      scenario->my_mask |= bit;
     }
 
-  for (i = 0; i < game_count; i++)
+  for (i = 0; i < decided_cards->opponent_card_count; i++)
     {
-      deck = create_shuffled_deck ();
-      if (deck == NULL)
+      bit = get_card_suit_rank (decided_cards->opponent_cards[i]);
+      bit = RAZZ_CARD_BIT (bit);
+      if (scenario->known_mask & bit)
 	{
-	  fprintf (stderr, "Cannot create a shuffled deck\n");
-	  destroy_deck (&deck);
 	  return 1;
 	}
-      strip_deck (deck, decided_cards);
+      scenario->known_mask |= bit;
+    }
 
-      complete_hand (my_hand, decided_cards, deck);
-      listener (arg, get_razz_rank (my_hand));
+  return 0;
+}
 
-      reset_hand (my_hand);
-      destroy_deck (&deck);
+int
+unpack_razz_scenario (const struct razz_scenario *scenario,
+		      struct decided_cards *decided_cards)
+{
+  uint64_t mask = scenario->known_mask;
+
+  decided_cards->my_card_count = 0;
+  decided_cards->opponent_card_count = 0;
+
+  if (!is_valid_razz_scenario (scenario)
+      || (count_cards_in_mask (scenario->my_mask)
+	  > sizeof (decided_cards->my_cards) / sizeof (const card *))
+      || (count_cards_in_mask (scenario->known_mask & ~scenario->my_mask)
+	  > sizeof (decided_cards->opponent_cards) / sizeof (const card *)))
+    {
+      return 1;
     }
 
-  destroy_hand (&my_hand);
-  destroy_deck (&deck);
+  while (mask != 0)
+    {
+      enum card_suit_rank csr = take_lowest_card (&mask);
+      const card *c = create_card (csr);
+
+      if (c == NULL)
+	{
+	  release_decided_cards (decided_cards);
+	  return 1;
+	}
+
+      if (scenario->my_mask & RAZZ_CARD_BIT (csr))
+	{
+	  decided_cards->my_cards[decided_cards->my_card_count++] = c;
+	}
+      else
+	{
+	  decided_cards->opponent_cards[decided_cards->opponent_card_count++]
+	    = c;
+	}
+    }
 
   return 0;
 }
+
+void
+release_decided_cards (struct decided_cards *decided_cards)
+{
+  int i;
+
+  for (i = 0; i < decided_cards->my_card_count; i++)
+    {
+      destroy_card (&decided_cards->my_cards[i]);
+    }
+  for (i = 0; i < decided_cards->opponent_card_count; i++)
+    {
+      destroy_card (&decided_cards->opponent_cards[i]);
+    }
+  decided_cards->my_card_count = 0;
+  decided_cards->opponent_card_count = 0;
+}
+
+/**
+ * Determines the Razz rank of a Razz low index, which is the highest rank of
+ * an unpaired low.
+ *
+ * @param [in] low_index the Razz low index.
+ *
+ * @return the Razz rank between R5 and K or INVALID_RANK for a paired low.
+ */
+static enum card_rank
+get_razz_rank_of_low_index (unsigned int low_index)
+{
+  int r = R5;
+
+  if (low_index >= low_category_base[LOW_ONE_PAIR])
+    {
+      return INVALID_RANK;
+    }
+
+  while (binomial[r + 1][5] <= low_index)
+    {
+      r++;
+    }
+
+  return r;
+}
+
+void
+clear_razz_result (struct razz_result *result)
+{
+  memset (result, 0, sizeof (*result));
+}
+
+void
+merge_razz_result (struct razz_result *dst, const struct razz_result *src)
+{
+  int i;
+
+  dst->game_count += src->game_count;
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      dst->rank_counts[i] += src->rank_counts[i];
+    }
+  dst->invalid_rank_count += src->invalid_rank_count;
+  for (i = 0; i < RAZZ_LOW_INDEX_COUNT; i++)
+    {
+      dst->low_counts[i] += src->low_counts[i];
+    }
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      dst->high_counts[i] += src->high_counts[i];
+    }
+  dst->qualified_low_count += src->qualified_low_count;
+}
+
+/**
+ * Records the Razz low of a game in a result.
+ *
+ * @param [in,out] result the result to record the low in.
+ * @param [in] low_index the Razz low index of my complete hand.
+ */
+static void
+record_low_index (struct razz_result *result, unsigned int low_index)
+{
+  enum card_rank r = get_razz_rank_of_low_index (low_index);
+
+  result->low_counts[low_index]++;
+  if (r == INVALID_RANK)
+    {
+      result->invalid_rank_count++;
+    }
+  else
+    {
+      result->rank_counts[r]++;
+    }
+}
+
+/**
+ * Records the outcome of a game in a result.
+ *
+ * @param [in,out] result the result to record the outcome in.
+ * @param [in] rank_counts the rank counts of my complete hand.
+ */
+static void
+record_outcome (struct razz_result *result,
+		const uint8_t rank_counts[RANK_COUNT])
+{
+  record_low_index (result, get_razz_low_index_of_counts (rank_counts));
+}
+
+/**
+ * Checks whether the ranks of a mask make a straight. The ace is bit ::ACE
+ * and also plays above the king.
+ *
+ * @param [in] rank_mask the ranks with bit ::card_rank set for every rank.
+ *
+ * @return non-zero if five of the ranks are consecutive.
+ */
+static inline int
+is_straight (unsigned int rank_mask)
+{
+  unsigned int m = rank_mask | ((rank_mask & (1 << ACE)) << RANK_COUNT);
+
+  return (m & (m >> 1) & (m >> 2) & (m >> 3) & (m >> 4)) != 0;
+}
+
+enum stud_high_category
+get_stud_high_category (const uint8_t rank_counts[RANK_COUNT],
+			const uint16_t suit_masks[SUIT_COUNT])
+{
+  int i;
+  int pair_count = 0;
+  int trips_count = 0;
+  int is_flush = 0;
+  unsigned int rank_mask = 0;
+
+  for (i = 0; i < SUIT_COUNT; i++)
+    {
+      if (__builtin_popcount (suit_masks[i]) >= 5)
+	{
+	  if (is_straight (suit_masks[i]))
+	    {
+	      return HIGH_STRAIGHT_FLUSH;
+	    }
+	  is_flush = 1;
+	}
+    }
+
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      switch (rank_counts[i])
+	{
+	case 0:
+	  continue;
+	case 1:
+	  break;
+	case 2:
+	  pair_count++;
+	  break;
+	case 3:
+	  trips_count++;
+	  break;
+	default:
+	  return HIGH_QUADS;
+	}
+      rank_mask |= 1 << i;
+    }
+
+  if (trips_count >= 2 || (trips_count == 1 && pair_count >= 1))
+    {
+      return HIGH_FULL_HOUSE;
+    }
+  if (is_flush)
+    {
+      return HIGH_FLUSH;
+    }
+  if (is_straight (rank_mask))
+    {
+      return HIGH_STRAIGHT;
+    }
+  if (trips_count == 1)
+    {
+      return HIGH_TRIPS;
+    }
+  if (pair_count >= 2)
+    {
+      return HIGH_TWO_PAIR;
+    }
+
+  return pair_count == 1 ? HIGH_ONE_PAIR : HIGH_NO_PAIR;
+}
+
+/**
+ * Records the outcome of a Razz game. The signature is that of every
+ * recorder used by DEFINE_STUD_RUNNER() and by the sweep.
+ *
+ * @param [in,out] result the result to record the outcome in.
+ * @param [in] rank_counts the rank counts of my complete hand.
+ * @param [in] suit_masks the ranks of my complete hand by suit, which are
+ *                        unused.
+ */
+static inline void
+record_razz_outcome (struct razz_result *result,
+		     const uint8_t rank_counts[RANK_COUNT],
+		     const uint16_t suit_masks[SUIT_COUNT])
+{
+  record_outcome (result, rank_counts);
+}
+
+/**
+ * Records the outcome of a seven-card stud high game.
+ */
+static inline void
+record_stud_high_outcome (struct razz_result *result,
+			  const uint8_t rank_counts[RANK_COUNT],
+			  const uint16_t suit_masks[SUIT_COUNT])
+{
+  result->high_counts[get_stud_high_category (rank_counts, suit_masks)]++;
+}
+
+/**
+ * Records the outcome of a seven-card stud high-low eight-or-better game. The
+ * low qualifies if it is unpaired with no rank above eight, which are exactly
+ * the Razz low indices below those of the nine lows.
+ */
+static inline void
+record_stud_hilo8_outcome (struct razz_result *result,
+			   const uint8_t rank_counts[RANK_COUNT],
+			   const uint16_t suit_masks[SUIT_COUNT])
+{
+  unsigned int low_index = get_razz_low_index_of_counts (rank_counts);
+  enum card_rank r = get_razz_rank_of_low_index (low_index);
+
+  result->low_counts[low_index]++;
+  if (r == INVALID_RANK)
+    {
+      result->invalid_rank_count++;
+    }
+  else
+    {
+      result->rank_counts[r]++;
+      if (r <= R8)
+	{
+	  result->qualified_low_count++;
+	}
+    }
+  result->high_counts[get_stud_high_category (rank_counts, suit_masks)]++;
+}
+
+/**
+ * Makes room in the batch of a scratch for the games that a plan deals at
+ * once. The batch keeps its arrays if they cannot be enlarged.
+ *
+ * @param [in,out] b the batch.
+ * @param [in] capacity the number of games each array should hold.
+ *
+ * @return 0 if the arrays hold the games or non-zero otherwise.
+ */
+static int
+reserve_razz_batch (struct razz_batch *b, unsigned int capacity)
+{
+  size_t game_size = (RAZZ_CARD_IN_HAND_COUNT * sizeof (**b->dealt)
+		      + sizeof (*b->rank_masks) + sizeof (*b->low_indices)
+		      + sizeof (*b->ranks));
+  uint16_t *arrays;
+  int j;
+
+  if (capacity <= b->capacity)
+    {
+      return 0;
+    }
+
+  /* The 16-bit arrays go first to stay aligned */
+  arrays = malloc (capacity * game_size);
+  if (arrays == NULL)
+    {
+      return 1;
+    }
+  free (b->rank_masks);
+  b->capacity = capacity;
+  b->rank_masks = arrays;
+  b->low_indices = arrays + capacity;
+  b->ranks = (uint8_t *) (arrays + 2 * capacity);
+  for (j = 0; j < RAZZ_CARD_IN_HAND_COUNT; j++)
+    {
+      b->dealt[j] = b->ranks + (j + 1) * capacity;
+    }
+
+  return 0;
+}
+
+/**
+ * Returns the number of games of a plan to deal at once with a scratch.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in,out] scratch the per-thread state whose batch may be enlarged.
+ *
+ * @return the number of games, which is at least one.
+ */
+static unsigned int
+get_razz_batch_size (const struct razz_plan *plan,
+		     struct razz_scratch *scratch)
+{
+  unsigned int batch_size = plan->options.batch_size;
+
+  if (batch_size == 0)
+    {
+      batch_size = DEFAULT_GAME_BATCH_SIZE;
+    }
+  if (reserve_razz_batch (&scratch->batch, batch_size))
+    {
+      batch_size = scratch->batch.capacity;
+    }
+
+  return batch_size;
+}
+
+/**
+ * Deals the missing cards of a batch of games from the suited deck of a plan
+ * into the card columns of the batch of a scratch. The random draws are the
+ * same as those of dealing and evaluating one game at a time.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in,out] scratch the per-thread state of the running thread.
+ * @param [in] game_count the number of games of the batch.
+ * @param [in] uses_suits non-zero to store the ::card_suit_rank of every card
+ *                        instead of its ::card_rank.
+ */
+static inline void
+deal_suited_batch (const struct razz_plan *plan, struct razz_scratch *scratch,
+		   unsigned int game_count, int uses_suits)
+{
+  struct razz_batch *b = &scratch->batch;
+  unsigned int i;
+  int j;
+  int missing_count = plan->missing_count;
+  uint64_t key = plan->options.counter_key;
+  rng *r = key == 0 ? scratch->rng : scratch->counter_rng;
+
+  for (i = 0; i < game_count; i++)
+    {
+      const card *dealt_cards[RAZZ_CARD_IN_HAND_COUNT];
+
+      reset_deck_from (scratch->deck, plan->template_deck);
+      set_deck_rng (scratch->deck, r);
+      if (key != 0)
+	{
+	  rng_seek (r, key, scratch->next_game++);
+	}
+
+      if (plan->options.deal_mode == DEAL_COMBINATION)
+	{
+	  deal_combination_from_deck (scratch->deck, missing_count,
+				      dealt_cards);
+	}
+      else
+	{
+	  for (j = 0; j < missing_count; j++)
+	    {
+	      dealt_cards[j] = deal_from_deck (scratch->deck);
+	    }
+	}
+
+      for (j = 0; j < missing_count; j++)
+	{
+	  b->dealt[j][i] = (uses_suits
+			    ? get_card_suit_rank (dealt_cards[j])
+			    : get_card_rank (dealt_cards[j]));
+	}
+    }
+}
+
+/**
+ * Deals the missing ranks of a batch of games from the rank deck of a plan
+ * into the card columns of the batch of a scratch.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in,out] scratch the per-thread state of the running thread.
+ * @param [in] game_count the number of games of the batch.
+ */
+static void
+deal_rank_batch (const struct razz_plan *plan, struct razz_scratch *scratch,
+		 unsigned int game_count)
+{
+  struct razz_batch *b = &scratch->batch;
+  unsigned int i;
+  int j;
+  int missing_count = plan->missing_count;
+  uint64_t key = plan->options.counter_key;
+  rng *r = key == 0 ? scratch->rng : scratch->counter_rng;
+
+  for (i = 0; i < game_count; i++)
+    {
+      struct rank_deck deck = plan->rank_template;
+
+      if (key != 0)
+	{
+	  rng_seek (r, key, scratch->next_game++);
+	}
+      for (j = 0; j < missing_count; j++)
+	{
+	  b->dealt[j][i] = deal_rank_from_rank_deck (&deck, r);
+	}
+    }
+}
+
+/**
+ * Evaluates the Razz low of every game of a batch whose card columns hold
+ * ranks. The distinct ranks of all games are gathered column by column first,
+ * which the compiler can vectorize. An unpaired low, which most games have,
+ * is then indexed from the five lowest of them, leaving only the paired lows
+ * to the full evaluation from the rank counts.
+ *
+ * @param [in] plan the plan being run.
+ * @param [in,out] b the batch.
+ * @param [in] game_count the number of games of the batch.
+ */
+static void
+evaluate_razz_batch (const struct razz_plan *plan, struct razz_batch *b,
+		     unsigned int game_count)
+{
+  uint16_t *restrict rank_masks = b->rank_masks;
+  unsigned int i;
+  int j;
+  int missing_count = plan->missing_count;
+
+  for (i = 0; i < game_count; i++)
+    {
+      rank_masks[i] = plan->my_rank_mask;
+    }
+  for (j = 0; j < missing_count; j++)
+    {
+      const uint8_t *restrict column = b->dealt[j];
+
+      for (i = 0; i < game_count; i++)
+	{
+	  rank_masks[i] |= 1 << column[i];
+	}
+    }
+
+  for (i = 0; i < game_count; i++)
+    {
+      unsigned int mask = rank_masks[i];
+
+      if (__builtin_popcount (mask) >= 5)
+	{
+	  unsigned int low_index = 0;
+	  int k;
+	  int r = 0;
+
+	  for (k = 1; k <= 5; k++)
+	    {
+	      r = __builtin_ctz (mask);
+	      low_index += binomial[r][k];
+	      mask &= mask - 1;
+	    }
+	  b->low_indices[i] = low_index;
+	  b->ranks[i] = r;
+	}
+      else
+	{
+	  uint8_t rank_counts[RANK_COUNT];
+
+	  memcpy (rank_counts, plan->my_rank_counts, sizeof (rank_counts));
+	  for (j = 0; j < missing_count; j++)
+	    {
+	      rank_counts[b->dealt[j][i]]++;
+	    }
+	  b->low_indices[i] = get_razz_low_index_of_counts (rank_counts);
+	  b->ranks[i] = RANK_COUNT;
+	}
+    }
+}
+
+/**
+ * Adds the evaluated outcomes of a batch to a result.
+ *
+ * @param [in] b the batch.
+ * @param [in] game_count the number of games of the batch.
+ * @param [in,out] result the result to which the outcomes are added.
+ */
+static void
+accumulate_razz_batch (const struct razz_batch *b, unsigned int game_count,
+		       struct razz_result *result)
+{
+  unsigned long rank_counts[RANK_COUNT + 1] = {0};
+  unsigned int i;
+  int r;
+
+  for (i = 0; i < game_count; i++)
+    {
+      result->low_counts[b->low_indices[i]]++;
+    }
+  for (i = 0; i < game_count; i++)
+    {
+      rank_counts[b->ranks[i]]++;
+    }
+
+  for (r = 0; r < RANK_COUNT; r++)
+    {
+      result->rank_counts[r] += rank_counts[r];
+    }
+  result->invalid_rank_count += rank_counts[RANK_COUNT];
+}
+
+/**
+ * Runs the Razz games of a plan dealing ranks from the rank deck of the plan,
+ * which only Razz can do.
+ *
+ * @param [in] plan the plan to be run.
+ * @param [in] scratch the per-thread state of the running thread.
+ * @param [in] game_count the number of games to run.
+ * @param [in,out] result the result to which the outcomes are added.
+ */
+static void
+run_razz_rank_games (const struct razz_plan *plan,
+		     struct razz_scratch *scratch,
+		     unsigned long game_count, struct razz_result *result)
+{
+  unsigned int batch_size = get_razz_batch_size (plan, scratch);
+
+  while (game_count != 0)
+    {
+      unsigned int n = game_count < batch_size ? game_count : batch_size;
+
+      deal_rank_batch (plan, scratch, n);
+      evaluate_razz_batch (plan, &scratch->batch, n);
+      accumulate_razz_batch (&scratch->batch, n, result);
+      game_count -= n;
+    }
+}
+
+/**
+ * Runs the Razz games of a plan dealing from the suited deck of the plan.
+ * The parameters are the same as those of run_razz_rank_games().
+ */
+static void
+run_razz_suited_games (const struct razz_plan *plan,
+		       struct razz_scratch *scratch,
+		       unsigned long game_count, struct razz_result *result)
+{
+  unsigned int batch_size = get_razz_batch_size (plan, scratch);
+
+  while (game_count != 0)
+    {
+      unsigned int n = game_count < batch_size ? game_count : batch_size;
+
+      deal_suited_batch (plan, scratch, n, 0);
+      evaluate_razz_batch (plan, &scratch->batch, n);
+      accumulate_razz_batch (&scratch->batch, n, result);
+      game_count -= n;
+    }
+}
+
+/**
+ * Defines a ::plan_runner of a stud variant dealing a batch of games from the
+ * suited deck of the plan before evaluating them with the inlined outcome
+ * recorder.
+ *
+ * @param name the name of the runner.
+ * @param RECORD the recorder of the outcome of each game.
+ */
+#define DEFINE_STUD_RUNNER(name, RECORD)				\
+  static void								\
+  name (const struct razz_plan *plan, struct razz_scratch *scratch,	\
+	unsigned long game_count, struct razz_result *result)		\
+  {									\
+    unsigned int batch_size = get_razz_batch_size (plan, scratch);	\
+    const struct razz_batch *b = &scratch->batch;			\
+    int missing_count = plan->missing_count;				\
+    uint8_t rank_counts[RANK_COUNT];					\
+    uint16_t suit_masks[SUIT_COUNT];					\
+									\
+    while (game_count != 0)						\
+      {									\
+	unsigned int n = (game_count < batch_size			\
+			  ? game_count : batch_size);			\
+	unsigned int i;							\
+	int j;								\
+									\
+	deal_suited_batch (plan, scratch, n, 1);			\
+	for (i = 0; i < n; i++)						\
+	  {								\
+	    memcpy (rank_counts, plan->my_rank_counts,			\
+		    sizeof (rank_counts));				\
+	    memcpy (suit_masks, plan->my_suit_masks,			\
+		    sizeof (suit_masks));				\
+	    for (j = 0; j < missing_count; j++)				\
+	      {								\
+		unsigned int csr = b->dealt[j][i];			\
+		unsigned int cr = csr % RANK_COUNT;			\
+									\
+		rank_counts[cr]++;					\
+		suit_masks[csr / RANK_COUNT] |= 1 << cr;		\
+	      }								\
+									\
+	    RECORD (result, rank_counts, suit_masks);			\
+	  }								\
+	game_count -= n;						\
+      }									\
+  }
+
+DEFINE_STUD_RUNNER (run_stud_high_games, record_stud_high_outcome)
+DEFINE_STUD_RUNNER (run_stud_hilo8_games, record_stud_hilo8_outcome)
+
+int
+prepare_razz_plan (struct razz_plan *plan,
+		   const struct razz_scenario *scenario,
+		   const struct simulation_options *options)
+{
+  uint64_t mask;
+
+  if (!is_valid_razz_scenario (scenario))
+    {
+      return 1;
+    }
+
+  if (options == NULL)
+    {
+      init_simulation_options (&plan->options);
+    }
+  else
+    {
+      plan->options = *options;
+    }
+
+  switch (plan->options.variant)
+    {
+    case GAME_RAZZ:
+      plan->run_games = (plan->options.deck_kind == RANK_DECK
+			 ? run_razz_rank_games : run_razz_suited_games);
+      break;
+    case GAME_STUD_HIGH:
+      plan->run_games = run_stud_high_games;
+      break;
+    case GAME_STUD_HILO8:
+      plan->run_games = run_stud_hilo8_games;
+      break;
+    default:
+      return 1;
+    }
+  if (plan->options.variant != GAME_RAZZ
+      && plan->options.deck_kind == RANK_DECK)
+    {
+      return 1;
+    }
+
+  plan->template_deck = create_shuffled_deck ();
+  if (plan->template_deck == NULL)
+    {
+      return 1;
+    }
+  strip_deck (plan->template_deck, scenario);
+
+  prepare_rank_template (&plan->rank_template, plan->my_rank_counts,
+			 scenario);
+  memset (plan->my_suit_masks, 0, sizeof (plan->my_suit_masks));
+  plan->my_rank_mask = 0;
+  mask = scenario->my_mask;
+  while (mask != 0)
+    {
+      enum card_suit_rank csr = take_lowest_card (&mask);
+
+      plan->my_suit_masks[csr / RANK_COUNT] |= 1 << (csr % RANK_COUNT);
+      plan->my_rank_mask |= 1 << (csr % RANK_COUNT);
+    }
+  plan->missing_count = (RAZZ_CARD_IN_HAND_COUNT
+			 - count_cards_in_mask (scenario->my_mask));
+
+  return 0;
+}
+
+void
+release_razz_plan (struct razz_plan *plan)
+{
+  destroy_deck (&plan->template_deck);
+}
+
+int
+init_razz_scratch (struct razz_scratch *scratch, uint64_t seed)
+{
+  scratch->rng = create_rng (seed);
+  if (scratch->rng == NULL)
+    {
+      return 1;
+    }
+
+  scratch->counter_rng = create_counter_rng (seed);
+  if (scratch->counter_rng == NULL)
+    {
+      destroy_rng (&scratch->rng);
+      return 1;
+    }
+  scratch->next_game = 0;
+
+  scratch->deck = create_shuffled_deck ();
+  if (scratch->deck == NULL)
+    {
+      destroy_rng (&scratch->counter_rng);
+      destroy_rng (&scratch->rng);
+      return 1;
+    }
+
+  memset (&scratch->batch, 0, sizeof (scratch->batch));
+  if (reserve_razz_batch (&scratch->batch, DEFAULT_GAME_BATCH_SIZE))
+    {
+      destroy_deck (&scratch->deck);
+      destroy_rng (&scratch->counter_rng);
+      destroy_rng (&scratch->rng);
+      return 1;
+    }
+
+  return 0;
+}
+
+void
+release_razz_scratch (struct razz_scratch *scratch)
+{
+  free (scratch->batch.rank_masks);
+  destroy_deck (&scratch->deck);
+  destroy_rng (&scratch->counter_rng);
+  destroy_rng (&scratch->rng);
+}
+
+void
+run_razz_plan (const struct razz_plan *plan, struct razz_scratch *scratch,
+	       unsigned long game_count, struct razz_result *result)
+{
+  result->game_count += game_count;
+  plan->run_games (plan, scratch, game_count, result);
+}
+
+/**
+ * Computes the number of seconds between two points in time.
+ *
+ * @param [in] from the earlier point in time.
+ * @param [in] to the later point in time.
+ *
+ * @return the number of seconds.
+ */
+static double
+seconds_between (const struct timespec *from, const struct timespec *to)
+{
+  return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) / 1e9;
+}
+
+void
+start_progress (struct progress_tracker *t,
+		const struct simulation_options *options,
+		unsigned long total_game_count)
+{
+  t->options = options;
+  t->total_game_count = total_game_count;
+  clock_gettime (CLOCK_MONOTONIC, &t->start);
+  t->last_report = t->start;
+  t->last_report_game_count = 0;
+
+  t->check_period = PROGRESS_CHECK_PERIOD;
+  if (options->progress_interval_games != 0
+      && options->progress_interval_games < t->check_period)
+    {
+      t->check_period = options->progress_interval_games;
+    }
+}
+
+int
+is_progress_due (const struct progress_tracker *t, unsigned long game_count,
+		 int is_final)
+{
+  const struct simulation_options *o = t->options;
+  struct timespec now;
+
+  if (o->progress_listener == NULL)
+    {
+      return 0;
+    }
+
+  if (is_final)
+    {
+      return 1;
+    }
+
+  if (o->progress_interval_games != 0
+      && game_count - t->last_report_game_count >= o->progress_interval_games)
+    {
+      return 1;
+    }
+
+  if (o->progress_interval_ms != 0)
+    {
+      clock_gettime (CLOCK_MONOTONIC, &now);
+      if (seconds_between (&t->last_report, &now) * 1000
+	  >= o->progress_interval_ms)
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+void
+report_progress (struct progress_tracker *t, unsigned long game_count,
+		 const struct razz_result *partial)
+{
+  struct razz_progress progress;
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  progress.game_count = game_count;
+  progress.total_game_count = t->total_game_count;
+  progress.elapsed_seconds = seconds_between (&t->start, &now);
+  progress.games_per_second = (progress.elapsed_seconds > 0
+			       ? game_count / progress.elapsed_seconds : 0);
+  progress.partial = partial;
+
+  t->last_report = now;
+  t->last_report_game_count = game_count;
+
+  t->options->progress_listener (t->options->progress_arg, &progress);
+}
+
+void
+poll_progress (struct progress_tracker *t, unsigned long game_count,
+	       const struct razz_result *partial, int is_final)
+{
+  if (is_progress_due (t, game_count, is_final))
+    {
+      report_progress (t, game_count, partial);
+    }
+}
+
+int
+is_cancelled (const struct simulation_options *options)
+{
+  return options->cancel_flag != NULL && *options->cancel_flag;
+}
+
+void
+init_simulation_options (struct simulation_options *options)
+{
+  options->deal_mode = DEAL_COMBINATION;
+  options->deck_kind = SUITED_DECK;
+  options->variant = GAME_RAZZ;
+  options->progress_listener = NULL;
+  options->progress_arg = NULL;
+  options->progress_interval_games = 0;
+  options->progress_interval_ms = 0;
+  options->cancel_flag = NULL;
+  options->perf_counts = NULL;
+  options->tracer = NULL;
+  options->counter_key = 0;
+  options->first_game_index = 0;
+  options->batch_size = 0;
+}
+
+/**
+ * Runs Razz games dealing the missing cards from a deck of suited cards.
+ *
+ * @param [in] scenario the valid scenario whose cards will not be included in
+ *                      the simulated dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] options the options of the simulation.
+ * @param [in] r the generator to deal with.
+ * @param [in] arg your marshalled argument into the listeners.
+ * @param [in] r_listener the listener of the Razz rank or NULL.
+ * @param [in] l_listener the listener of the Razz low index or NULL.
+ * @param [in,out] partial the cleared result that counts the outcomes for the
+ *                         progress listener or NULL.
+ * @param [out] played_count the number of games actually simulated.
+ *
+ * @return 0 if the simulation encounters no error or non-zero if it encounters
+ *         one.
+ */
+static int
+run_suited_games (const struct razz_scenario *scenario,
+		  unsigned long game_count,
+		  const struct simulation_options *options,
+		  rng *r,
+		  void *arg,
+		  rank_listener r_listener,
+		  low_listener l_listener,
+		  struct razz_result *partial,
+		  unsigned long *played_count)
+{
+  unsigned long i;
+  unsigned long since_check = 0;
+  int rc = 0;
+  int j;
+  int my_card_count = 0;
+  uint64_t mask = scenario->my_mask;
+  struct progress_tracker tracker;
+  card_hand *my_hand;
+  card_deck *template_deck;
+  card_deck *deck;
+  const card *my_cards[RAZZ_CARD_IN_HAND_COUNT];
+
+  while (mask != 0)
+    {
+      my_cards[my_card_count] = create_card (take_lowest_card (&mask));
+      if (my_cards[my_card_count] == NULL)
+	{
+	  fprintf (stderr, "Cannot create my card #%d\n", my_card_count + 1);
+	  rc = 1;
+	  break;
+	}
+      my_card_count++;
+    }
+
+  deck = NULL;
+  template_deck = NULL;
+  my_hand = create_hand (RAZZ_CARD_IN_HAND_COUNT, sort_card_by_rank);
+  if (rc == 0 && my_hand == NULL)
+    {
+      fprintf (stderr, "Cannot create a hand\n");
+      rc = 1;
+    }
+
+  if (rc == 0)
+    {
+      template_deck = create_shuffled_deck ();
+      if (template_deck == NULL)
+	{
+	  fprintf (stderr, "Cannot create a shuffled deck\n");
+	  rc = 1;
+	}
+    }
+
+  if (rc == 0)
+    {
+      strip_deck (template_deck, scenario);
+      set_deck_rng (template_deck, r);
+
+      deck = copy_deck (template_deck);
+      if (deck == NULL)
+	{
+	  fprintf (stderr, "Cannot create a working deck\n");
+	  rc = 1;
+	}
+    }
+
+  if (rc == 0)
+    {
+      start_progress (&tracker, options, game_count);
+      for (i = 0; i < game_count; i++)
+	{
+	  reset_deck_from (deck, template_deck);
+	  if (options->counter_key != 0)
+	    {
+	      rng_seek (r, options->counter_key,
+			options->first_game_index + i);
+	    }
+
+	  complete_hand (my_hand, my_cards, my_card_count, deck,
+			 options->deal_mode);
+	  if (l_listener != NULL)
+	    {
+	      l_listener (arg, get_razz_low_index (my_hand));
+	    }
+	  if (r_listener != NULL)
+	    {
+	      r_listener (arg, get_razz_rank (my_hand));
+	    }
+	  if (partial != NULL)
+	    {
+	      record_low_index (partial, get_razz_low_index (my_hand));
+	      partial->game_count++;
+	    }
+
+	  reset_hand (my_hand);
+
+	  if (++since_check == tracker.check_period)
+	    {
+	      since_check = 0;
+	      if (is_cancelled (options))
+		{
+		  i++;
+		  rc = RAZZ_CANCELLED;
+		  break;
+		}
+	      poll_progress (&tracker, i + 1, partial, 0);
+	    }
+	}
+      poll_progress (&tracker, i, partial, 1);
+      *played_count = i;
+    }
+
+  destroy_deck (&deck);
+  destroy_deck (&template_deck);
+  destroy_hand (&my_hand);
+  for (j = 0; j < my_card_count; j++)
+    {
+      destroy_card (&my_cards[j]);
+    }
+
+  return rc;
+}
+
+/**
+ * Runs Razz games dealing the missing ranks from a deck of rank counters.
+ * The parameters are the same as those of run_suited_games().
+ *
+ * @return 0 if the simulation encounters no error or non-zero if it encounters
+ *         one.
+ */
+static int
+run_rank_games (const struct razz_scenario *scenario,
+		unsigned long game_count,
+		const struct simulation_options *options,
+		rng *r,
+		void *arg,
+		rank_listener r_listener,
+		low_listener l_listener,
+		struct razz_result *partial,
+		unsigned long *played_count)
+{
+  unsigned long i;
+  unsigned long since_check = 0;
+  int rc = 0;
+  int j;
+  int missing_count;
+  struct progress_tracker tracker;
+  struct rank_deck template_deck;
+  uint8_t template_counts[RANK_COUNT];
+
+  prepare_rank_template (&template_deck, template_counts, scenario);
+  missing_count = (RAZZ_CARD_IN_HAND_COUNT
+		   - count_cards_in_mask (scenario->my_mask));
+
+  start_progress (&tracker, options, game_count);
+  for (i = 0; i < game_count; i++)
+    {
+      struct rank_deck deck = template_deck;
+      uint8_t rank_counts[RANK_COUNT];
+
+      if (options->counter_key != 0)
+	{
+	  rng_seek (r, options->counter_key, options->first_game_index + i);
+	}
+      memcpy (rank_counts, template_counts, sizeof (rank_counts));
+      for (j = 0; j < missing_count; j++)
+	{
+	  rank_counts[deal_rank_from_rank_deck (&deck, r)]++;
+	}
+
+      if (l_listener != NULL)
+	{
+	  l_listener (arg, get_razz_low_index_of_counts (rank_counts));
+	}
+      if (r_listener != NULL)
+	{
+	  r_listener (arg, get_razz_rank_of_counts (rank_counts));
+	}
+      if (partial != NULL)
+	{
+	  record_outcome (partial, rank_counts);
+	  partial->game_count++;
+	}
+
+      if (++since_check == tracker.check_period)
+	{
+	  since_check = 0;
+	  if (is_cancelled (options))
+	    {
+	      i++;
+	      rc = RAZZ_CANCELLED;
+	      break;
+	    }
+	  poll_progress (&tracker, i + 1, partial, 0);
+	}
+    }
+  poll_progress (&tracker, i, partial, 1);
+  *played_count = i;
+
+  return rc;
+}
+
+int
+simulate_razz_game_with_options (const struct decided_cards *decided_cards,
+				 unsigned long game_count,
+				 const struct simulation_options *options,
+				 void *arg,
+				 rank_listener r_listener,
+				 low_listener l_listener)
+{
+  struct razz_scenario scenario;
+
+  if (pack_decided_cards (decided_cards, &scenario))
+    {
+      fprintf (stderr, "Duplicated decided cards\n");
+      return 1;
+    }
+
+  return simulate_razz_scenario (&scenario, game_count, options, arg,
+				 r_listener, l_listener);
+}
+
+int
+simulate_razz_scenario (const struct razz_scenario *scenario,
+			unsigned long game_count,
+			const struct simulation_options *options,
+			void *arg,
+			rank_listener r_listener,
+			low_listener l_listener)
+{
+  int rc;
+  struct simulation_options default_options;
+  struct perf_group perf;
+  uint64_t before[PERF_EVENT_KIND_COUNT];
+  uint64_t after[PERF_EVENT_KIND_COUNT];
+  int is_counted = 0;
+  unsigned long played_count = 0;
+  uint64_t start_ns;
+  struct razz_result *partial = NULL;
+  rng *r;
+
+  if (!is_valid_razz_scenario (scenario))
+    {
+      fprintf (stderr, "Invalid scenario\n");
+      return 1;
+    }
+
+  if (options == NULL)
+    {
+      init_simulation_options (&default_options);
+      options = &default_options;
+    }
+
+  if (options->variant != GAME_RAZZ)
+    {
+      fprintf (stderr, "Only a context runs variants other than Razz\n");
+      return 1;
+    }
+
+  if (options->counter_key != 0)
+    {
+      r = create_counter_rng (options->counter_key);
+    }
+  else
+    {
+      r = create_rng (((uint64_t) lrand48 () << 31) ^ lrand48 ());
+    }
+  if (r == NULL)
+    {
+      fprintf (stderr, "Cannot create a random number generator\n");
+      return 1;
+    }
+
+  if (options->progress_listener != NULL)
+    {
+      partial = malloc (sizeof (*partial));
+      if (partial == NULL)
+	{
+	  fprintf (stderr, "Cannot allocate the partial result\n");
+	  destroy_rng (&r);
+	  return 1;
+	}
+      clear_razz_result (partial);
+    }
+
+  if (options->perf_counts != NULL)
+    {
+      is_counted = (open_perf_group (&perf) == 0
+		    && read_perf_group (&perf, before) == 0);
+    }
+
+  start_ns = options->tracer == NULL ? 0 : razz_trace_now ();
+  if (options->deck_kind == RANK_DECK)
+    {
+      rc = run_rank_games (scenario, game_count, options, r,
+			   arg, r_listener, l_listener, partial,
+			   &played_count);
+    }
+  else
+    {
+      rc = run_suited_games (scenario, game_count, options, r,
+			     arg, r_listener, l_listener, partial,
+			     &played_count);
+    }
+  razz_trace_span (options->tracer, "sim", "run", start_ns, played_count);
+
+  if (options->perf_counts != NULL)
+    {
+      is_counted = is_counted && read_perf_group (&perf, after) == 0;
+      add_perf_counts (options->perf_counts, is_counted ? &perf : NULL,
+		       before, after, played_count);
+      close_perf_group (&perf);
+    }
+
+  destroy_rng (&r);
+  free (partial);
+
+  return rc;
+}
+
+/**
+ * Records the outcome of a game of a variant in a result.
+ *
+ * @param [in,out] result the result to record the outcome in.
+ * @param [in] rank_counts the rank counts of my complete hand.
+ * @param [in] suit_masks the ranks of my complete hand by suit.
+ */
+typedef void (*outcome_recorder) (struct razz_result *result,
+				  const uint8_t rank_counts[RANK_COUNT],
+				  const uint16_t suit_masks[SUIT_COUNT]);
+
+/** A scenario of a sweep. */
+struct sweep_cell
+{
+  uint64_t known_mask; /**< The cards a deal must not hit. */
+  uint8_t my_rank_counts[RANK_COUNT]; /**< The rank counts of my cards. */
+  uint16_t my_suit_masks[SUIT_COUNT]; /**< The ranks of my cards by suit. */
+  int missing_count; /**< The number of dealt cards completing my hand. */
+};
+
+/**
+ * Evaluates a deal for every scenario of a sweep that it does not conflict
+ * with.
+ *
+ * @param [in] cells the scenarios of the sweep.
+ * @param [in] cell_count the number of scenarios.
+ * @param [in] dealt the dealt cards in the order they are dealt.
+ * @param [in] record the recorder of the variant.
+ * @param [in,out] results the results of the scenarios.
+ */
+static void
+evaluate_sweep_deal (const struct sweep_cell *cells, unsigned int cell_count,
+		     const card **dealt, outcome_recorder record,
+		     struct razz_result *results)
+{
+  uint64_t dealt_masks[RAZZ_CARD_IN_HAND_COUNT + 1];
+  enum card_rank ranks[RAZZ_CARD_IN_HAND_COUNT];
+  enum card_suit suits[RAZZ_CARD_IN_HAND_COUNT];
+  unsigned int c;
+  int j;
+
+  /* The cards dealt to a scenario are a prefix of the deal */
+  dealt_masks[0] = 0;
+  for (j = 0; j < RAZZ_CARD_IN_HAND_COUNT && dealt[j] != NULL; j++)
+    {
+      enum card_suit_rank csr = get_card_suit_rank (dealt[j]);
+
+      ranks[j] = csr % RANK_COUNT;
+      suits[j] = csr / RANK_COUNT;
+      dealt_masks[j + 1] = dealt_masks[j] | RAZZ_CARD_BIT (csr);
+    }
+
+  for (c = 0; c < cell_count; c++)
+    {
+      const struct sweep_cell *cell = &cells[c];
+      uint8_t rank_counts[RANK_COUNT];
+      uint16_t suit_masks[SUIT_COUNT];
+
+      if (dealt_masks[cell->missing_count] & cell->known_mask)
+	{
+	  continue;
+	}
+
+      memcpy (rank_counts, cell->my_rank_counts, sizeof (rank_counts));
+      memcpy (suit_masks, cell->my_suit_masks, sizeof (suit_masks));
+      for (j = 0; j < cell->missing_count; j++)
+	{
+	  rank_counts[ranks[j]]++;
+	  suit_masks[suits[j]] |= 1 << ranks[j];
+	}
+
+      results[c].game_count++;
+      record (&results[c], rank_counts, suit_masks);
+    }
+}
+
+int
+simulate_razz_sweep (const struct razz_scenario *scenarios,
+		     unsigned int scenario_count,
+		     unsigned long deal_count,
+		     const struct simulation_options *options,
+		     struct razz_result *results)
+{
+  struct simulation_options default_options;
+  struct progress_tracker tracker;
+  struct razz_scenario common = {~(uint64_t) 0 >> (64 - CARD_COUNT), 0};
+  struct sweep_cell *cells;
+  outcome_recorder record;
+  card_deck *template_deck = NULL;
+  card_deck *deck = NULL;
+  rng *r = NULL;
+  unsigned long i;
+  unsigned long since_check = 0;
+  uint64_t start_ns;
+  unsigned int c;
+  int deal_size = 0;
+  int is_uniform = 1;
+  int rc = 0;
+  int j;
+
+  if (options == NULL)
+    {
+      init_simulation_options (&default_options);
+      options = &default_options;
+    }
+
+  switch (options->variant)
+    {
+    case GAME_RAZZ:
+      record = record_razz_outcome;
+      break;
+    case GAME_STUD_HIGH:
+      record = record_stud_high_outcome;
+      break;
+    case GAME_STUD_HILO8:
+      record = record_stud_hilo8_outcome;
+      break;
+    default:
+      fprintf (stderr, "Unknown variant\n");
+      return 1;
+    }
+
+  if (scenario_count == 0)
+    {
+      return 0;
+    }
+
+  cells = malloc (scenario_count * sizeof (*cells));
+  if (cells == NULL)
+    {
+      fprintf (stderr, "Cannot allocate the sweep\n");
+      return 1;
+    }
+
+  for (c = 0; c < scenario_count; c++)
+    {
+      struct sweep_cell *cell = &cells[c];
+      uint64_t mask = scenarios[c].my_mask;
+
+      if (!is_valid_razz_scenario (&scenarios[c]))
+	{
+	  fprintf (stderr, "Invalid scenario #%u\n", c + 1);
+	  free (cells);
+	  return 1;
+	}
+
+      clear_razz_result (&results[c]);
+      cell->known_mask = scenarios[c].known_mask;
+      memset (cell->my_rank_counts, 0, sizeof (cell->my_rank_counts));
+      memset (cell->my_suit_masks, 0, sizeof (cell->my_suit_masks));
+      while (mask != 0)
+	{
+	  enum card_suit_rank csr = take_lowest_card (&mask);
+
+	  cell->my_rank_counts[csr % RANK_COUNT]++;
+	  cell->my_suit_masks[csr / RANK_COUNT] |= 1 << (csr % RANK_COUNT);
+	}
+      cell->missing_count = (RAZZ_CARD_IN_HAND_COUNT
+			     - count_cards_in_mask (scenarios[c].my_mask));
+
+      common.known_mask &= cell->known_mask;
+      if (c > 0 && cell->missing_count != deal_size)
+	{
+	  is_uniform = 0;
+	}
+      if (cell->missing_count > deal_size)
+	{
+	  deal_size = cell->missing_count;
+	}
+    }
+
+  /* Every scenario is valid, so the cards not known in every scenario are
+     enough to complete any hand */
+  template_deck = create_shuffled_deck ();
+  if (template_deck != NULL)
+    {
+      strip_deck (template_deck, &common);
+      deck = copy_deck (template_deck);
+    }
+  if (options->counter_key != 0)
+    {
+      r = create_counter_rng (options->counter_key);
+    }
+  else
+    {
+      r = create_rng (((uint64_t) lrand48 () << 31) ^ lrand48 ());
+    }
+  if (deck == NULL || r == NULL)
+    {
+      fprintf (stderr, "Cannot create the deck of the sweep\n");
+      rc = 1;
+      deal_count = 0;
+    }
+  else
+    {
+      set_deck_rng (template_deck, r);
+    }
+
+  start_ns = options->tracer == NULL ? 0 : razz_trace_now ();
+  start_progress (&tracker, options, deal_count);
+  for (i = 0; i < deal_count; i++)
+    {
+      const card *dealt[RAZZ_CARD_IN_HAND_COUNT + 1] = {NULL};
+
+      reset_deck_from (deck, template_deck);
+      if (options->counter_key != 0)
+	{
+	  rng_seek (r, options->counter_key, options->first_game_index + i);
+	}
+
+      /* The cards of a combination are not in random order, so a prefix of
+	 it is only random if every scenario takes the whole of it */
+      if (is_uniform)
+	{
+	  deal_combination_from_deck (deck, deal_size, dealt);
+	}
+      else
+	{
+	  for (j = 0; j < deal_size; j++)
+	    {
+	      dealt[j] = deal_from_deck (deck);
+	    }
+	}
+
+      evaluate_sweep_deal (cells, scenario_count, dealt, record, results);
+
+      if (++since_check == tracker.check_period)
+	{
+	  since_check = 0;
+	  if (is_cancelled (options))
+	    {
+	      i++;
+	      rc = RAZZ_CANCELLED;
+	      break;
+	    }
+	  poll_progress (&tracker, i + 1, NULL, 0);
+	}
+    }
+  if (rc != 1)
+    {
+      poll_progress (&tracker, i, NULL, 1);
+    }
+  razz_trace_span (options->tracer, "sim", "sweep", start_ns, i);
+
+  destroy_rng (&r);
+  destroy_deck (&deck);
+  destroy_deck (&template_deck);
+  free (cells);
+
+  return rc;
+}
+
+int
+simulate_razz_game (const struct decided_cards *decided_cards,
+		    unsigned long game_count,
+		    void *arg,
+		    rank_listener listener)
+{
+  return simulate_razz_game_with_options (decided_cards, game_count, NULL,
+					  arg, listener, NULL);
+}
+
+int
+simulate_razz_game_low (const struct decided_cards *decided_cards,
+			unsigned long game_count,
+			void *arg,
+			low_listener listener)
+{
+  return simulate_razz_game_with_options (decided_cards, game_count, NULL,
+					  arg, NULL, listener);
+}
+
+/**
+ * Sorts cards by rank like sort_card_by_rank() does. Being a different
+ * function, it makes a hand take its generic insertion path, which is the
+ * reference for the specialized one.
+ */
+static int
+reference_sort_card_by_rank (const card *before, const card *new,
+			     const card *after)
+{
+  return sort_card_by_rank (before, new, after);
+}
+
+/**
+ * Records the cards of a hand in order. The context points to an array of
+ * ::card_suit_rank large enough for the hand.
+ */
+static enum itr_action
+card_recorder (void *ctx, unsigned long len, unsigned long pos, const card *c)
+{
+  ((enum card_suit_rank *) ctx)[pos] = get_card_suit_rank (c);
+  return CONTINUE;
+}
+
+/** The state of a verification run. */
+struct verifier
+{
+  card_hand *reference; /**< The hand sorted through the generic path. */
+  card_hand *fast; /**< The hand sorted through the specialized path. */
+  struct razz_mismatch *mismatch; /**< Where to report a mismatch. */
+  unsigned long checked_count; /**< The number of hands checked so far. */
+  struct razz_plan batch_plan; /**<
+				* A plan dealing all cards of the hand to
+				* evaluate_razz_batch().
+				*/
+  struct razz_result *result; /**< The outcomes of the hi/lo8 recorder. */
+};
+
+/**
+ * Reports a mismatch if a fast path disagrees with the reference.
+ *
+ * @param [in] v the verifier.
+ * @param [in] path the name of the fast path.
+ * @param [in] reference the value given by the reference.
+ * @param [in] fast the value given by the fast path.
+ *
+ * @return non-zero if the values disagree.
+ */
+static int
+is_mismatch (struct verifier *v, const char *path, int reference, int fast)
+{
+  if (reference == fast)
+    {
+      return 0;
+    }
+
+  v->mismatch->path = path;
+  v->mismatch->reference = reference;
+  v->mismatch->fast = fast;
+
+  return 1;
+}
+
+/** The best five cards of a hand according to the reference. */
+struct reference_hand
+{
+  int low; /**< The Razz low encoded by encode_razz_low(). */
+  enum razz_low_category low_category; /**< The category of the low. */
+  enum card_rank low_ranks[5]; /**<
+				* The ranks of the low, the bigger groups and
+				* then the higher ranks first.
+				*/
+  enum stud_high_category high; /**< The category of the high hand. */
+};
+
+/**
+ * Encodes a Razz low as its category followed by its ranks in base
+ * ::RANK_COUNT, so that a better low is a smaller number.
+ *
+ * @param [in] category the category of the low.
+ * @param [in] ranks the ranks of the low, the bigger groups and then the
+ *                   higher ranks first.
+ *
+ * @return the encoded low.
+ */
+static int
+encode_razz_low (enum razz_low_category category,
+		 const enum card_rank ranks[5])
+{
+  int low = category;
+  int i;
+
+  for (i = 0; i < 5; i++)
+    {
+      low = low * RANK_COUNT + ranks[i];
+    }
+
+  return low;
+}
+
+/**
+ * Encodes the low of a Razz low index like encode_razz_low() does.
+ *
+ * @param [in] low_index the Razz low index.
+ *
+ * @return the encoded low or -1 if the low index is invalid.
+ */
+static int
+encode_razz_low_index (unsigned int low_index)
+{
+  enum card_rank ranks[5];
+  enum razz_low_category category = get_razz_low_ranks (low_index, ranks);
+
+  if (category == LOW_CATEGORY_COUNT)
+    {
+      return -1;
+    }
+
+  return encode_razz_low (category, ranks);
+}
+
+/**
+ * Evaluates five cards by the rules of Razz and of seven-card stud high
+ * without any of the shortcuts of the fast paths.
+ *
+ * @param [in] cards the five cards.
+ * @param [out] hand the Razz low and the high category of the cards.
+ */
+static void
+evaluate_reference_five (const enum card_suit_rank cards[5],
+			 struct reference_hand *hand)
+{
+  int rank_counts[RANK_COUNT] = {0};
+  int group_count = 0;
+  int biggest_group = 0;
+  int is_flush = 1;
+  int is_straight;
+  int lowest = K;
+  int highest = ACE;
+  int size;
+  int len = 0;
+  int r;
+  int i;
+
+  for (i = 0; i < 5; i++)
+    {
+      r = cards[i] % RANK_COUNT;
+      rank_counts[r]++;
+      lowest = r < lowest ? r : lowest;
+      highest = r > highest ? r : highest;
+      is_flush = is_flush && cards[i] / RANK_COUNT == cards[0] / RANK_COUNT;
+    }
+
+  for (size = 4; size >= 1; size--)
+    {
+      for (r = K; r >= ACE; r--)
+	{
+	  if (rank_counts[r] != size)
+	    {
+	      continue;
+	    }
+	  if (biggest_group == 0)
+	    {
+	      biggest_group = size;
+	    }
+	  group_count++;
+	  for (i = 0; i < size; i++)
+	    {
+	      hand->low_ranks[len++] = r;
+	    }
+	}
+    }
+
+  switch (biggest_group)
+    {
+    case 1:
+      hand->low_category = LOW_NO_PAIR;
+      break;
+    case 2:
+      hand->low_category = group_count == 4 ? LOW_ONE_PAIR : LOW_TWO_PAIR;
+      break;
+    case 3:
+      hand->low_category = group_count == 3 ? LOW_TRIPS : LOW_FULL_HOUSE;
+      break;
+    default:
+      hand->low_category = LOW_QUADS;
+      break;
+    }
+  hand->low = encode_razz_low (hand->low_category, hand->low_ranks);
+
+  /* An ace is below a two or above a king */
+  is_straight = (group_count == 5
+		 && (highest - lowest == 4
+		     || (rank_counts[ACE] && rank_counts[R10] && rank_counts[J]
+			 && rank_counts[Q] && rank_counts[K])));
+  if (is_straight && is_flush)
+    {
+      hand->high = HIGH_STRAIGHT_FLUSH;
+    }
+  else if (hand->low_category == LOW_QUADS)
+    {
+      hand->high = HIGH_QUADS;
+    }
+  else if (hand->low_category == LOW_FULL_HOUSE)
+    {
+      hand->high = HIGH_FULL_HOUSE;
+    }
+  else if (is_flush)
+    {
+      hand->high = HIGH_FLUSH;
+    }
+  else if (is_straight)
+    {
+      hand->high = HIGH_STRAIGHT;
+    }
+  else if (hand->low_category == LOW_TRIPS)
+    {
+      hand->high = HIGH_TRIPS;
+    }
+  else if (hand->low_category == LOW_TWO_PAIR)
+    {
+      hand->high = HIGH_TWO_PAIR;
+    }
+  else
+    {
+      hand->high = (hand->low_category == LOW_ONE_PAIR
+		    ? HIGH_ONE_PAIR : HIGH_NO_PAIR);
+    }
+}
+
+/**
+ * Evaluates the best five of seven cards for the reference by leaving out
+ * every pair of cards in turn.
+ *
+ * @param [in] cards the seven cards.
+ * @param [out] best the best Razz low and the best high category of the
+ *                   cards.
+ */
+static void
+evaluate_reference_hand (const enum card_suit_rank *cards,
+			 struct reference_hand *best)
+{
+  enum card_suit_rank five[5];
+  enum stud_high_category high = HIGH_NO_PAIR;
+  struct reference_hand hand;
+  int is_first = 1;
+  int a, b;
+  int i, len;
+
+  for (a = 0; a < RAZZ_CARD_IN_HAND_COUNT; a++)
+    {
+      for (b = a + 1; b < RAZZ_CARD_IN_HAND_COUNT; b++)
+	{
+	  len = 0;
+	  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+	    {
+	      if (i != a && i != b)
+		{
+		  five[len++] = cards[i];
+		}
+	    }
+
+	  evaluate_reference_five (five, &hand);
+	  if (is_first || hand.low < best->low)
+	    {
+	      *best = hand;
+	      is_first = 0;
+	    }
+	  high = hand.high > high ? hand.high : high;
+	}
+    }
+  best->high = high;
+}
+
+/**
+ * Checks one hand through the reference and the fast paths.
+ *
+ * @param [in] v the verifier.
+ * @param [in] cards the seven cards of the hand in the order they are dealt.
+ *
+ * @return non-zero if a fast path disagrees.
+ */
+static int
+verify_hand (struct verifier *v, const card **cards)
+{
+  enum card_suit_rank reference_order[RAZZ_CARD_IN_HAND_COUNT];
+  enum card_suit_rank fast_order[RAZZ_CARD_IN_HAND_COUNT];
+  struct reference_hand reference;
+  enum card_rank reference_rank;
+  uint8_t rank_counts[RANK_COUNT];
+  uint16_t suit_masks[SUIT_COUNT] = {0};
+  uint8_t dealt_ranks[RAZZ_CARD_IN_HAND_COUNT];
+  struct razz_batch batch;
+  uint16_t batch_rank_mask;
+  uint16_t batch_low_index;
+  uint8_t batch_rank;
+  unsigned long qualified_count;
+  unsigned int low_index;
+  int i;
+
+  v->checked_count++;
+  reset_hand (v->reference);
+  reset_hand (v->fast);
+  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+    {
+      v->mismatch->cards[i] = get_card_suit_rank (cards[i]);
+      suit_masks[get_card_suit (cards[i])] |= 1 << get_card_rank (cards[i]);
+      insert_into_hand (v->reference, cards[i]);
+      insert_into_hand (v->fast, cards[i]);
+    }
+
+  iterate_hand_ctx (v->reference, card_recorder, reference_order);
+  iterate_hand_ctx (v->fast, card_recorder, fast_order);
+  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+    {
+      if (is_mismatch (v, "sort_card_by_rank", reference_order[i],
+		       fast_order[i]))
+	{
+	  return 1;
+	}
+    }
+
+  evaluate_reference_hand (v->mismatch->cards, &reference);
+  reference_rank = (reference.low_category == LOW_NO_PAIR
+		    ? reference.low_ranks[0] : INVALID_RANK);
+
+  count_ranks_in_hand (v->reference, rank_counts);
+  low_index = get_razz_low_index_of_counts (rank_counts);
+  if (is_mismatch (v, "get_razz_low_index_of_counts", reference.low,
+		   encode_razz_low_index (low_index))
+      || is_mismatch (v, "get_razz_low_index", reference.low,
+		      encode_razz_low_index (get_razz_low_index (v->fast))))
+    {
+      return 1;
+    }
+
+  if (is_mismatch (v, "evaluate_razz_rank", reference_rank,
+		   evaluate_razz_rank (v->reference, NULL))
+      || is_mismatch (v, "get_razz_rank_of_counts", reference_rank,
+		      get_razz_rank_of_counts (rank_counts))
+      || is_mismatch (v, "get_razz_rank_of_low_index", reference_rank,
+		      get_razz_rank_of_low_index (low_index)))
+    {
+      return 1;
+    }
+
+  /* Evaluate the hand as a batch of one game as the plan runners do */
+  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+    {
+      dealt_ranks[i] = get_card_rank (cards[i]);
+      batch.dealt[i] = &dealt_ranks[i];
+    }
+  batch.capacity = 1;
+  batch.rank_masks = &batch_rank_mask;
+  batch.low_indices = &batch_low_index;
+  batch.ranks = &batch_rank;
+  evaluate_razz_batch (&v->batch_plan, &batch, 1);
+  if (is_mismatch (v, "evaluate_razz_batch", reference.low,
+		   encode_razz_low_index (batch_low_index))
+      || is_mismatch (v, "evaluate_razz_batch", reference_rank,
+		      (batch_rank == RANK_COUNT
+		       ? INVALID_RANK : (enum card_rank) batch_rank)))
+    {
+      return 1;
+    }
+
+  if (is_mismatch (v, "get_stud_high_category", reference.high,
+		   get_stud_high_category (rank_counts, suit_masks)))
+    {
+      return 1;
+    }
+
+  qualified_count = v->result->qualified_low_count;
+  record_stud_hilo8_outcome (v->result, rank_counts, suit_masks);
+
+  return is_mismatch (v, "record_stud_hilo8_outcome",
+		      reference_rank != INVALID_RANK && reference_rank <= R8,
+		      v->result->qualified_low_count - qualified_count);
+}
+
+/**
+ * Checks the ranks that a rank deck stripped of a hand deals against a
+ * reference deck holding the ranks of the remaining cards in rank order. The
+ * reference deals the card at the position drawn from a twin of the stream of
+ * the rank deck.
+ *
+ * @param [in] v the verifier.
+ * @param [in] cards the seven cards of the hand.
+ * @param [in,out] fast_r the stream of the rank deck.
+ * @param [in,out] reference_r the twin stream of the reference deck.
+ *
+ * @return non-zero if the rank deck disagrees.
+ */
+static int
+verify_rank_deal (struct verifier *v, const card **cards, rng *fast_r,
+		  rng *reference_r)
+{
+  enum card_rank remaining[CARD_COUNT];
+  struct rank_deck deck;
+  uint64_t hand_mask = 0;
+  uint32_t remaining_count = 0;
+  uint32_t pos;
+  int i;
+  int r;
+  int s;
+
+  init_rank_deck (&deck);
+  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+    {
+      hand_mask |= RAZZ_CARD_BIT (get_card_suit_rank (cards[i]));
+      strip_rank_from_rank_deck (get_card_rank (cards[i]), &deck);
+    }
+  for (r = ACE; r < RANK_COUNT; r++)
+    {
+      for (s = SPADE; s < SUIT_COUNT; s++)
+	{
+	  if (!(hand_mask & RAZZ_CARD_BIT (s * RANK_COUNT + r)))
+	    {
+	      remaining[remaining_count++] = r;
+	    }
+	}
+    }
+
+  for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+    {
+      pos = rng_below (reference_r, remaining_count);
+      if (is_mismatch (v, "deal_rank_from_rank_deck", remaining[pos],
+		       deal_rank_from_rank_deck (&deck, fast_r)))
+	{
+	  return 1;
+	}
+      remaining_count--;
+      memmove (&remaining[pos], &remaining[pos + 1],
+	       (remaining_count - pos) * sizeof (*remaining));
+    }
+
+  return 0;
+}
+
+/**
+ * Checks every multiset of seven ranks made of concrete cards, going through
+ * the ranks from the given one.
+ *
+ * @param [in] v the verifier.
+ * @param [in] all_cards every card indexed by its ::card_suit_rank.
+ * @param [in,out] cards the cards chosen so far.
+ * @param [in] len the number of cards chosen so far.
+ * @param [in] r the first rank that may still be chosen.
+ *
+ * @return non-zero if a fast path disagrees.
+ */
+static int
+verify_rank_multisets (struct verifier *v, const card **all_cards,
+		       const card **cards, int len, int r)
+{
+  const card *dealt[RAZZ_CARD_IN_HAND_COUNT];
+  int i;
+  int k;
+
+  if (len == RAZZ_CARD_IN_HAND_COUNT)
+    {
+      /* Deal the cards from the highest rank down so that every card is
+	 inserted before the cards already in the hand */
+      for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+	{
+	  dealt[i] = cards[RAZZ_CARD_IN_HAND_COUNT - 1 - i];
+	}
+      return verify_hand (v, dealt);
+    }
+
+  for (; r < RANK_COUNT; r++)
+    {
+      for (k = 1; k <= SUIT_COUNT && len + k <= RAZZ_CARD_IN_HAND_COUNT; k++)
+	{
+	  cards[len + k - 1] = all_cards[(k - 1) * RANK_COUNT + r];
+	  if (verify_rank_multisets (v, all_cards, cards, len + k, r + 1))
+	    {
+	      return 1;
+	    }
+	}
+    }
+
+  return 0;
+}
+
+/**
+ * Checks random hands dealt with the combination dealer and the ranks that a
+ * rank deck deals after each of them.
+ *
+ * @param [in] v the verifier.
+ * @param [in] count the number of hands.
+ * @param [in] seed the seed of the hands.
+ *
+ * @return 0 if every hand agrees, 1 if a fast path disagrees or -1 if the
+ *         deck cannot be created.
+ */
+static int
+verify_random_hands (struct verifier *v, unsigned long count, uint64_t seed)
+{
+  card_deck *template_deck;
+  card_deck *deck;
+  rng *r;
+  rng *fast_r;
+  rng *reference_r;
+  const card *dealt[RAZZ_CARD_IN_HAND_COUNT];
+  unsigned long n;
+  int rc = 0;
+  int i, j;
+
+  deck = NULL;
+  template_deck = create_shuffled_deck ();
+  if (template_deck != NULL)
+    {
+      deck = copy_deck (template_deck);
+    }
+  r = create_rng (seed);
+  fast_r = create_rng (seed + 1);
+  reference_r = create_rng (seed + 1);
+  if (template_deck == NULL || deck == NULL || r == NULL || fast_r == NULL
+      || reference_r == NULL)
+    {
+      destroy_rng (&reference_r);
+      destroy_rng (&fast_r);
+      destroy_rng (&r);
+      destroy_deck (&deck);
+      destroy_deck (&template_deck);
+      return -1;
+    }
+
+  set_deck_rng (template_deck, r);
+  for (n = 0; n < count && rc == 0; n++)
+    {
+      reset_deck_from (deck, template_deck);
+      if (deal_combination_from_deck (deck, RAZZ_CARD_IN_HAND_COUNT, dealt))
+	{
+	  rc = -1;
+	  break;
+	}
+
+      /* The fast dealer must never deal the same card twice */
+      for (i = 0; i < RAZZ_CARD_IN_HAND_COUNT; i++)
+	{
+	  v->mismatch->cards[i] = get_card_suit_rank (dealt[i]);
+	  for (j = 0; j < i; j++)
+	    {
+	      if (dealt[i] == dealt[j])
+		{
+		  v->checked_count++;
+		  v->mismatch->path = "deal_combination_from_deck";
+		  v->mismatch->reference = j;
+		  v->mismatch->fast = i;
+		  rc = 1;
+		}
+	    }
+	}
+
+      if (rc == 0)
+	{
+	  rc = verify_hand (v, dealt);
+	}
+      if (rc == 0)
+	{
+	  rc = verify_rank_deal (v, dealt, fast_r, reference_r);
+	}
+    }
+
+  destroy_rng (&reference_r);
+  destroy_rng (&fast_r);
+  destroy_rng (&r);
+  destroy_deck (&deck);
+  destroy_deck (&template_deck);
+
+  return rc;
+}
+
+int
+verify_razz_evaluators (int is_exhaustive, unsigned long random_count,
+			uint64_t seed, struct razz_mismatch *mismatch,
+			unsigned long *checked_count)
+{
+  struct verifier v;
+  const card *all_cards[CARD_COUNT];
+  const card *cards[RAZZ_CARD_IN_HAND_COUNT];
+  int rc = 0;
+  int i;
+
+  mismatch->path = NULL;
+  v.mismatch = mismatch;
+  v.checked_count = 0;
+  memset (&v.batch_plan, 0, sizeof (v.batch_plan));
+  v.batch_plan.missing_count = RAZZ_CARD_IN_HAND_COUNT;
+  v.result = malloc (sizeof (*v.result));
+  if (v.result != NULL)
+    {
+      clear_razz_result (v.result);
+    }
+  v.reference = create_hand (RAZZ_CARD_IN_HAND_COUNT,
+			     reference_sort_card_by_rank);
+  v.fast = create_hand (RAZZ_CARD_IN_HAND_COUNT, sort_card_by_rank);
+  for (i = 0; i < CARD_COUNT; i++)
+    {
+      all_cards[i] = create_card (i);
+      if (all_cards[i] == NULL)
+	{
+	  rc = 1;
+	}
+    }
+
+  if (v.reference == NULL || v.fast == NULL || v.result == NULL)
+    {
+      rc = 1;
+    }
+  if (rc == 0 && is_exhaustive)
+    {
+      rc = verify_rank_multisets (&v, all_cards, cards, 0, ACE);
+    }
+  if (rc == 0 && random_count != 0)
+    {
+      rc = (verify_random_hands (&v, random_count, seed) != 0);
+    }
+
+  if (checked_count != NULL)
+    {
+      *checked_count = v.checked_count;
+    }
+
+  for (i = 0; i < CARD_COUNT; i++)
+    {
+      destroy_card (&all_cards[i]);
+    }
+  free (v.result);
+  destroy_hand (&v.fast);
+  destroy_hand (&v.reference);
+
+  return rc;
+}
@@ -19,8 +19,10 @@
  * @author Tadeus Prastowo <eus@member.fsf.org>
  ****************************************************************************/
 
+#include <signal.h>
 #include <stdint.h>
 #include "card.h"
+#include "razz_trace.h"
 
 #ifndef RAZZ_SIMULATION_H
 #define RAZZ_SIMULATION_H
@@ -38,6 +40,71 @@ struct decided_cards
   const card *opponent_cards[7]; /**< The initial card of the opponent. */
 };
 
+/**
+ * The bit of a card in the masks of a ::razz_scenario.
+ *
+ * @param [in] csr the ::card_suit_rank of the card.
+ */
+#define RAZZ_CARD_BIT(csr) ((uint64_t) 1 << (csr))
+
+/**
+ * The cards that are not played in the simulated game packed into a value
+ * that can be copied, compared, hashed or sent between threads and processes
+ * as it is. Bit ::card_suit_rank of a mask is set if the card is in the mask.
+ */
+struct razz_scenario
+{
+  uint64_t known_mask; /**< The cards that are not dealt, mine included. */
+  uint64_t my_mask; /**< The cards of mine, which are also known. */
+};
+
+/**
+ * Checks that a packed scenario can be simulated: my cards are known, no
+ * card is beyond ::CARD_COUNT, I have at most seven cards and enough cards
+ * are left to complete my hand.
+ *
+ * @param [in] scenario the scenario to be checked.
+ *
+ * @return non-zero if the scenario is valid or 0 otherwise.
+ */
+int
+is_valid_razz_scenario (const struct razz_scenario *scenario);
+
+/**
+ * Packs the cards of a scenario into a value.
+ *
+ * @param [in] decided_cards the cards to be packed.
+ * @param [out] scenario the packed scenario.
+ *
+ * @return 0 if the cards are packed or non-zero if a card is duplicated.
+ */
+int
+pack_decided_cards (const struct decided_cards *decided_cards,
+		    struct razz_scenario *scenario);
+
+/**
+ * Unpacks a scenario into newly created cards ordered by ::card_suit_rank.
+ * The cards have to be freed with release_decided_cards().
+ *
+ * @param [in] scenario the scenario to be unpacked.
+ * @param [out] decided_cards the unpacked cards, which are empty on failure.
+ *
+ * @return 0 if the scenario is unpacked or non-zero if it is invalid, has
+ *         more cards than ::decided_cards can hold or a card cannot be
+ *         created.
+ */
+int
+unpack_razz_scenario (const struct razz_scenario *scenario,
+		      struct decided_cards *decided_cards);
+
+/**
+ * Destroys the cards of a scenario and sets their counts to zero.
+ *
+ * @param [in,out] decided_cards the cards to be destroyed.
+ */
+void
+release_decided_cards (struct decided_cards *decided_cards);
+
 /**
  * Listens to the final rank of my hand at the end of each game.
  *
@@ -47,7 +114,332 @@ struct decided_cards
 typedef void (*rank_listener) (void *arg, enum card_rank r);
 
 /**
- * Runs a Razz game for a number of times.
+ * The number of distinct Razz low indices. A Razz low index totally orders
+ * the best five-card Razz hands that can be made out of five to seven cards:
+ * the lower the index, the better the hand. Index 0 is 5-4-3-2-A, the first
+ * 1287 indices are the unpaired lows and the rest are the paired categories
+ * listed in ::razz_low_category. Two hands with the same index split the pot.
+ */
+#define RAZZ_LOW_INDEX_COUNT 6175
+
+/** The category of a Razz low from the best to the worst. */
+enum razz_low_category
+  {
+    LOW_NO_PAIR, LOW_ONE_PAIR, LOW_TWO_PAIR, LOW_TRIPS, LOW_FULL_HOUSE,
+    LOW_QUADS,
+
+    LOW_CATEGORY_COUNT,
+  };
+
+/**
+ * Determines the Razz low index of the best five cards that can be made out
+ * of the given rank counts.
+ *
+ * @param [in] rank_counts the number of cards of each rank (the sum must be
+ *                         between 5 and 7 inclusive).
+ *
+ * @return the Razz low index or ::RAZZ_LOW_INDEX_COUNT if the counts cannot
+ *         make a five-card hand.
+ */
+unsigned int
+get_razz_low_index_of_counts (const uint8_t rank_counts[RANK_COUNT]);
+
+/**
+ * Determines the Razz low index of a hand.
+ *
+ * @param [in] hand the hand of five to seven cards to be evaluated.
+ *
+ * @return the Razz low index or ::RAZZ_LOW_INDEX_COUNT if the hand cannot
+ *         make a five-card hand.
+ */
+unsigned int
+get_razz_low_index (const card_hand *hand);
+
+/**
+ * Decodes a Razz low index into the five ranks making up the low.
+ *
+ * @param [in] low_index the Razz low index to be decoded.
+ * @param [out] ranks the five ranks ordered by their significance in a
+ *                    showdown (e.g., 8, 7, 6, 5, 4 for an unpaired 8-low or
+ *                    Q, Q, 4, 3, A for a pair of queens).
+ *
+ * @return the category of the low or ::LOW_CATEGORY_COUNT if the index is
+ *         invalid.
+ */
+enum razz_low_category
+get_razz_low_ranks (unsigned int low_index, enum card_rank ranks[5]);
+
+/**
+ * Listens to the Razz low index of my hand at the end of each game.
+ *
+ * @param [in] arg your marshalled argument into the listener.
+ * @param [in] low_index the Razz low index of my hand.
+ */
+typedef void (*low_listener) (void *arg, unsigned int low_index);
+
+/** How the cards missing from my hand are dealt in each game. */
+enum deal_mode
+  {
+    DEAL_COMBINATION, /**<
+		       * Deal all missing cards at once with one random draw
+		       * using deal_combination_from_deck() (the default).
+		       */
+    DEAL_ONE_BY_ONE, /**<
+		      * Deal the missing cards one by one with one random draw
+		      * per card using deal_from_deck().
+		      */
+  };
+
+/** What kind of deck the missing cards are dealt from. */
+enum deck_kind
+  {
+    SUITED_DECK, /**< A ::card_deck of 52 suited cards (the default). */
+    RANK_DECK, /**<
+		* A ::rank_deck of 13 rank counters. Since Razz ignores the
+		* suits, this gives the same results with a much smaller
+		* per-game state. The deal mode is then ignored because ranks
+		* are always dealt one by one.
+		*/
+  };
+
+/**
+ * The stud game whose outcome is counted. Every variant deals seven cards to
+ * my hand and has its own simulation loop specialized at compile time, so
+ * the variant is looked at only once per query.
+ */
+enum game_variant
+  {
+    GAME_RAZZ, /**< Razz, which is ace-to-five lowball (the default). */
+    GAME_STUD_HIGH, /**<
+		     * Seven-card stud high. Only the high category of my hand
+		     * is counted, so the deck must be suited.
+		     */
+    GAME_STUD_HILO8, /**<
+		      * Seven-card stud high-low eight or better. Both the high
+		      * category and the Razz low of my hand are counted
+		      * together with whether the low qualifies, so the deck
+		      * must be suited.
+		      */
+  };
+
+/** The category of a seven-card stud high hand from the worst to the best. */
+enum stud_high_category
+  {
+    HIGH_NO_PAIR, HIGH_ONE_PAIR, HIGH_TWO_PAIR, HIGH_TRIPS, HIGH_STRAIGHT,
+    HIGH_FLUSH, HIGH_FULL_HOUSE, HIGH_QUADS, HIGH_STRAIGHT_FLUSH,
+
+    HIGH_CATEGORY_COUNT,
+  };
+
+/**
+ * Determines the category of the best five-card high hand that can be made
+ * out of five to seven cards. An ace plays both above a king and below a two
+ * in a straight.
+ *
+ * @param [in] rank_counts the number of cards of each rank.
+ * @param [in] suit_masks the ranks of the cards of each suit with bit
+ *                        ::card_rank set for every card of the rank.
+ *
+ * @return the category of the hand.
+ */
+enum stud_high_category
+get_stud_high_category (const uint8_t rank_counts[RANK_COUNT],
+			const uint16_t suit_masks[SUIT_COUNT]);
+
+/** The value returned by a simulation that is stopped by its cancel flag. */
+#define RAZZ_CANCELLED (-1)
+
+struct razz_result;
+struct perf_counts;
+
+/** A snapshot of a simulation in progress. */
+struct razz_progress
+{
+  unsigned long game_count; /**< The number of games simulated so far. */
+  unsigned long total_game_count; /**< The number of games requested. */
+  double elapsed_seconds; /**< The time since the simulation started. */
+  double games_per_second; /**< The average throughput so far. */
+  const struct razz_result *partial; /**<
+				      * The outcome counts so far or NULL for a
+				      * sweep.
+				      */
+};
+
+/**
+ * Listens to the progress of a simulation. The listener is invoked from the
+ * thread that started the simulation.
+ *
+ * @param [in] arg your marshalled argument into the listener.
+ * @param [in] progress the snapshot of the simulation, which is valid only
+ *                      during the invocation.
+ */
+typedef void (*progress_listener) (void *arg,
+				   const struct razz_progress *progress);
+
+/**
+ * The number of games a plan runner deals before evaluating any of them by
+ * default, which keeps the arrays of a batch within the L1 data cache.
+ */
+#define DEFAULT_GAME_BATCH_SIZE 1024
+
+/** The options controlling how a simulation is run. */
+struct simulation_options
+{
+  enum deal_mode deal_mode; /**< How the missing cards are dealt. */
+  enum deck_kind deck_kind; /**< What kind of deck is dealt from. */
+  enum game_variant variant; /**<
+			      * The game whose outcome is counted. Variants
+			      * other than ::GAME_RAZZ are only run by a
+			      * context.
+			      */
+  progress_listener progress_listener; /**<
+					* The listener of the progress or NULL.
+					* It is invoked whenever one of the
+					* intervals below has passed and once
+					* more at the end.
+					*/
+  void *progress_arg; /**< Your marshalled argument into the listener. */
+  unsigned long progress_interval_games; /**<
+					  * The number of games between two
+					  * progress reports or 0.
+					  */
+  unsigned long progress_interval_ms; /**<
+				       * The number of milliseconds between two
+				       * progress reports or 0.
+				       */
+  const volatile sig_atomic_t *cancel_flag; /**<
+					     * The flag that stops the
+					     * simulation early once it is set
+					     * to non-zero (e.g., from another
+					     * thread or a signal handler) or
+					     * NULL.
+					     */
+  struct perf_counts *perf_counts; /**<
+				    * The counts to which every thread
+				    * running the games adds the hardware
+				    * events counted during the games or
+				    * NULL. A thread that cannot open its
+				    * counters marks the events missing.
+				    */
+  razz_tracer *tracer; /**<
+			* The tracer of the runs and, in a context, of the
+			* queries, their chunks and merges or NULL.
+			*/
+  uint64_t counter_key; /**<
+			 * The key of a counter-based generator dealing game
+			 * i of the run from its stream first_game_index + i
+			 * or 0 to deal from a generator per thread. With a
+			 * key, the outcome counts are the same whatever the
+			 * number of threads or the split of the games into
+			 * runs.
+			 */
+  uint64_t first_game_index; /**<
+			      * The index of the first game of the run in the
+			      * streams of ::counter_key (e.g., the games
+			      * already run by earlier shards).
+			      */
+  unsigned int batch_size; /**<
+			    * The number of games a context deals before
+			    * evaluating any of them or 0 for
+			    * ::DEFAULT_GAME_BATCH_SIZE. The counts do not
+			    * depend on it.
+			    */
+};
+
+/**
+ * Sets the options of a simulation to the default values.
+ *
+ * @param [out] options the options to be initialized.
+ */
+void
+init_simulation_options (struct simulation_options *options);
+
+/**
+ * Runs a Razz game for a number of times with the given options reporting
+ * the outcome of each game to the given listeners. The simulation stops early
+ * with ::RAZZ_CANCELLED if the cancel flag of the options is set, in which
+ * case the listeners have seen the games simulated until then. The progress
+ * listener of the options receives the outcome counts so far.
+ *
+ * @param [in] decided_cards the cards that will not be included in the simulated
+ *                           dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] options the options of the simulation or NULL for the default
+ *                     options.
+ * @param [in] arg your marshalled argument into the listeners.
+ * @param [in] r_listener the callback function that will be invoked with the
+ *                        rank of my hand at the end of each game or NULL.
+ * @param [in] l_listener the callback function that will be invoked with the
+ *                        Razz low index of my hand at the end of each game or
+ *                        NULL.
+ *
+ * @return 0 if the simulation encounters no error, ::RAZZ_CANCELLED if it is
+ *         cancelled or another non-zero value if it encounters an error.
+ */
+int
+simulate_razz_game_with_options (const struct decided_cards *decided_cards,
+				 unsigned long game_count,
+				 const struct simulation_options *options,
+				 void *arg,
+				 rank_listener r_listener,
+				 low_listener l_listener);
+
+/**
+ * Runs a packed scenario like simulate_razz_game_with_options() does.
+ *
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] options the options of the simulation or NULL for the default
+ *                     options.
+ * @param [in] arg your marshalled argument into the listeners.
+ * @param [in] r_listener the listener of the rank of my hand or NULL.
+ * @param [in] l_listener the listener of the Razz low index of my hand or
+ *                        NULL.
+ *
+ * @return 0 if the simulation encounters no error, ::RAZZ_CANCELLED if it is
+ *         cancelled or another non-zero value if it encounters an error
+ *         (e.g., the scenario is invalid).
+ */
+int
+simulate_razz_scenario (const struct razz_scenario *scenario,
+			unsigned long game_count,
+			const struct simulation_options *options,
+			void *arg,
+			rank_listener r_listener,
+			low_listener l_listener);
+
+/**
+ * Runs a grid of scenarios on common random numbers: every deal completes the
+ * hands of all scenarios at once and is evaluated for every scenario whose
+ * known cards it does not hit. A deal that hits the known cards of a scenario
+ * is rejected for that scenario only, so every scenario still sees uniformly
+ * random completions while the differences between the scenarios are much
+ * less noisy than those of separate runs. The cards are dealt from a suited
+ * deck stripped of the cards known in every scenario, so the deck kind of the
+ * options is ignored. The progress listener receives no partial result.
+ *
+ * @param [in] scenarios the valid scenarios of the grid.
+ * @param [in] scenario_count the number of scenarios.
+ * @param [in] deal_count the number of deals, which bounds the number of games
+ *                        of every scenario.
+ * @param [in] options the options of the sweep or NULL for the default
+ *                     options.
+ * @param [out] results the outcome counts of each scenario whose game count
+ *                      is the number of deals accepted by the scenario.
+ *
+ * @return 0 if the sweep encounters no error, ::RAZZ_CANCELLED if it is
+ *         cancelled or another non-zero value if it encounters an error.
+ */
+int
+simulate_razz_sweep (const struct razz_scenario *scenarios,
+		     unsigned int scenario_count,
+		     unsigned long deal_count,
+		     const struct simulation_options *options,
+		     struct razz_result *results);
+
+/**
+ * Runs a Razz game for a number of times with the default options.
  *
  * @param [in] decided_cards the cards that will not be included in the simulated
  *                           dealing.
@@ -65,6 +457,407 @@ simulate_razz_game (const struct decided_cards *decided_cards,
 		    void *arg,
 		    rank_listener listener);
 
+/**
+ * Runs a Razz game for a number of times with the default options reporting
+ * the Razz low index of my hand instead of its rank.
+ *
+ * @param [in] decided_cards the cards that will not be included in the simulated
+ *                           dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] arg your marshalled argument into the listener.
+ * @param [in] listener the callback function that will be invoked with the
+ *                      Razz low index of my hand at the end of each game.
+ *
+ * @return 0 if the simulation encounters no error or non-zero if it encounters
+ *         one.
+ */
+int
+simulate_razz_game_low (const struct decided_cards *decided_cards,
+			unsigned long game_count,
+			void *arg,
+			low_listener listener);
+
+/** The first hand on which a fast path disagrees with the reference. */
+struct razz_mismatch
+{
+  enum card_suit_rank cards[7]; /**< The hand in the order it was dealt. */
+  const char *path; /**< The name of the disagreeing fast path. */
+  int reference; /**< The value given by the reference path. */
+  int fast; /**< The value given by the fast path. */
+};
+
+/**
+ * Runs the reference pipeline side by side with the fast paths on the same
+ * seven-card hands and stops at the first hand on which they disagree. The
+ * reference evaluates each of the C(7, 5) five-card subsets of a hand by the
+ * rules and keeps the best Razz low, paired or not, and the best stud high
+ * category. The fast paths are the rank-sorted insertion of the hand, the
+ * Razz low index and rank computed from the hand and from its rank counts,
+ * the batch evaluator of the plan runners, the stud high and the hi/lo8
+ * evaluators, the combination dealer and, after every random hand, the ranks
+ * dealt from a rank deck stripped of the hand, which must be those that a
+ * deck of the remaining cards in rank order deals from a twin stream. A
+ * mismatching Razz low is reported as its ::razz_low_category followed by its
+ * five ranks in base ::RANK_COUNT.
+ *
+ * @param [in] is_exhaustive non-zero to check every multiset of seven ranks,
+ *                           which covers every distinct input of the rank
+ *                           based evaluators.
+ * @param [in] random_count the number of random hands to check dealt with
+ *                          deal_combination_from_deck().
+ * @param [in] seed the seed of the random hands.
+ * @param [out] mismatch the first hand that disagrees, whose path is NULL if
+ *                       the verification cannot run.
+ * @param [out] checked_count the number of hands checked or NULL.
+ *
+ * @return 0 if every hand agrees or non-zero otherwise.
+ */
+int
+verify_razz_evaluators (int is_exhaustive, unsigned long random_count,
+			uint64_t seed, struct razz_mismatch *mismatch,
+			unsigned long *checked_count);
+
+/** The outcome counts of a number of simulated games. */
+struct razz_result
+{
+  unsigned long game_count; /**< The number of simulated games. */
+  unsigned long rank_counts[RANK_COUNT]; /**<
+					  * The number of games in which my
+					  * hand has the rank at the index.
+					  */
+  unsigned long invalid_rank_count; /**<
+				     * The number of games in which my hand
+				     * is worse than K (i.e., paired).
+				     */
+  unsigned long low_counts[RAZZ_LOW_INDEX_COUNT]; /**<
+						   * The number of games in
+						   * which my hand has the
+						   * Razz low index at the
+						   * index.
+						   */
+  unsigned long high_counts[HIGH_CATEGORY_COUNT]; /**<
+						   * The number of games in
+						   * which my hand has the
+						   * stud high category at
+						   * the index.
+						   */
+  unsigned long qualified_low_count; /**<
+				      * The number of games in which my hand
+				      * has an eight-or-better low.
+				      */
+};
+
+/**
+ * Sets all counts of a result to zero.
+ *
+ * @param [out] result the result to be cleared.
+ */
+void
+clear_razz_result (struct razz_result *result);
+
+/** The options of a simulation context. */
+struct razz_ctx_options
+{
+  unsigned int thread_count; /**<
+			      * The number of worker threads or 0 to use one
+			      * worker per online CPU.
+			      */
+  unsigned long chunk_size; /**<
+			     * The number of games that a worker runs at once
+			     * before taking more work.
+			     */
+  uint64_t seed; /**<
+		  * The seed from which the random stream of each worker is
+		  * derived or 0 to draw one from lrand48().
+		  */
+  int pin_threads; /**<
+		    * Non-zero to pin every worker to a CPU spreading the
+		    * workers over the sockets found in sysfs. The workers then
+		    * allocate their scratch state on their own CPU and merge
+		    * their counts per socket before merging across sockets.
+		    * A thread count of 0 then means one worker per usable CPU.
+		    */
+  int avoid_smt; /**<
+		  * Non-zero to pin the workers only to the first SMT sibling
+		  * of every core. It is only used when the workers are pinned.
+		  */
+  struct simulation_options simulation; /**< How the games are run. */
+};
+
+/**
+ * Sets the options of a simulation context to the default values.
+ *
+ * @param [out] options the options to be initialized.
+ */
+void
+init_razz_ctx_options (struct razz_ctx_options *options);
+
+/**
+ * A simulation context owning worker threads together with their random
+ * streams and scratch decks, so that the setup cost is paid once and the warm
+ * state is reused across many runs. A context can be used by several threads
+ * at once.
+ */
+typedef struct razz_ctx_impl razz_ctx;
+
+/**
+ * Creates a simulation context and starts its workers. The returned context
+ * has to be freed with razz_ctx_destroy().
+ *
+ * @param [in] options the options of the context or NULL for the default.
+ *
+ * @return the context or NULL if it cannot be created.
+ */
+razz_ctx *
+razz_ctx_create (const struct razz_ctx_options *options);
+
+/**
+ * Runs a Razz game for a number of times on the workers of a context and
+ * waits for the result.
+ *
+ * @param [in] ctx the context whose workers run the games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [out] result the outcome counts of the games.
+ *
+ * @return 0 if the simulation encounters no error or non-zero if it encounters
+ *         one.
+ */
+int
+razz_ctx_run (razz_ctx *ctx, const struct decided_cards *scenario,
+	      unsigned long game_count, struct razz_result *result);
+
+/**
+ * Runs a Razz game for a number of times on the workers of a context like
+ * razz_ctx_run() but with the given options instead of those of the context.
+ * The progress listener of the options receives the partial result. If the
+ * cancel flag of the options is set, no more chunks are started and the
+ * result holds the games of the chunks already started.
+ *
+ * @param [in] ctx the context whose workers run the games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] options the options of this run.
+ * @param [out] result the outcome counts of the games.
+ *
+ * @return 0 if the simulation encounters no error, ::RAZZ_CANCELLED if it is
+ *         cancelled or another non-zero value if it encounters an error.
+ */
+int
+razz_ctx_run_with_options (razz_ctx *ctx, const struct decided_cards *scenario,
+			   unsigned long game_count,
+			   const struct simulation_options *options,
+			   struct razz_result *result);
+
+/**
+ * Runs a packed scenario on the workers of a context like
+ * razz_ctx_run_with_options() does.
+ *
+ * @param [in] ctx the context whose workers run the games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated.
+ * @param [in] options the options of this run or NULL to use those of the
+ *                     context.
+ * @param [out] result the outcome counts of the games.
+ *
+ * @return 0 if the simulation encounters no error, ::RAZZ_CANCELLED if it is
+ *         cancelled or another non-zero value if it encounters an error.
+ */
+int
+razz_ctx_run_scenario (razz_ctx *ctx, const struct razz_scenario *scenario,
+		       unsigned long game_count,
+		       const struct simulation_options *options,
+		       struct razz_result *result);
+
+/** A query running in the background on the workers of a context. */
+typedef struct razz_job_impl razz_job;
+
+/**
+ * Submits a Razz game to be run for a number of times on the workers of a
+ * context without waiting for the games to finish. This lets an event loop
+ * keep many queries in flight on one pool of workers. The progress listener
+ * of the options is not used; use razz_poll() instead. All jobs of a context
+ * must be destroyed before the context is.
+ *
+ * @param [in] ctx the context whose workers run the games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated, which must
+ *                        not be 0.
+ * @param [in] options the options of this job or NULL to use those of the
+ *                     context. The cancel flag, if any, must outlive the job.
+ *
+ * @return the job or NULL if it cannot be created.
+ */
+razz_job *
+razz_submit (razz_ctx *ctx, const struct decided_cards *scenario,
+	     unsigned long game_count,
+	     const struct simulation_options *options);
+
+/**
+ * Submits a packed scenario like razz_submit() does.
+ *
+ * @param [in] ctx the context whose workers run the games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of Razz games to be simulated, which must
+ *                        not be 0.
+ * @param [in] options the options of this job or NULL to use those of the
+ *                     context.
+ *
+ * @return the job or NULL if it cannot be created.
+ */
+razz_job *
+razz_submit_scenario (razz_ctx *ctx, const struct razz_scenario *scenario,
+		      unsigned long game_count,
+		      const struct simulation_options *options);
+
+/**
+ * Returns the eventfd of a job, which becomes readable once the job is
+ * finished. The descriptor can be added to epoll or poll and is owned by the
+ * job, so it must not be closed.
+ *
+ * @param [in] job the job whose descriptor is returned.
+ *
+ * @return the eventfd of the job.
+ */
+int
+razz_job_fd (const razz_job *job);
+
+/**
+ * Checks whether or not a job is finished without blocking.
+ *
+ * @param [in] job the job to be checked.
+ * @param [out] game_count the number of games simulated so far or NULL.
+ *
+ * @return non-zero if the job is finished or 0 otherwise.
+ */
+int
+razz_poll (razz_job *job, unsigned long *game_count);
+
+/**
+ * Waits for a job to finish.
+ *
+ * @param [in] job the job to be waited for.
+ * @param [in] timeout_ms the longest time to wait in milliseconds, 0 to not
+ *                        wait at all or a negative value to wait without any
+ *                        time limit.
+ *
+ * @return non-zero if the job is finished or 0 if the time is up.
+ */
+int
+razz_wait (razz_job *job, long timeout_ms);
+
+/**
+ * Stops a job from starting more games. The job finishes once the chunks of
+ * games already started are done.
+ *
+ * @param [in] job the job to be cancelled.
+ */
+void
+razz_cancel (razz_job *job);
+
+/**
+ * Retrieves the outcome counts of a finished job.
+ *
+ * @param [in] job the job whose result is retrieved.
+ * @param [out] result the outcome counts of the games of the job.
+ *
+ * @return 0 if the job has run all games, ::RAZZ_CANCELLED if it was
+ *         cancelled or another non-zero value if it is not finished yet.
+ */
+int
+razz_job_result (razz_job *job, struct razz_result *result);
+
+/**
+ * Cancels a job, waits for it to finish and reclaims the memory space that
+ * was allocated for it as well as setting the pointer to NULL as a safe guard.
+ *
+ * @param [in] job the job to be destroyed.
+ */
+void
+razz_job_destroy (razz_job **job);
+
+/** The number of finite buckets of the query latency histogram. */
+#define RAZZ_LATENCY_BUCKET_COUNT 20
+
+/**
+ * The upper bound in microseconds of a bucket of the query latency histogram.
+ * The bounds double from 100 us, so the last finite bucket ends at about 52 s.
+ */
+#define RAZZ_LATENCY_BUCKET_BOUND_US(bucket) (100UL << (bucket))
+
+/**
+ * The counters of a context as a whole. The counters only grow except for
+ * those of the work still pending.
+ */
+struct razz_ctx_metrics
+{
+  unsigned int worker_count; /**< The number of workers. */
+  unsigned long game_count; /**< The games run by all workers. */
+  unsigned long queued_query_count; /**< The queries queued so far. */
+  unsigned long finished_query_count; /**<
+				       * The queries finished so far, which
+				       * never exceed the queued ones.
+				       */
+  unsigned long pending_chunk_count; /**<
+				      * The chunks queued but not finished
+				      * yet, which is the depth of the work
+				      * queue.
+				      */
+  /**
+   * The number of finished queries whose latency falls into each bucket, the
+   * last one being unbounded.
+   */
+  unsigned long latency_counts[RAZZ_LATENCY_BUCKET_COUNT + 1];
+  double latency_sum; /**< The total latency of the queries in seconds. */
+};
+
+/** The counters of a worker of a context, which only grow. */
+struct razz_worker_metrics
+{
+  unsigned long game_count; /**< The games run by the worker. */
+  unsigned long chunk_count; /**< The chunks run by the worker. */
+  double busy_time; /**< The seconds spent running chunks. */
+};
+
+/**
+ * Reads the counters of a context. Every worker updates its own counters
+ * without any lock, so reading them does not slow the workers down, but the
+ * counters of different workers may be read at slightly different times.
+ *
+ * @param [in] ctx the context whose counters are read.
+ * @param [out] metrics the counters of the context.
+ */
+void
+razz_ctx_get_metrics (razz_ctx *ctx, struct razz_ctx_metrics *metrics);
+
+/**
+ * Reads the counters of a worker of a context.
+ *
+ * @param [in] ctx the context of the worker.
+ * @param [in] worker the index of the worker, which must be less than the
+ *                    number of workers of the context.
+ * @param [out] metrics the counters of the worker.
+ */
+void
+razz_ctx_get_worker_metrics (razz_ctx *ctx, unsigned int worker,
+			     struct razz_worker_metrics *metrics);
+
+/**
+ * Stops the workers of a context and reclaims the memory space that was
+ * allocated for it as well as setting the pointer to NULL as a safe guard.
+ * No run may be in progress. Passing a pointer to NULL is safe but not a NULL
+ * pointer.
+ *
+ * @param [in] ctx_ptr the pointer pointing to the context to be freed.
+ */
+void
+razz_ctx_destroy (razz_ctx **ctx_ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,1065 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <assert.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "card.h"
+#include "razz_simulation.h"
+#include "cpu_topology.h"
+#include "perf_counters.h"
+#include "razz_store.h"
+#include "razz_metrics.h"
+
+static void
+fill_rank_counts (uint8_t rank_counts[RANK_COUNT],
+		  const enum card_rank *ranks, int count)
+{
+  int i;
+
+  memset (rank_counts, 0, RANK_COUNT * sizeof (*rank_counts));
+  for (i = 0; i < count; i++)
+    {
+      rank_counts[ranks[i]]++;
+    }
+}
+
+static unsigned int
+get_low_index (const enum card_rank *ranks, int count)
+{
+  uint8_t rank_counts[RANK_COUNT];
+
+  fill_rank_counts (rank_counts, ranks, count);
+
+  return get_razz_low_index_of_counts (rank_counts);
+}
+
+/** The state of the progress listener of the test. */
+struct progress_check
+{
+  unsigned int report_count;
+  unsigned long game_count;
+  unsigned long cancel_at;
+  volatile sig_atomic_t cancel_flag;
+};
+
+static void
+count_low (void *arg, unsigned int low_index)
+{
+  unsigned long *low_counts = arg;
+
+  low_counts[low_index]++;
+}
+
+static void
+check_progress (void *arg, const struct razz_progress *progress)
+{
+  struct progress_check *check = arg;
+
+  assert (progress->game_count >= check->game_count);
+  assert (progress->game_count <= progress->total_game_count);
+  assert (progress->partial != NULL);
+  assert (progress->partial->game_count == progress->game_count);
+
+  check->report_count++;
+  check->game_count = progress->game_count;
+  if (check->game_count >= check->cancel_at)
+    {
+      check->cancel_flag = 1;
+    }
+}
+
+/** Another process topping up the store while a top-up is simulating. */
+struct concurrent_top_up
+{
+  razz_store *store;
+  const struct razz_scenario *scenario;
+  int is_done;
+};
+
+static void
+top_up_concurrently (void *arg, const struct razz_progress *progress)
+{
+  struct concurrent_top_up *other = arg;
+  struct razz_result stored;
+  int rc;
+
+  if (other->is_done)
+    {
+      return;
+    }
+  other->is_done = 1;
+
+  razz_store_lookup (other->store, other->scenario, GAME_RAZZ, &stored);
+  stored.game_count += 500;
+  stored.rank_counts[R5] += 500;
+  rc = razz_store_append (other->store, other->scenario, GAME_RAZZ, &stored);
+  assert (rc == 0);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  int i;
+  int rc;
+  unsigned int idx;
+  enum razz_low_category cat;
+  enum razz_low_category prev_cat;
+  enum card_rank prev_ranks[5];
+  enum card_rank ranks[5];
+  uint8_t rank_counts[RANK_COUNT];
+  card_hand *h;
+  const card *cards[7];
+
+  /* Known lows */
+  {
+    const enum card_rank wheel[] = {R5, R4, R3, R2, ACE};
+    const enum card_rank rough_8[] = {R8, R7, R6, R5, R4, K, K};
+    const enum card_rank smooth_8[] = {R8, R4, R3, R2, ACE, Q, J};
+    const enum card_rank aces[] = {ACE, ACE, R2, R3, R4};
+    const enum card_rank kings[] = {K, K, R2, R3, R4};
+    const enum card_rank too_few[] = {ACE, R2, R3, R4};
+
+    assert (get_low_index (wheel, 5) == 0);
+    assert (get_low_index (smooth_8, 7) < get_low_index (rough_8, 7));
+    assert (get_low_index (rough_8, 7) < get_low_index (aces, 5));
+    assert (get_low_index (aces, 5) < get_low_index (kings, 5));
+    assert (get_low_index (too_few, 4) == RAZZ_LOW_INDEX_COUNT);
+
+    cat = get_razz_low_ranks (get_low_index (rough_8, 7), ranks);
+    assert (cat == LOW_NO_PAIR);
+    assert (memcmp (ranks, rough_8, sizeof (ranks)) == 0);
+    cat = get_razz_low_ranks (get_low_index (kings, 5), ranks);
+    assert (cat == LOW_ONE_PAIR);
+    assert (ranks[0] == K && ranks[1] == K && ranks[2] == R4
+	    && ranks[3] == R3 && ranks[4] == R2);
+  }
+
+  /* The best five cards out of seven */
+  {
+    const enum card_rank two_pair[] = {R9, R9, R3, R3, J, J, J};
+    const enum card_rank two_pair_best[] = {R9, R9, R3, R3, J};
+    const enum card_rank full_house[] = {R7, R7, R7, R7, R2, R2, R2};
+    const enum card_rank full_house_best[] = {R2, R2, R2, R7, R7};
+
+    cat = get_razz_low_ranks (get_low_index (two_pair, 7), ranks);
+    assert (cat == LOW_TWO_PAIR);
+    assert (memcmp (ranks, two_pair_best, sizeof (ranks)) == 0);
+    cat = get_razz_low_ranks (get_low_index (full_house, 7), ranks);
+    assert (cat == LOW_FULL_HOUSE);
+    assert (memcmp (ranks, full_house_best, sizeof (ranks)) == 0);
+  }
+
+  /* Dense and totally ordered */
+  cat = get_razz_low_ranks (RAZZ_LOW_INDEX_COUNT, ranks);
+  assert (cat == LOW_CATEGORY_COUNT);
+  prev_cat = LOW_NO_PAIR;
+  for (idx = 0; idx < RAZZ_LOW_INDEX_COUNT; idx++)
+    {
+      cat = get_razz_low_ranks (idx, ranks);
+      assert (cat != LOW_CATEGORY_COUNT);
+      assert (get_low_index (ranks, 5) == idx);
+      if (idx > 0)
+	{
+	  assert (cat > prev_cat
+		  || (cat == prev_cat
+		      && memcmp (prev_ranks, ranks, sizeof (ranks)) < 0));
+	}
+
+      prev_cat = cat;
+      memcpy (prev_ranks, ranks, sizeof (ranks));
+    }
+
+  /* Hand */
+  h = create_hand (7, sort_card_by_rank);
+  assert (h != NULL);
+  cards[0] = create_card (CLUB_8);
+  cards[1] = create_card (SPADE_4);
+  cards[2] = create_card (HEART_4);
+  cards[3] = create_card (DIAMOND_2);
+  cards[4] = create_card (SPADE_ACE);
+  cards[5] = create_card (HEART_3);
+  cards[6] = create_card (CLUB_K);
+  for (i = 0; i < 7; i++)
+    {
+      assert (cards[i] != NULL);
+      insert_into_hand (h, cards[i]);
+    }
+  count_ranks_in_hand (h, rank_counts);
+  assert (rank_counts[R4] == 2 && rank_counts[K] == 1 && rank_counts[R5] == 0);
+  cat = get_razz_low_ranks (get_razz_low_index (h), ranks);
+  assert (cat == LOW_NO_PAIR);
+  assert (ranks[0] == R8 && ranks[4] == ACE);
+  destroy_hand (&h);
+  for (i = 0; i < 7; i++)
+    {
+      destroy_card (&cards[i]);
+    }
+
+  /* The fast evaluators agree with the reference */
+  {
+    struct razz_mismatch mismatch;
+    unsigned long checked_count;
+
+    rc = verify_razz_evaluators (1, 20000, 3, &mismatch, &checked_count);
+    assert (rc == 0);
+    assert (checked_count > 20000);
+  }
+
+  /* Simulation context */
+  {
+    static struct razz_result result;
+    struct razz_ctx_options options;
+    struct decided_cards decided_cards;
+    razz_ctx *ctx;
+    unsigned long sum;
+
+    decided_cards.my_card_count = 3;
+    decided_cards.my_cards[0] = create_card (SPADE_ACE);
+    decided_cards.my_cards[1] = create_card (SPADE_2);
+    decided_cards.my_cards[2] = create_card (SPADE_3);
+    decided_cards.opponent_card_count = 1;
+    decided_cards.opponent_cards[0] = create_card (HEART_ACE);
+
+    init_razz_ctx_options (&options);
+    options.thread_count = 3;
+    options.chunk_size = 1000;
+    options.seed = 3;
+    ctx = razz_ctx_create (&options);
+    assert (ctx != NULL);
+
+    rc = razz_ctx_run (ctx, &decided_cards, 100500, &result);
+    assert (rc == 0);
+    assert (result.game_count == 100500);
+    sum = result.invalid_rank_count;
+    for (i = 0; i < RANK_COUNT; i++)
+      {
+	assert (i >= R5 || result.rank_counts[i] == 0);
+	sum += result.rank_counts[i];
+      }
+    assert (sum == result.game_count);
+    sum = 0;
+    for (idx = 0; idx < RAZZ_LOW_INDEX_COUNT; idx++)
+      {
+	sum += result.low_counts[idx];
+      }
+    assert (sum == result.game_count);
+    /* P(5-4-3-2-A | A-2-3, dead A) is about 7.4% */
+    assert (result.low_counts[0] > 6900 && result.low_counts[0] < 8000);
+
+    rc = razz_ctx_run (ctx, &decided_cards, 0, &result);
+    assert (rc == 0);
+    assert (result.game_count == 0);
+
+    /* Packed scenarios */
+    {
+      struct razz_scenario scenario;
+      struct razz_scenario invalid;
+      struct decided_cards unpacked;
+      const card *ace;
+      razz_job *job;
+
+      rc = pack_decided_cards (&decided_cards, &scenario);
+      assert (rc == 0);
+      assert (scenario.my_mask == (RAZZ_CARD_BIT (SPADE_ACE)
+				   | RAZZ_CARD_BIT (SPADE_2)
+				   | RAZZ_CARD_BIT (SPADE_3)));
+      assert (scenario.known_mask == (scenario.my_mask
+				      | RAZZ_CARD_BIT (HEART_ACE)));
+      assert (is_valid_razz_scenario (&scenario));
+
+      rc = unpack_razz_scenario (&scenario, &unpacked);
+      assert (rc == 0);
+      assert (unpacked.my_card_count == 3 && unpacked.opponent_card_count == 1);
+      assert (get_card_suit_rank (unpacked.opponent_cards[0]) == HEART_ACE);
+      release_decided_cards (&unpacked);
+      assert (unpacked.my_card_count == 0);
+
+      ace = decided_cards.opponent_cards[0];
+      decided_cards.opponent_cards[0] = decided_cards.my_cards[0];
+      rc = pack_decided_cards (&decided_cards, &invalid);
+      assert (rc != 0);
+      job = razz_submit (ctx, &decided_cards, 1000, NULL);
+      assert (job == NULL);
+      decided_cards.opponent_cards[0] = ace;
+
+      invalid.known_mask = RAZZ_CARD_BIT (HEART_2);
+      invalid.my_mask = RAZZ_CARD_BIT (SPADE_2);
+      assert (!is_valid_razz_scenario (&invalid));
+      rc = unpack_razz_scenario (&invalid, &unpacked);
+      assert (rc != 0);
+      rc = razz_ctx_run_scenario (ctx, &invalid, 1000, NULL, &result);
+      assert (rc != 0);
+      invalid.known_mask = ~(uint64_t) 0 >> (64 - CARD_COUNT);
+      invalid.my_mask = 0;
+      assert (!is_valid_razz_scenario (&invalid));
+
+      rc = razz_ctx_run_scenario (ctx, &scenario, 100500, NULL, &result);
+      assert (rc == 0);
+      assert (result.game_count == 100500);
+      assert (result.low_counts[0] > 6900 && result.low_counts[0] < 8000);
+    }
+
+    /* Stud variants */
+    {
+      struct razz_scenario scenario = {0, 0};
+      struct simulation_options sim_options;
+      uint8_t counts[RANK_COUNT] = {0};
+      uint16_t suits[SUIT_COUNT] = {0};
+      unsigned long qualified_count;
+
+      /* A wheel with a flush draw is a straight */
+      counts[ACE] = counts[R2] = counts[R3] = counts[R4] = counts[R5] = 1;
+      suits[SPADE] = 1 << ACE | 1 << R2 | 1 << R3 | 1 << R4;
+      suits[HEART] = 1 << R5;
+      assert (get_stud_high_category (counts, suits) == HIGH_STRAIGHT);
+      /* Broadway in hearts */
+      memset (counts, 0, sizeof (counts));
+      counts[R10] = counts[J] = counts[Q] = counts[K] = counts[ACE] = 1;
+      counts[R2] = 2;
+      suits[SPADE] = 1 << R2;
+      suits[HEART] = 1 << R10 | 1 << J | 1 << Q | 1 << K | 1 << ACE;
+      suits[DIAMOND] = 1 << R2;
+      assert (get_stud_high_category (counts, suits) == HIGH_STRAIGHT_FLUSH);
+      /* Two trips make a full house */
+      memset (counts, 0, sizeof (counts));
+      memset (suits, 0, sizeof (suits));
+      counts[R9] = counts[R4] = 3;
+      counts[K] = 1;
+      suits[SPADE] = 1 << R9 | 1 << R4 | 1 << K;
+      suits[HEART] = suits[DIAMOND] = 1 << R9 | 1 << R4;
+      assert (get_stud_high_category (counts, suits) == HIGH_FULL_HOUSE);
+      counts[R4] = 2;
+      counts[R9] = 1;
+      counts[R2] = 2;
+      assert (get_stud_high_category (counts, suits) == HIGH_TWO_PAIR);
+
+      /* Seven random cards make one pair about 43.8% of the time */
+      init_simulation_options (&sim_options);
+      sim_options.variant = GAME_STUD_HIGH;
+      rc = razz_ctx_run_scenario (ctx, &scenario, 100000, &sim_options,
+				  &result);
+      assert (rc == 0);
+      sum = 0;
+      for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+	{
+	  sum += result.high_counts[i];
+	}
+      assert (sum == result.game_count && result.game_count == 100000);
+      assert (result.high_counts[HIGH_ONE_PAIR] > 42800
+	      && result.high_counts[HIGH_ONE_PAIR] < 44800);
+      assert (result.high_counts[HIGH_FLUSH] > 2600
+	      && result.high_counts[HIGH_FLUSH] < 3500);
+      assert (result.low_counts[0] == 0);
+
+      sim_options.variant = GAME_STUD_HILO8;
+      rc = razz_ctx_run_scenario (ctx, &scenario, 20000, &sim_options,
+				  &result);
+      assert (rc == 0);
+      /* The eight-or-better lows are the first C(8, 5) Razz low indices */
+      qualified_count = 0;
+      for (idx = 0; idx < 56; idx++)
+	{
+	  qualified_count += result.low_counts[idx];
+	}
+      assert (qualified_count == result.qualified_low_count);
+      assert (qualified_count > 0);
+
+      sim_options.deck_kind = RANK_DECK;
+      rc = razz_ctx_run_scenario (ctx, &scenario, 1000, &sim_options,
+				  &result);
+      assert (rc != 0);
+      sim_options.deck_kind = SUITED_DECK;
+      rc = simulate_razz_scenario (&scenario, 1000, &sim_options, NULL, NULL,
+				   NULL);
+      assert (rc != 0);
+    }
+
+    /* Sweeps on common random numbers */
+    {
+      static struct razz_result results[3];
+      struct razz_scenario cells[3];
+      unsigned long k;
+
+      rc = pack_decided_cards (&decided_cards, &cells[0]);
+      assert (rc == 0);
+      cells[1] = cells[0];
+      /* Another opponent upcard rejects the deals hitting it */
+      cells[2] = cells[0];
+      cells[2].known_mask |= RAZZ_CARD_BIT (CLUB_4);
+
+      rc = simulate_razz_sweep (cells, 3, 50000, NULL, results);
+      assert (rc == 0);
+      assert (results[0].game_count == 50000);
+      assert (memcmp (&results[0], &results[1], sizeof (results[0])) == 0);
+      assert (results[2].game_count < 50000);
+      /* P(no C4 among four of 48 cards) = 44/48 */
+      assert (results[2].game_count > 50000 * 905 / 1000
+	      && results[2].game_count < 50000 * 928 / 1000);
+      sum = 0;
+      for (k = 0; k < RAZZ_LOW_INDEX_COUNT; k++)
+	{
+	  sum += results[2].low_counts[k];
+	}
+      assert (sum == results[2].game_count);
+
+      /* My hands of different sizes share the dealt cards one by one */
+      cells[1].my_mask &= ~RAZZ_CARD_BIT (SPADE_3);
+      rc = simulate_razz_sweep (cells, 2, 20000, NULL, results);
+      assert (rc == 0);
+      assert (results[0].game_count == 20000);
+      assert (results[1].game_count == 20000);
+
+      cells[1].my_mask = RAZZ_CARD_BIT (HEART_K);
+      rc = simulate_razz_sweep (cells, 2, 1000, NULL, results);
+      assert (rc != 0);
+    }
+
+    /* Hardware counters, which may not be permitted */
+    {
+      struct simulation_options sim_options;
+      struct perf_counts counts;
+
+      memset (&counts, 0, sizeof (counts));
+      init_simulation_options (&sim_options);
+      sim_options.perf_counts = &counts;
+      rc = simulate_razz_game_with_options (&decided_cards, 20000,
+					    &sim_options, NULL, NULL, NULL);
+      assert (rc == 0);
+      assert (counts.game_count == 20000);
+      assert ((counts.missing_mask & (1 << PERF_INSTRUCTIONS))
+	      || counts.values[PERF_INSTRUCTIONS] > 20000);
+
+      rc = razz_ctx_run_with_options (ctx, &decided_cards, 20500,
+				      &sim_options, &result);
+      assert (rc == 0);
+      assert (counts.game_count == 40500);
+    }
+
+    /* Tracing */
+    {
+      struct simulation_options sim_options;
+      razz_tracer *tracer = razz_tracer_create (0);
+      char path[] = "/tmp/razz_trace_XXXXXX";
+      static char buf[1 << 20];
+      size_t len;
+      FILE *f;
+      int fd;
+      int k;
+
+      assert (tracer != NULL);
+      init_simulation_options (&sim_options);
+      sim_options.tracer = tracer;
+      rc = razz_ctx_run_with_options (ctx, &decided_cards, 20500,
+				      &sim_options, &result);
+      assert (rc == 0);
+      assert (result.game_count == 20500);
+      rc = simulate_razz_game_with_options (&decided_cards, 1000,
+					    &sim_options, NULL, NULL, NULL);
+      assert (rc == 0);
+
+      fd = mkstemp (path);
+      assert (fd != -1);
+      close (fd);
+      rc = razz_tracer_write (tracer, path);
+      assert (rc == 0);
+      f = fopen (path, "r");
+      assert (f != NULL);
+      len = fread (buf, 1, sizeof (buf) - 1, f);
+      assert (len < sizeof (buf) - 1);
+      buf[len] = '\0';
+      fclose (f);
+      unlink (path);
+      assert (strncmp (buf, "{\"traceEvents\"", 14) == 0);
+      assert (strstr (buf, "\"name\":\"chunk\"") != NULL);
+      assert (strstr (buf, "\"name\":\"query\"") != NULL);
+      assert (strstr (buf, "\"name\":\"run\"") != NULL);
+      assert (strstr (buf, "\"thread_name\"") != NULL);
+
+      razz_tracer_destroy (&tracer);
+      assert (tracer == NULL);
+
+      /* A thread switching between tracers keeps one ring in each */
+      {
+	razz_tracer *other = razz_tracer_create (4);
+	const char *span;
+	int span_count = 0;
+
+	tracer = razz_tracer_create (4);
+	assert (tracer != NULL && other != NULL);
+	for (k = 0; k < 10; k++)
+	  {
+	    razz_trace_span (tracer, "test", "switch", razz_trace_now (), k);
+	    razz_trace_span (other, "test", "switch", razz_trace_now (), k);
+	  }
+	rc = razz_tracer_write (tracer, path);
+	assert (rc == 0);
+	f = fopen (path, "r");
+	assert (f != NULL);
+	len = fread (buf, 1, sizeof (buf) - 1, f);
+	buf[len] = '\0';
+	fclose (f);
+	unlink (path);
+	for (span = strstr (buf, "\"ph\":\"X\""); span != NULL;
+	     span = strstr (span + 1, "\"ph\":\"X\""))
+	  {
+	    span_count++;
+	  }
+	assert (span_count == 4);
+	razz_tracer_destroy (&other);
+	razz_tracer_destroy (&tracer);
+      }
+    }
+
+    /* Persistent result store */
+    {
+      struct simulation_options sim_options;
+      struct razz_scenario spades = {0, 0};
+      struct razz_scenario mixed = {0, 0};
+      struct razz_scenario canonical_spades;
+      struct razz_scenario canonical_mixed;
+      struct razz_result stored;
+      char path[] = "/tmp/razz_store_XXXXXX";
+      unsigned long simulated_count;
+      unsigned long sum;
+      razz_store *store;
+      int fd;
+      int k;
+
+      spades.my_mask = (RAZZ_CARD_BIT (SPADE_ACE) | RAZZ_CARD_BIT (SPADE_2)
+			| RAZZ_CARD_BIT (SPADE_3));
+      spades.known_mask = spades.my_mask | RAZZ_CARD_BIT (SPADE_K);
+      mixed.my_mask = (RAZZ_CARD_BIT (HEART_ACE) | RAZZ_CARD_BIT (CLUB_2)
+		       | RAZZ_CARD_BIT (DIAMOND_3));
+      mixed.known_mask = mixed.my_mask | RAZZ_CARD_BIT (CLUB_K);
+      canonicalize_razz_scenario (&spades, GAME_RAZZ, &canonical_spades);
+      canonicalize_razz_scenario (&mixed, GAME_RAZZ, &canonical_mixed);
+      assert (canonical_spades.my_mask == canonical_mixed.my_mask);
+      assert (canonical_spades.known_mask == canonical_mixed.known_mask);
+      canonicalize_razz_scenario (&mixed, GAME_STUD_HIGH, &canonical_mixed);
+      assert (canonical_mixed.my_mask == mixed.my_mask);
+
+      fd = mkstemp (path);
+      assert (fd != -1);
+      rc = write (fd, "garbage", 7);
+      assert (rc == 7);
+      close (fd);
+      store = razz_store_open (path);
+      assert (store == NULL);
+      unlink (path);
+
+      store = razz_store_open (path);
+      assert (store != NULL);
+      rc = razz_store_lookup (store, &spades, GAME_RAZZ, &stored);
+      assert (rc != 0);
+      assert (stored.game_count == 0);
+
+      init_simulation_options (&sim_options);
+      rc = razz_store_top_up (store, ctx, &spades, 20000, &sim_options,
+			      &result, &simulated_count);
+      assert (rc == 0);
+      assert (simulated_count == 20000);
+      assert (result.game_count == 20000);
+
+      rc = razz_store_top_up (store, ctx, &mixed, 15000, &sim_options,
+			      &result, &simulated_count);
+      assert (rc == 0);
+      assert (simulated_count == 0);
+      assert (result.game_count == 20000);
+
+      rc = razz_store_top_up (store, ctx, &mixed, 30000, &sim_options,
+			      &result, &simulated_count);
+      assert (rc == 0);
+      assert (simulated_count == 10000);
+      assert (result.game_count == 30000);
+      razz_store_close (&store);
+      assert (store == NULL);
+
+      store = razz_store_open (path);
+      assert (store != NULL);
+      rc = razz_store_lookup (store, &spades, GAME_RAZZ, &stored);
+      assert (rc == 0);
+      assert (stored.game_count == 30000);
+      sum = stored.invalid_rank_count;
+      for (k = 0; k < RANK_COUNT; k++)
+	{
+	  assert (stored.rank_counts[k] == result.rank_counts[k]);
+	  sum += stored.rank_counts[k];
+	}
+      assert (sum == 30000);
+      rc = razz_store_lookup (store, &spades, GAME_STUD_HIGH, &stored);
+      assert (rc != 0);
+
+      assert (get_razz_game_count_for_precision (&stored, GAME_RAZZ, 0.01)
+	      == 2501);
+      assert (get_razz_game_count_for_precision (&result, GAME_RAZZ, 0.01)
+	      < 2501);
+      assert (get_razz_game_count_for_precision (&result, GAME_RAZZ, 0)
+	      == 0);
+
+      /* The games of a concurrent top-up are kept */
+      {
+	struct concurrent_top_up other = {NULL, &spades, 0};
+	unsigned long r5_count;
+
+	other.store = razz_store_open (path);
+	assert (other.store != NULL);
+	razz_store_lookup (store, &spades, GAME_RAZZ, &stored);
+	r5_count = stored.rank_counts[R5];
+	sim_options.progress_listener = top_up_concurrently;
+	sim_options.progress_arg = &other;
+	sim_options.progress_interval_games = 1000;
+	rc = razz_store_top_up (store, ctx, &spades, 40000, &sim_options,
+				&result, &simulated_count);
+	assert (rc == 0);
+	assert (other.is_done);
+	assert (simulated_count == 10000);
+	assert (result.game_count == 40500);
+	assert (result.rank_counts[R5] >= r5_count + 500);
+	rc = razz_store_lookup (other.store, &spades, GAME_RAZZ, &stored);
+	assert (rc == 0);
+	assert (memcmp (&stored, &result, offsetof (struct razz_result,
+						     low_counts)) == 0);
+	razz_store_close (&other.store);
+	init_simulation_options (&sim_options);
+      }
+      razz_store_close (&store);
+      unlink (path);
+
+      /* Topping up a seeded run deals the streams after the stored games */
+      {
+	static struct razz_result whole;
+
+	store = razz_store_open (path);
+	assert (store != NULL);
+	sim_options.counter_key = 5;
+	rc = razz_store_top_up (store, ctx, &spades, 1000, &sim_options,
+				&result, NULL);
+	assert (rc == 0);
+	rc = razz_store_top_up (store, ctx, &spades, 2500, &sim_options,
+				&result, &simulated_count);
+	assert (rc == 0);
+	assert (simulated_count == 1500);
+	rc = razz_ctx_run_scenario (ctx, &spades, 2500, &sim_options, &whole);
+	assert (rc == 0);
+	rc = razz_store_lookup (store, &spades, GAME_RAZZ, &stored);
+	assert (rc == 0);
+	assert (memcmp (&stored, &whole, offsetof (struct razz_result,
+						    low_counts)) == 0);
+	razz_store_close (&store);
+	unlink (path);
+      }
+    }
+
+    /* Metrics */
+    {
+      struct razz_ctx_options metered_options;
+      struct razz_ctx_metrics metrics;
+      struct razz_worker_metrics worker_metrics;
+      struct razz_store_metrics store_metrics;
+      struct simulation_options sim_options;
+      struct razz_scenario scenario = {0, 0};
+      char store_path[] = "/tmp/razz_store_XXXXXX";
+      char path[] = "/tmp/razz_metrics_XXXXXX";
+      char tmp_path[64];
+      static char buf[1 << 16];
+      razz_metrics_exporter *exporter;
+      razz_store *store;
+      razz_ctx *metered;
+      razz_job *job;
+      unsigned long sum;
+      size_t len;
+      FILE *f;
+      int fd;
+      int k;
+
+      init_razz_ctx_options (&metered_options);
+      metered_options.thread_count = 2;
+      metered = razz_ctx_create (&metered_options);
+      assert (metered != NULL);
+      razz_ctx_get_metrics (metered, &metrics);
+      assert (metrics.worker_count == 2);
+      assert (metrics.game_count == 0);
+      assert (metrics.queued_query_count == 0);
+
+      rc = razz_ctx_run (metered, &decided_cards, 20500, &result);
+      assert (rc == 0);
+      job = razz_submit (metered, &decided_cards, 3000, NULL);
+      assert (job != NULL);
+      rc = razz_wait (job, -1);
+      assert (rc);
+      razz_job_destroy (&job);
+
+      razz_ctx_get_metrics (metered, &metrics);
+      assert (metrics.game_count == 23500);
+      assert (metrics.queued_query_count == 2);
+      assert (metrics.finished_query_count == 2);
+      assert (metrics.pending_chunk_count == 0);
+      sum = 0;
+      for (k = 0; k <= RAZZ_LATENCY_BUCKET_COUNT; k++)
+	{
+	  sum += metrics.latency_counts[k];
+	}
+      assert (sum == 2);
+      assert (metrics.latency_sum > 0);
+      sum = 0;
+      for (k = 0; k < 2; k++)
+	{
+	  razz_ctx_get_worker_metrics (metered, k, &worker_metrics);
+	  sum += worker_metrics.game_count;
+	}
+      assert (sum == 23500);
+
+      fd = mkstemp (store_path);
+      assert (fd != -1);
+      close (fd);
+      unlink (store_path);
+      store = razz_store_open (store_path);
+      assert (store != NULL);
+      scenario.my_mask = (RAZZ_CARD_BIT (SPADE_ACE) | RAZZ_CARD_BIT (SPADE_2)
+			  | RAZZ_CARD_BIT (SPADE_3));
+      scenario.known_mask = scenario.my_mask;
+      init_simulation_options (&sim_options);
+      rc = razz_store_top_up (store, metered, &scenario, 1000, &sim_options,
+			      &result, NULL);
+      assert (rc == 0);
+      rc = razz_store_top_up (store, metered, &scenario, 1000, &sim_options,
+			      &result, NULL);
+      assert (rc == 0);
+      razz_store_get_metrics (store, &store_metrics);
+      assert (store_metrics.hit_count == 1);
+      assert (store_metrics.miss_count == 1);
+      assert (store_metrics.reused_game_count == 1000);
+      assert (store_metrics.simulated_game_count == 1000);
+
+      fd = mkstemp (path);
+      assert (fd != -1);
+      close (fd);
+      rc = razz_metrics_write (path, metered, store);
+      assert (rc == 0);
+      snprintf (tmp_path, sizeof (tmp_path), "%s.%ld.tmp", path,
+		(long) getpid ());
+      assert (access (tmp_path, F_OK) != 0);
+      f = fopen (path, "r");
+      assert (f != NULL);
+      len = fread (buf, 1, sizeof (buf) - 1, f);
+      assert (len < sizeof (buf) - 1);
+      buf[len] = '\0';
+      fclose (f);
+      assert (strstr (buf, "# TYPE razz_games_total counter\n") != NULL);
+      assert (strstr (buf, "\nrazz_games_total 24500\n") != NULL);
+      assert (strstr (buf, "\nrazz_queries_pending 0\n") != NULL);
+      assert (strstr (buf, "razz_worker_games_total{worker=\"1\"}") != NULL);
+      assert (strstr (buf,
+		      "razz_query_latency_seconds_bucket{le=\"+Inf\"} 3\n")
+	      != NULL);
+      assert (strstr (buf, "razz_store_top_ups_total{result=\"hit\"} 1\n")
+	      != NULL);
+
+      unlink (path);
+      exporter = razz_metrics_exporter_create (path, 5, metered, NULL);
+      assert (exporter != NULL);
+      rc = razz_ctx_run (metered, &decided_cards, 1000, &result);
+      assert (rc == 0);
+      razz_metrics_exporter_destroy (&exporter);
+      assert (exporter == NULL);
+      f = fopen (path, "r");
+      assert (f != NULL);
+      len = fread (buf, 1, sizeof (buf) - 1, f);
+      buf[len] = '\0';
+      fclose (f);
+      assert (strstr (buf, "\nrazz_games_total 25500\n") != NULL);
+      assert (strstr (buf, "razz_store_") == NULL);
+      unlink (path);
+
+      razz_store_close (&store);
+      unlink (store_path);
+      razz_ctx_destroy (&metered);
+    }
+
+    /* Counter-based dealing is the same for any threads and split */
+    {
+      static struct razz_result whole;
+      static struct razz_result part;
+      static unsigned long low_counts[RAZZ_LOW_INDEX_COUNT];
+      struct simulation_options sim_options;
+      struct razz_ctx_options single_options;
+      razz_ctx *single;
+      int deck;
+      unsigned long k;
+
+      init_razz_ctx_options (&single_options);
+      single_options.thread_count = 1;
+      single_options.chunk_size = 777;
+      single = razz_ctx_create (&single_options);
+      assert (single != NULL);
+
+      init_simulation_options (&sim_options);
+      sim_options.counter_key = 2011;
+      for (deck = 0; deck < 2; deck++)
+	{
+	  sim_options.deck_kind = deck ? RANK_DECK : SUITED_DECK;
+	  sim_options.first_game_index = 0;
+	  rc = razz_ctx_run_with_options (ctx, &decided_cards, 20500,
+					  &sim_options, &whole);
+	  assert (rc == 0);
+
+	  rc = razz_ctx_run_with_options (single, &decided_cards, 20500,
+					  &sim_options, &result);
+	  assert (rc == 0);
+	  assert (memcmp (&result, &whole, sizeof (result)) == 0);
+
+	  memset (low_counts, 0, sizeof (low_counts));
+	  rc = simulate_razz_game_with_options (&decided_cards, 20500,
+						&sim_options, low_counts, NULL,
+						count_low);
+	  assert (rc == 0);
+	  assert (memcmp (low_counts, whole.low_counts,
+			  sizeof (low_counts)) == 0);
+
+	  /* Resuming at game 7000 on another context adds up to the whole */
+	  rc = razz_ctx_run_with_options (single, &decided_cards, 7000,
+					  &sim_options, &result);
+	  assert (rc == 0);
+	  sim_options.first_game_index = 7000;
+	  rc = razz_ctx_run_with_options (ctx, &decided_cards, 13500,
+					  &sim_options, &part);
+	  assert (rc == 0);
+	  for (k = 0; k < RAZZ_LOW_INDEX_COUNT; k++)
+	    {
+	      assert (result.low_counts[k] + part.low_counts[k]
+		      == whole.low_counts[k]);
+	    }
+	}
+
+      /* The batch size of the pipeline does not change the counts */
+      sim_options.first_game_index = 0;
+      for (deck = 0; deck < 3; deck++)
+	{
+	  sim_options.deck_kind = deck == 1 ? RANK_DECK : SUITED_DECK;
+	  sim_options.variant = deck == 2 ? GAME_STUD_HILO8 : GAME_RAZZ;
+	  sim_options.batch_size = 0;
+	  rc = razz_ctx_run_with_options (single, &decided_cards, 5000,
+					  &sim_options, &whole);
+	  assert (rc == 0);
+	  sim_options.batch_size = 1;
+	  rc = razz_ctx_run_with_options (single, &decided_cards, 5000,
+					  &sim_options, &result);
+	  assert (rc == 0);
+	  assert (memcmp (&result, &whole, sizeof (result)) == 0);
+	  sim_options.batch_size = 3000;
+	  rc = razz_ctx_run_with_options (ctx, &decided_cards, 5000,
+					  &sim_options, &result);
+	  assert (rc == 0);
+	  assert (memcmp (&result, &whole, sizeof (result)) == 0);
+	}
+
+      razz_ctx_destroy (&single);
+    }
+
+    /* Progress and cancellation */
+    {
+      struct simulation_options sim_options;
+      struct progress_check check = {0, 0, 2000, 0};
+
+      init_simulation_options (&sim_options);
+      sim_options.progress_listener = check_progress;
+      sim_options.progress_arg = &check;
+      sim_options.progress_interval_games = 500;
+      sim_options.cancel_flag = &check.cancel_flag;
+
+      rc = simulate_razz_game_with_options (&decided_cards, 100000,
+					    &sim_options, NULL, NULL, NULL);
+      assert (rc == RAZZ_CANCELLED);
+      assert (check.game_count == 2500);
+      assert (check.report_count == 5);
+
+      check.report_count = 0;
+      check.game_count = 0;
+      check.cancel_flag = 0;
+      sim_options.deck_kind = RANK_DECK;
+      rc = simulate_razz_game_with_options (&decided_cards, 100000,
+					    &sim_options, NULL, NULL, NULL);
+      assert (rc == RAZZ_CANCELLED);
+      assert (check.game_count == 2500);
+      sim_options.deck_kind = SUITED_DECK;
+
+      check.report_count = 0;
+      check.game_count = 0;
+      check.cancel_at = 10000;
+      check.cancel_flag = 0;
+      sim_options.progress_interval_games = 5000;
+      rc = razz_ctx_run_with_options (ctx, &decided_cards, 10000000,
+				      &sim_options, &result);
+      assert (rc == RAZZ_CANCELLED);
+      assert (check.game_count == result.game_count);
+      assert (result.game_count >= 10000 && result.game_count < 10000000);
+      assert (result.game_count % 1000 == 0);
+
+      check.report_count = 0;
+      check.game_count = 0;
+      check.cancel_at = 20000;
+      check.cancel_flag = 0;
+      rc = razz_ctx_run_with_options (ctx, &decided_cards, 15000,
+				      &sim_options, &result);
+      assert (rc == 0);
+      assert (result.game_count == 15000);
+      assert (check.game_count == 15000);
+      assert (check.report_count >= 1 && check.report_count <= 4);
+    }
+
+    /* Asynchronous jobs */
+    {
+      razz_job *jobs[8];
+      struct pollfd fds[8];
+      unsigned long game_count;
+      int finished_count = 0;
+      int j;
+
+      for (j = 0; j < 8; j++)
+	{
+	  jobs[j] = razz_submit (ctx, &decided_cards, 5000 + j, NULL);
+	  assert (jobs[j] != NULL);
+	  fds[j].fd = razz_job_fd (jobs[j]);
+	  fds[j].events = POLLIN;
+	}
+      while (finished_count != 8)
+	{
+	  rc = poll (fds, 8, -1);
+	  assert (rc > 0);
+	  for (j = 0; j < 8; j++)
+	    {
+	      if (fds[j].fd == -1 || !(fds[j].revents & POLLIN))
+		{
+		  continue;
+		}
+	      rc = razz_poll (jobs[j], &game_count);
+	      assert (rc);
+	      assert (game_count == 5000 + j);
+	      rc = razz_job_result (jobs[j], &result);
+	      assert (rc == 0);
+	      assert (result.game_count == 5000 + j);
+	      razz_job_destroy (&jobs[j]);
+	      assert (jobs[j] == NULL);
+	      fds[j].fd = -1;
+	      finished_count++;
+	    }
+	}
+
+      jobs[0] = razz_submit (ctx, &decided_cards, 100000000, NULL);
+      assert (jobs[0] != NULL);
+      rc = razz_wait (jobs[0], 0);
+      assert (!rc);
+      rc = razz_job_result (jobs[0], &result);
+      assert (rc != 0);
+      razz_cancel (jobs[0]);
+      rc = razz_wait (jobs[0], -1);
+      assert (rc);
+      rc = razz_job_result (jobs[0], &result);
+      assert (rc == RAZZ_CANCELLED);
+      assert (result.game_count < 100000000);
+      assert (result.game_count % 1000 == 0);
+      razz_job_destroy (&jobs[0]);
+
+      jobs[0] = razz_submit (ctx, &decided_cards, 100000000, NULL);
+      assert (jobs[0] != NULL);
+      razz_job_destroy (&jobs[0]);
+      assert (jobs[0] == NULL);
+
+      jobs[0] = razz_submit (ctx, &decided_cards, 0, NULL);
+      assert (jobs[0] == NULL);
+
+      /* Small queries next to a big one */
+      {
+	razz_job *mix[33];
+
+	for (j = 0; j < 33; j++)
+	  {
+	    mix[j] = razz_submit (ctx, &decided_cards,
+				  j == 0 ? 2000000 : 1500, NULL);
+	    assert (mix[j] != NULL);
+	  }
+	for (j = 32; j >= 0; j--)
+	  {
+	    rc = razz_wait (mix[j], -1);
+	    assert (rc);
+	    rc = razz_job_result (mix[j], &result);
+	    assert (rc == 0);
+	    assert (result.game_count == (j == 0 ? 2000000 : 1500));
+	    sum = 0;
+	    for (idx = 0; idx < RAZZ_LOW_INDEX_COUNT; idx++)
+	      {
+		sum += result.low_counts[idx];
+	      }
+	    assert (sum == result.game_count);
+	    razz_job_destroy (&mix[j]);
+	  }
+      }
+    }
+
+    razz_ctx_destroy (&ctx);
+    assert (ctx == NULL);
+
+    /* Workers pinned to the cores of the sockets */
+    {
+      struct cpu_topology t;
+      unsigned int cpus[5];
+      unsigned int j;
+
+      rc = read_cpu_topology (&t);
+      assert (rc == 0);
+      assert (t.cpu_count > 0 && t.package_count > 0);
+      assert (t.cpus[0].is_first_thread);
+      assert (count_worker_cpus (&t, 1) <= count_worker_cpus (&t, 0));
+      assign_worker_cpus (&t, 1, 5, cpus);
+      for (j = 0; j < 5; j++)
+	{
+	  assert (cpus[j] < t.cpu_count);
+	  assert (t.cpus[cpus[j]].is_first_thread);
+	  assert (t.cpus[cpus[j]].package < t.package_count);
+	}
+      release_cpu_topology (&t);
+
+      options.thread_count = 0;
+      options.pin_threads = 1;
+      options.avoid_smt = 1;
+      ctx = razz_ctx_create (&options);
+      assert (ctx != NULL);
+      rc = razz_ctx_run (ctx, &decided_cards, 20500, &result);
+      assert (rc == 0);
+      assert (result.game_count == 20500);
+      sum = 0;
+      for (idx = 0; idx < RAZZ_LOW_INDEX_COUNT; idx++)
+	{
+	  sum += result.low_counts[idx];
+	}
+      assert (sum == result.game_count);
+      razz_ctx_destroy (&ctx);
+    }
+    for (i = 0; i < 3; i++)
+      {
+	destroy_card (&decided_cards.my_cards[i]);
+      }
+    destroy_card (&decided_cards.opponent_cards[0]);
+  }
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,572 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_store.c
+ * @brief The store of the outcome counts of the scenarios on disk.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "razz_store.h"
+
+/** The magic number starting the file of a store. */
+#define RAZZ_STORE_MAGIC "RAZZSTR1"
+
+/** The header of the file of a store. */
+struct store_header
+{
+  char magic[8]; /**< ::RAZZ_STORE_MAGIC. */
+  uint32_t record_size; /**< The size of a record, to reject other layouts. */
+  uint32_t reserved; /**< Zero. */
+};
+
+/** The outcome counts of a canonical scenario as laid out on disk. */
+struct store_record
+{
+  uint64_t known_mask; /**< The known cards of the canonical scenario. */
+  uint64_t my_mask; /**< My cards of the canonical scenario. */
+  uint32_t variant; /**< The game whose outcome is counted. */
+  uint32_t is_complete; /**< Written last, so a torn append is ignored. */
+  uint64_t game_count; /**< The number of games counted. */
+  uint64_t rank_counts[RANK_COUNT]; /**< As in ::razz_result. */
+  uint64_t invalid_rank_count; /**< As in ::razz_result. */
+  uint64_t high_counts[HIGH_CATEGORY_COUNT]; /**< As in ::razz_result. */
+  uint64_t qualified_low_count; /**< As in ::razz_result. */
+};
+
+/** A store. */
+struct razz_store_impl
+{
+  int fd; /**< The file of the store. */
+  unsigned char *map; /**< The mapped file or NULL if nothing is mapped. */
+  size_t map_size; /**< The number of bytes mapped. */
+  unsigned long hit_count; /**< The top-ups needing no simulation. */
+  unsigned long miss_count; /**< The top-ups needing simulation. */
+  unsigned long reused_game_count; /**< The stored games used by top-ups. */
+  unsigned long simulated_game_count; /**< The games simulated by top-ups. */
+};
+
+/**
+ * Maps the whole file of a store again if it has grown, which it does when
+ * this or another process appends.
+ *
+ * @param [in] store the store.
+ *
+ * @return 0 if the file is mapped or non-zero otherwise.
+ */
+static int
+remap_store (struct razz_store_impl *store)
+{
+  struct stat st;
+  void *map;
+
+  if (fstat (store->fd, &st) == -1)
+    {
+      return 1;
+    }
+  if ((size_t) st.st_size == store->map_size)
+    {
+      return 0;
+    }
+
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, store->fd, 0);
+  if (map == MAP_FAILED)
+    {
+      return 1;
+    }
+  if (store->map != NULL)
+    {
+      munmap (store->map, store->map_size);
+    }
+  store->map = map;
+  store->map_size = st.st_size;
+
+  return 0;
+}
+
+razz_store *
+razz_store_open (const char *path)
+{
+  struct razz_store_impl *store;
+  struct store_header header;
+  ssize_t len;
+
+  store = calloc (1, sizeof (*store));
+  if (store == NULL)
+    {
+      return NULL;
+    }
+  store->map = NULL;
+  store->map_size = 0;
+
+  store->fd = open (path, O_RDWR | O_CREAT, 0666);
+  if (store->fd == -1)
+    {
+      perror ("Cannot open the store");
+      free (store);
+      return NULL;
+    }
+
+  flock (store->fd, LOCK_EX);
+  len = pread (store->fd, &header, sizeof (header), 0);
+  if (len == 0)
+    {
+      memset (&header, 0, sizeof (header));
+      memcpy (header.magic, RAZZ_STORE_MAGIC, sizeof (header.magic));
+      header.record_size = sizeof (struct store_record);
+      if (pwrite (store->fd, &header, sizeof (header), 0) != sizeof (header))
+	{
+	  len = -1;
+	}
+      else
+	{
+	  len = sizeof (header);
+	}
+    }
+  flock (store->fd, LOCK_UN);
+
+  if (len != sizeof (header)
+      || memcmp (header.magic, RAZZ_STORE_MAGIC, sizeof (header.magic)) != 0
+      || header.record_size != sizeof (struct store_record)
+      || remap_store (store))
+    {
+      fprintf (stderr, "%s is not a store of this version\n", path);
+      razz_store_close (&store);
+      return NULL;
+    }
+
+  return store;
+}
+
+void
+canonicalize_razz_scenario (const struct razz_scenario *scenario,
+			    enum game_variant variant,
+			    struct razz_scenario *canonical)
+{
+  int r;
+
+  if (variant != GAME_RAZZ)
+    {
+      *canonical = *scenario;
+      return;
+    }
+
+  /* Give my cards of every rank the first suits and the other known cards
+     the next ones */
+  canonical->known_mask = 0;
+  canonical->my_mask = 0;
+  for (r = 0; r < RANK_COUNT; r++)
+    {
+      int my_count = 0;
+      int other_count = 0;
+      int s;
+
+      for (s = 0; s < SUIT_COUNT; s++)
+	{
+	  uint64_t bit = RAZZ_CARD_BIT (s * RANK_COUNT + r);
+
+	  if (scenario->my_mask & bit)
+	    {
+	      my_count++;
+	    }
+	  else if (scenario->known_mask & bit)
+	    {
+	      other_count++;
+	    }
+	}
+
+      for (s = 0; s < my_count + other_count; s++)
+	{
+	  uint64_t bit = RAZZ_CARD_BIT (s * RANK_COUNT + r);
+
+	  canonical->known_mask |= bit;
+	  if (s < my_count)
+	    {
+	      canonical->my_mask |= bit;
+	    }
+	}
+    }
+}
+
+/**
+ * Finds the latest complete record of a canonical scenario in the mapped
+ * part of a store.
+ *
+ * @param [in] store the store.
+ * @param [in] canonical the canonical scenario.
+ * @param [in] variant the game whose outcome is counted.
+ *
+ * @return the record or NULL if there is none.
+ */
+static const struct store_record *
+find_record (const struct razz_store_impl *store,
+	     const struct razz_scenario *canonical, enum game_variant variant)
+{
+  const struct store_record *records;
+  size_t i;
+
+  if (store->map_size < sizeof (struct store_header))
+    {
+      return NULL;
+    }
+  records = (const struct store_record *) (store->map
+					   + sizeof (struct store_header));
+  i = ((store->map_size - sizeof (struct store_header))
+       / sizeof (struct store_record));
+  while (i-- > 0)
+    {
+      if (records[i].is_complete
+	  && records[i].known_mask == canonical->known_mask
+	  && records[i].my_mask == canonical->my_mask
+	  && records[i].variant == variant)
+	{
+	  return &records[i];
+	}
+    }
+
+  return NULL;
+}
+
+/**
+ * Copies the counts of a record into a result, leaving its low counts as they
+ * are.
+ *
+ * @param [in] record the record.
+ * @param [out] result the result.
+ */
+static void
+copy_record_counts (const struct store_record *record,
+		    struct razz_result *result)
+{
+  int i;
+
+  result->game_count = record->game_count;
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      result->rank_counts[i] = record->rank_counts[i];
+    }
+  result->invalid_rank_count = record->invalid_rank_count;
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      result->high_counts[i] = record->high_counts[i];
+    }
+  result->qualified_low_count = record->qualified_low_count;
+}
+
+int
+razz_store_lookup (razz_store *store, const struct razz_scenario *scenario,
+		   enum game_variant variant, struct razz_result *result)
+{
+  const struct store_record *record;
+  struct razz_scenario canonical;
+
+  clear_razz_result (result);
+  canonicalize_razz_scenario (scenario, variant, &canonical);
+  if (remap_store (store))
+    {
+      return 1;
+    }
+  record = find_record (store, &canonical, variant);
+  if (record == NULL)
+    {
+      return 1;
+    }
+  copy_record_counts (record, result);
+
+  return 0;
+}
+
+/**
+ * Appends the outcome counts of a scenario, either replacing the stored
+ * counts or adding to them. The stored counts to add to are read under the
+ * exclusive lock of the file, so the games appended meanwhile by another
+ * process are never lost.
+ *
+ * @param [in] store the store.
+ * @param [in] scenario the scenario, which need not be canonical.
+ * @param [in] variant the game whose outcome is counted.
+ * @param [in] result the counts to be stored or added.
+ * @param [in] is_added non-zero to add the counts to the latest stored ones.
+ * @param [out] stored the counts of the appended record or NULL.
+ *
+ * @return 0 if the counts are appended or non-zero otherwise.
+ */
+static int
+append_counts (struct razz_store_impl *store,
+	       const struct razz_scenario *scenario, enum game_variant variant,
+	       const struct razz_result *result, int is_added,
+	       struct razz_result *stored)
+{
+  struct store_record record;
+  struct razz_scenario canonical;
+  struct stat st;
+  off_t end;
+  int rc = 0;
+  int i;
+
+  canonicalize_razz_scenario (scenario, variant, &canonical);
+  memset (&record, 0, sizeof (record));
+  record.known_mask = canonical.known_mask;
+  record.my_mask = canonical.my_mask;
+  record.variant = variant;
+  record.game_count = result->game_count;
+  for (i = 0; i < RANK_COUNT; i++)
+    {
+      record.rank_counts[i] = result->rank_counts[i];
+    }
+  record.invalid_rank_count = result->invalid_rank_count;
+  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+    {
+      record.high_counts[i] = result->high_counts[i];
+    }
+  record.qualified_low_count = result->qualified_low_count;
+
+  flock (store->fd, LOCK_EX);
+  if (is_added)
+    {
+      const struct store_record *latest = NULL;
+
+      if (remap_store (store) == 0)
+	{
+	  latest = find_record (store, &canonical, variant);
+	}
+      if (latest != NULL)
+	{
+	  record.game_count += latest->game_count;
+	  for (i = 0; i < RANK_COUNT; i++)
+	    {
+	      record.rank_counts[i] += latest->rank_counts[i];
+	    }
+	  record.invalid_rank_count += latest->invalid_rank_count;
+	  for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+	    {
+	      record.high_counts[i] += latest->high_counts[i];
+	    }
+	  record.qualified_low_count += latest->qualified_low_count;
+	}
+    }
+  if (stored != NULL)
+    {
+      copy_record_counts (&record, stored);
+    }
+
+  if (fstat (store->fd, &st) == -1)
+    {
+      rc = 1;
+    }
+  else
+    {
+      /* Overwrite the torn tail of an append that did not finish */
+      end = ((st.st_size - sizeof (struct store_header))
+	     / sizeof (record) * sizeof (record)
+	     + sizeof (struct store_header));
+      if (pwrite (store->fd, &record, sizeof (record), end) != sizeof (record)
+	  || ftruncate (store->fd, end + sizeof (record)) == -1)
+	{
+	  rc = 1;
+	}
+      else
+	{
+	  record.is_complete = 1;
+	  if (pwrite (store->fd, &record.is_complete,
+		      sizeof (record.is_complete),
+		      end + offsetof (struct store_record, is_complete))
+	      != sizeof (record.is_complete))
+	    {
+	      rc = 1;
+	    }
+	}
+    }
+  flock (store->fd, LOCK_UN);
+
+  return rc || remap_store (store);
+}
+
+int
+razz_store_append (razz_store *store, const struct razz_scenario *scenario,
+		   enum game_variant variant, const struct razz_result *result)
+{
+  return append_counts (store, scenario, variant, result, 0, NULL);
+}
+
+int
+razz_store_top_up (razz_store *store, razz_ctx *ctx,
+		   const struct razz_scenario *scenario,
+		   unsigned long game_count,
+		   const struct simulation_options *options,
+		   struct razz_result *result, unsigned long *simulated_count)
+{
+  enum game_variant variant = options->variant;
+  struct simulation_options run_options = *options;
+  struct razz_result *added;
+  int rc;
+
+  if (simulated_count != NULL)
+    {
+      *simulated_count = 0;
+    }
+
+  razz_store_lookup (store, scenario, variant, result);
+  __atomic_fetch_add (&store->reused_game_count, result->game_count,
+		      __ATOMIC_RELAXED);
+  if (result->game_count >= game_count)
+    {
+      __atomic_fetch_add (&store->hit_count, 1, __ATOMIC_RELAXED);
+      return 0;
+    }
+  __atomic_fetch_add (&store->miss_count, 1, __ATOMIC_RELAXED);
+
+  added = malloc (sizeof (*added));
+  if (added == NULL)
+    {
+      return 1;
+    }
+  /* The stored games of a counter key are its first streams, so deal the
+     next ones instead of counting the same games twice */
+  if (run_options.counter_key != 0)
+    {
+      run_options.first_game_index += result->game_count;
+    }
+  rc = razz_ctx_run_scenario (ctx, scenario, game_count - result->game_count,
+			      &run_options, added);
+  if (rc == 0 || rc == RAZZ_CANCELLED)
+    {
+      if (simulated_count != NULL)
+	{
+	  *simulated_count = added->game_count;
+	}
+      __atomic_fetch_add (&store->simulated_game_count, added->game_count,
+			  __ATOMIC_RELAXED);
+
+      /* Add only the games of this call to whatever is stored by now,
+	 which includes the games of any concurrent top-up */
+      if (added->game_count != 0
+	  && append_counts (store, scenario, variant, added, 1, result))
+	{
+	  fprintf (stderr, "Cannot append to the store\n");
+	  rc = 1;
+	}
+      memcpy (result->low_counts, added->low_counts,
+	      sizeof (result->low_counts));
+    }
+  free (added);
+
+  return rc;
+}
+
+/**
+ * Raises the largest variance of an outcome seen so far with the variance of
+ * the frequency of another outcome.
+ *
+ * @param [in] largest the largest variance so far.
+ * @param [in] count the number of games having the outcome.
+ * @param [in] game_count the number of games.
+ *
+ * @return the larger of the two variances.
+ */
+static double
+raise_variance (double largest, unsigned long count, unsigned long game_count)
+{
+  double p = (double) count / game_count;
+  double variance = p * (1 - p);
+
+  return variance > largest ? variance : largest;
+}
+
+unsigned long
+get_razz_game_count_for_precision (const struct razz_result *result,
+				   enum game_variant variant,
+				   double std_error)
+{
+  double variance = 0;
+  int i;
+
+  if (!(std_error > 0))
+    {
+      return 0;
+    }
+
+  if (result->game_count == 0)
+    {
+      variance = 0.25;
+    }
+  else if (variant == GAME_RAZZ)
+    {
+      for (i = 0; i < RANK_COUNT; i++)
+	{
+	  variance = raise_variance (variance, result->rank_counts[i],
+				     result->game_count);
+	}
+      variance = raise_variance (variance, result->invalid_rank_count,
+				 result->game_count);
+    }
+  else
+    {
+      for (i = 0; i < HIGH_CATEGORY_COUNT; i++)
+	{
+	  variance = raise_variance (variance, result->high_counts[i],
+				     result->game_count);
+	}
+      if (variant == GAME_STUD_HILO8)
+	{
+	  variance = raise_variance (variance, result->qualified_low_count,
+				     result->game_count);
+	}
+    }
+
+  return (unsigned long) (variance / (std_error * std_error)) + 1;
+}
+
+void
+razz_store_get_metrics (razz_store *store, struct razz_store_metrics *metrics)
+{
+  metrics->hit_count = __atomic_load_n (&store->hit_count, __ATOMIC_RELAXED);
+  metrics->miss_count = __atomic_load_n (&store->miss_count, __ATOMIC_RELAXED);
+  metrics->reused_game_count = __atomic_load_n (&store->reused_game_count,
+						__ATOMIC_RELAXED);
+  metrics->simulated_game_count
+    = __atomic_load_n (&store->simulated_game_count, __ATOMIC_RELAXED);
+}
+
+void
+razz_store_close (razz_store **store_ptr)
+{
+  struct razz_store_impl *store = *store_ptr;
+
+  if (store == NULL)
+    {
+      return;
+    }
+
+  if (store->map != NULL)
+    {
+      munmap (store->map, store->map_size);
+    }
+  if (store->fd != -1)
+    {
+      close (store->fd);
+    }
+  free (store);
+  *store_ptr = NULL;
+}
@@ -0,0 +1,177 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_store.h
+ * @brief The store of the outcome counts of the scenarios on disk.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include "razz_simulation.h"
+
+#ifndef RAZZ_STORE_H
+#define RAZZ_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * An append-only file of outcome counts keyed by canonical scenario, which is
+ * memory-mapped for the lookups. Topping up a scenario appends a new record
+ * holding the merged counts, so the latest record of a key wins and a record
+ * is never rewritten. Several processes may share a store because every
+ * append is done under an exclusive lock of the file.
+ */
+typedef struct razz_store_impl razz_store;
+
+/**
+ * Opens a store, creating an empty one if the file does not exist. The
+ * returned store has to be closed with razz_store_close().
+ *
+ * @param [in] path the file of the store.
+ *
+ * @return the store or NULL if the file cannot be opened or is not a store.
+ */
+razz_store *
+razz_store_open (const char *path);
+
+/**
+ * Turns a scenario into the one under which its outcome counts are stored.
+ * The suits of the cards do not matter to Razz, so two Razz scenarios with
+ * the same ranks share one canonical scenario.
+ *
+ * @param [in] scenario the scenario.
+ * @param [in] variant the game whose outcome is counted.
+ * @param [out] canonical the canonical scenario.
+ */
+void
+canonicalize_razz_scenario (const struct razz_scenario *scenario,
+			    enum game_variant variant,
+			    struct razz_scenario *canonical);
+
+/**
+ * Looks up the latest outcome counts of a scenario. Only the game count, the
+ * rank counts, the high counts and the qualified low count are stored; the
+ * low counts of the result are set to zero.
+ *
+ * @param [in] store the store.
+ * @param [in] scenario the scenario, which need not be canonical.
+ * @param [in] variant the game whose outcome is counted.
+ * @param [out] result the stored counts or zero counts if there are none.
+ *
+ * @return 0 if the scenario is stored or non-zero otherwise.
+ */
+int
+razz_store_lookup (razz_store *store, const struct razz_scenario *scenario,
+		   enum game_variant variant, struct razz_result *result);
+
+/**
+ * Appends the outcome counts of a scenario, which replace those stored
+ * earlier for the same canonical scenario.
+ *
+ * @param [in] store the store.
+ * @param [in] scenario the scenario, which need not be canonical.
+ * @param [in] variant the game whose outcome is counted.
+ * @param [in] result the counts to be stored.
+ *
+ * @return 0 if the counts are appended or non-zero otherwise.
+ */
+int
+razz_store_append (razz_store *store, const struct razz_scenario *scenario,
+		   enum game_variant variant, const struct razz_result *result);
+
+/**
+ * Brings the stored outcome counts of a scenario up to a number of games by
+ * simulating only the missing games on a context, then adds them to the
+ * counts stored by the time they are appended, so the games of a concurrent
+ * top-up by another process are kept too. Nothing is simulated or appended if
+ * the store already has enough games. The games simulated before a
+ * cancellation are still stored.
+ *
+ * @param [in] store the store.
+ * @param [in] ctx the context whose workers run the missing games.
+ * @param [in] scenario the cards that will not be included in the simulated
+ *                      dealing.
+ * @param [in] game_count the number of games the counts should cover.
+ * @param [in] options the options of the run, whose variant also selects
+ *                     the stored counts. With a counter key, the stored
+ *                     games are taken to be the streams from the first game
+ *                     index on, so the missing games are dealt from the
+ *                     streams that follow them.
+ * @param [out] result the stored counts after this call whose low counts
+ *                     cover only the games simulated by this call.
+ * @param [out] simulated_count the number of games simulated by this call or
+ *                              NULL.
+ *
+ * @return 0 if the counts cover the games, ::RAZZ_CANCELLED if the
+ *         simulation is cancelled or another non-zero value if it encounters
+ *         an error.
+ */
+int
+razz_store_top_up (razz_store *store, razz_ctx *ctx,
+		   const struct razz_scenario *scenario,
+		   unsigned long game_count,
+		   const struct simulation_options *options,
+		   struct razz_result *result, unsigned long *simulated_count);
+
+/**
+ * Estimates the number of games needed for the probability of every outcome
+ * of a variant to have at most a given standard error, using the outcome
+ * frequencies of a result or the worst case if the result has no games.
+ *
+ * @param [in] result the counts estimating the outcome probabilities.
+ * @param [in] variant the game whose outcomes are considered.
+ * @param [in] std_error the largest standard error allowed.
+ *
+ * @return the number of games or 0 if the standard error is not positive.
+ */
+unsigned long
+get_razz_game_count_for_precision (const struct razz_result *result,
+				   enum game_variant variant,
+				   double std_error);
+
+/** The counters of the top-ups of a store, which only grow. */
+struct razz_store_metrics
+{
+  unsigned long hit_count; /**< The top-ups needing no simulation. */
+  unsigned long miss_count; /**< The top-ups needing simulation. */
+  unsigned long reused_game_count; /**< The stored games used by top-ups. */
+  unsigned long simulated_game_count; /**< The games simulated by top-ups. */
+};
+
+/**
+ * Reads the counters of the top-ups done on a store by this process.
+ *
+ * @param [in] store the store.
+ * @param [out] metrics the counters of the store.
+ */
+void
+razz_store_get_metrics (razz_store *store, struct razz_store_metrics *metrics);
+
+/**
+ * Unmaps and closes a store as well as setting the pointer to NULL as a safe
+ * guard.
+ *
+ * @param [in] store_ptr the pointer pointing to the store to be closed.
+ */
+void
+razz_store_close (razz_store **store_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_STORE_H */
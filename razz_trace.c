@@ -0,0 +1,267 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_trace.c
+ * @brief The timeline of the simulating threads in Chrome trace format.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "razz_trace.h"
+
+/** A span of time recorded by a thread. */
+struct trace_span
+{
+  const char *category; /**< The category of the span. */
+  const char *name; /**< The name of the span. */
+  uint64_t start_ns; /**< The start of the span. */
+  uint64_t duration_ns; /**< The length of the span. */
+  unsigned long value; /**< The number shown with the span. */
+};
+
+/** The spans of one thread. */
+struct trace_ring
+{
+  struct trace_ring *next; /**< The ring of another thread. */
+  long tid; /**< The kernel ID of the thread. */
+  char name[32]; /**< The name of the thread or an empty string. */
+  unsigned long recorded_count; /**< The number of spans ever recorded. */
+  struct trace_span spans[]; /**< The spans indexed modulo the capacity. */
+};
+
+/** A tracer. */
+struct razz_tracer_impl
+{
+  unsigned long id; /**< Distinguishes the tracer from destroyed ones. */
+  unsigned long ring_capacity; /**< The number of spans per ring. */
+  uint64_t origin_ns; /**< The time the tracer was created. */
+  pthread_mutex_t lock; /**< Protects the list of rings. */
+  struct trace_ring *rings; /**< The rings of the threads. */
+};
+
+/** The source of the tracer IDs. */
+static unsigned long next_tracer_id = 1;
+
+/** The ID of the tracer whose ring the calling thread has cached. */
+static __thread unsigned long cached_tracer_id;
+
+/** The ring of the calling thread in the cached tracer. */
+static __thread struct trace_ring *cached_ring;
+
+razz_tracer *
+razz_tracer_create (unsigned long ring_capacity)
+{
+  struct razz_tracer_impl *t;
+
+  t = malloc (sizeof (*t));
+  if (t == NULL)
+    {
+      return NULL;
+    }
+
+  t->id = __atomic_fetch_add (&next_tracer_id, 1, __ATOMIC_RELAXED);
+  t->ring_capacity = (ring_capacity == 0
+		      ? DEFAULT_TRACE_RING_CAPACITY : ring_capacity);
+  t->origin_ns = razz_trace_now ();
+  pthread_mutex_init (&t->lock, NULL);
+  t->rings = NULL;
+
+  return t;
+}
+
+uint64_t
+razz_trace_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Finds the ring of the calling thread creating it on first use. The ring is
+ * allocated by the thread itself, so its memory is local to the thread. A
+ * thread switching between tracers finds its ring again by its kernel ID.
+ *
+ * @param [in] t the tracer.
+ *
+ * @return the ring or NULL if it cannot be allocated.
+ */
+static struct trace_ring *
+get_ring (struct razz_tracer_impl *t)
+{
+  struct trace_ring *ring;
+  long tid;
+
+  if (cached_tracer_id == t->id)
+    {
+      return cached_ring;
+    }
+
+  tid = syscall (SYS_gettid);
+  pthread_mutex_lock (&t->lock);
+  for (ring = t->rings; ring != NULL && ring->tid != tid; ring = ring->next)
+    {
+    }
+  pthread_mutex_unlock (&t->lock);
+  if (ring != NULL)
+    {
+      cached_tracer_id = t->id;
+      cached_ring = ring;
+      return ring;
+    }
+
+  ring = malloc (sizeof (*ring) + t->ring_capacity * sizeof (ring->spans[0]));
+  if (ring == NULL)
+    {
+      return NULL;
+    }
+  ring->tid = tid;
+  ring->name[0] = '\0';
+  ring->recorded_count = 0;
+
+  pthread_mutex_lock (&t->lock);
+  ring->next = t->rings;
+  t->rings = ring;
+  pthread_mutex_unlock (&t->lock);
+
+  cached_tracer_id = t->id;
+  cached_ring = ring;
+
+  return ring;
+}
+
+void
+razz_trace_span (razz_tracer *t, const char *category, const char *name,
+		 uint64_t start_ns, unsigned long value)
+{
+  struct trace_ring *ring;
+  struct trace_span *span;
+
+  if (t == NULL || (ring = get_ring (t)) == NULL)
+    {
+      return;
+    }
+
+  span = &ring->spans[ring->recorded_count++ % t->ring_capacity];
+  span->category = category;
+  span->name = name;
+  span->start_ns = start_ns;
+  span->duration_ns = razz_trace_now () - start_ns;
+  span->value = value;
+}
+
+void
+razz_trace_thread_name (razz_tracer *t, const char *name)
+{
+  struct trace_ring *ring;
+
+  if (t == NULL || (ring = get_ring (t)) == NULL)
+    {
+      return;
+    }
+
+  snprintf (ring->name, sizeof (ring->name), "%s", name);
+}
+
+int
+razz_tracer_write (razz_tracer *t, const char *path)
+{
+  const struct trace_ring *ring;
+  const char *separator = "";
+  long pid = getpid ();
+  FILE *f;
+  int rc;
+
+  f = fopen (path, "w");
+  if (f == NULL)
+    {
+      return 1;
+    }
+
+  fprintf (f, "{\"traceEvents\":[");
+  pthread_mutex_lock (&t->lock);
+  for (ring = t->rings; ring != NULL; ring = ring->next)
+    {
+      unsigned long first = 0;
+      unsigned long i;
+
+      if (ring->name[0] != '\0')
+	{
+	  fprintf (f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,"
+		   "\"tid\":%ld,\"args\":{\"name\":\"%s\"}}",
+		   separator, pid, ring->tid, ring->name);
+	  separator = ",";
+	}
+
+      /* Only the latest spans of a ring that has wrapped are left */
+      if (ring->recorded_count > t->ring_capacity)
+	{
+	  first = ring->recorded_count - t->ring_capacity;
+	}
+      for (i = first; i < ring->recorded_count; i++)
+	{
+	  const struct trace_span *span = &ring->spans[i % t->ring_capacity];
+
+	  fprintf (f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+		   "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%ld,"
+		   "\"args\":{\"value\":%lu}}",
+		   separator, span->name, span->category,
+		   (span->start_ns - t->origin_ns) / 1e3,
+		   span->duration_ns / 1e3, pid, ring->tid, span->value);
+	  separator = ",";
+	}
+    }
+  pthread_mutex_unlock (&t->lock);
+  fprintf (f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  rc = ferror (f);
+  if (fclose (f) != 0)
+    {
+      rc = 1;
+    }
+
+  return rc;
+}
+
+void
+razz_tracer_destroy (razz_tracer **t_ptr)
+{
+  struct razz_tracer_impl *t = *t_ptr;
+  struct trace_ring *ring;
+
+  if (t == NULL)
+    {
+      return;
+    }
+
+  while ((ring = t->rings) != NULL)
+    {
+      t->rings = ring->next;
+      free (ring);
+    }
+  pthread_mutex_destroy (&t->lock);
+  free (t);
+  *t_ptr = NULL;
+}
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file razz_trace.h
+ * @brief The timeline of the simulating threads in Chrome trace format.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#ifndef RAZZ_TRACE_H
+#define RAZZ_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A tracer recording spans of time into a ring buffer per thread. A thread
+ * only ever writes to its own ring, so recording a span takes no lock once
+ * the ring of the thread exists. A full ring overwrites its oldest spans.
+ */
+typedef struct razz_tracer_impl razz_tracer;
+
+/** The number of spans a ring holds by default. */
+#define DEFAULT_TRACE_RING_CAPACITY 65536
+
+/**
+ * Creates a tracer. The returned tracer has to be freed with
+ * razz_tracer_destroy().
+ *
+ * @param [in] ring_capacity the number of spans each thread keeps or 0 for
+ *                           ::DEFAULT_TRACE_RING_CAPACITY.
+ *
+ * @return the tracer or NULL if it cannot be created.
+ */
+razz_tracer *
+razz_tracer_create (unsigned long ring_capacity);
+
+/**
+ * Returns the current time on the clock of the spans.
+ *
+ * @return the number of nanoseconds since an arbitrary point in time.
+ */
+uint64_t
+razz_trace_now (void);
+
+/**
+ * Records a span from a point in time until now in the ring of the calling
+ * thread. Nothing is recorded if the ring cannot be allocated.
+ *
+ * @param [in] t the tracer or NULL to record nothing.
+ * @param [in] category the category of the span, which must be a string
+ *                      that outlives the tracer (e.g., a literal).
+ * @param [in] name the name of the span with the same lifetime.
+ * @param [in] start_ns the start of the span from razz_trace_now().
+ * @param [in] value a number shown with the span (e.g., a game count).
+ */
+void
+razz_trace_span (razz_tracer *t, const char *category, const char *name,
+		 uint64_t start_ns, unsigned long value);
+
+/**
+ * Names the calling thread in the timeline.
+ *
+ * @param [in] t the tracer or NULL to do nothing.
+ * @param [in] name the name, which is copied.
+ */
+void
+razz_trace_thread_name (razz_tracer *t, const char *name);
+
+/**
+ * Writes the spans of every thread as Chrome trace-event JSON, which can be
+ * loaded into chrome://tracing or Perfetto. No thread may record spans at the
+ * same time.
+ *
+ * @param [in] t the tracer.
+ * @param [in] path the file to be written.
+ *
+ * @return 0 if the file is written or non-zero otherwise.
+ */
+int
+razz_tracer_write (razz_tracer *t, const char *path);
+
+/**
+ * Reclaims the memory of a tracer and its rings as well as setting the
+ * pointer to NULL as a safe guard. No thread may record spans any longer.
+ *
+ * @param [in] t_ptr the pointer pointing to the tracer to be freed.
+ */
+void
+razz_tracer_destroy (razz_tracer **t_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZZ_TRACE_H */
@@ -0,0 +1,260 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "rng.h"
+
+/** A buffered random number generator. */
+struct rng_impl
+{
+  uint32_t s[4][RNG_LANE_COUNT]; /**<
+				  * The xoshiro128++ states of all lanes laid
+				  * out word by word so that each word of all
+				  * lanes is contiguous.
+				  */
+  unsigned int pos; /**< The position of the next unused buffered number. */
+  unsigned int end; /**< The number of buffered numbers. */
+  int is_counter; /**< Non-zero if the generator is counter-based. */
+  uint32_t key[2]; /**< The Philox key of a counter-based generator. */
+  uint32_t counter[4]; /**<
+			* The next Philox counter of a counter-based generator
+			* whose first two words count the blocks of the stream
+			* in the last two words.
+			*/
+  uint32_t buffer[RNG_BUFFER_SIZE]; /**< The generated numbers. */
+};
+
+/**
+ * Advances a 64-bit SplitMix generator used to seed the lanes.
+ *
+ * @param [in,out] state the state of the SplitMix generator.
+ *
+ * @return the next 64-bit number.
+ */
+static uint64_t
+splitmix64 (uint64_t *state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+  return z ^ (z >> 31);
+}
+
+/**
+ * Refills the buffer with the next ::RNG_BUFFER_SIZE numbers. The inner loop
+ * over the lanes has no dependency between its iterations.
+ *
+ * @param [in] r the generator whose buffer is to be refilled.
+ */
+static void
+refill (rng *r)
+{
+  uint32_t *s0 = r->s[0];
+  uint32_t *s1 = r->s[1];
+  uint32_t *s2 = r->s[2];
+  uint32_t *s3 = r->s[3];
+  unsigned int i;
+  int l;
+
+  for (i = 0; i < RNG_BUFFER_SIZE; i += RNG_LANE_COUNT)
+    {
+      for (l = 0; l < RNG_LANE_COUNT; l++)
+	{
+	  uint32_t sum = s0[l] + s3[l];
+	  uint32_t t = s1[l] << 9;
+
+	  r->buffer[i + l] = ((sum << 7) | (sum >> 25)) + s0[l];
+
+	  s2[l] ^= s0[l];
+	  s3[l] ^= s1[l];
+	  s1[l] ^= s2[l];
+	  s0[l] ^= s3[l];
+	  s2[l] ^= t;
+	  s3[l] = (s3[l] << 11) | (s3[l] >> 21);
+	}
+    }
+
+  r->pos = 0;
+}
+
+void
+philox4x32 (const uint32_t counter[4], const uint32_t key[2],
+	    uint32_t out[4])
+{
+  uint32_t c0 = counter[0];
+  uint32_t c1 = counter[1];
+  uint32_t c2 = counter[2];
+  uint32_t c3 = counter[3];
+  uint32_t k0 = key[0];
+  uint32_t k1 = key[1];
+  int round;
+
+  for (round = 0; round < 10; round++)
+    {
+      uint64_t p0 = (uint64_t) 0xD2511F53 * c0;
+      uint64_t p1 = (uint64_t) 0xCD9E8D57 * c2;
+
+      c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+      c1 = (uint32_t) p1;
+      c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+      c3 = (uint32_t) p0;
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+/**
+ * Refills the buffer of a counter-based generator with the next
+ * ::RNG_COUNTER_BLOCK_COUNT blocks of its stream.
+ *
+ * @param [in] r the generator whose buffer is to be refilled.
+ */
+static void
+refill_counter (rng *r)
+{
+  int b;
+
+  for (b = 0; b < RNG_COUNTER_BLOCK_COUNT; b++)
+    {
+      philox4x32 (r->counter, r->key, &r->buffer[b * 4]);
+      if (++r->counter[0] == 0)
+	{
+	  r->counter[1]++;
+	}
+    }
+
+  r->pos = 0;
+}
+
+rng *
+create_rng (uint64_t seed)
+{
+  struct rng_impl *r;
+  uint64_t state = seed;
+  int l;
+
+  r = malloc (sizeof (*r));
+  if (r == NULL)
+    {
+      return NULL;
+    }
+
+  for (l = 0; l < RNG_LANE_COUNT; l++)
+    {
+      uint64_t a = splitmix64 (&state);
+      uint64_t b = splitmix64 (&state);
+
+      r->s[0][l] = a;
+      r->s[1][l] = a >> 32;
+      r->s[2][l] = b;
+      r->s[3][l] = (b >> 32) | 1; /* never all zero */
+    }
+
+  r->end = RNG_BUFFER_SIZE;
+  r->is_counter = 0;
+  refill (r);
+
+  return r;
+}
+
+rng *
+create_counter_rng (uint64_t key)
+{
+  struct rng_impl *r;
+
+  r = malloc (sizeof (*r));
+  if (r == NULL)
+    {
+      return NULL;
+    }
+
+  r->end = RNG_COUNTER_BLOCK_COUNT * 4;
+  r->is_counter = 1;
+  rng_seek (r, key, 0);
+
+  return r;
+}
+
+void
+rng_seek (rng *r, uint64_t key, uint64_t stream)
+{
+  r->key[0] = key;
+  r->key[1] = key >> 32;
+  r->counter[0] = 0;
+  r->counter[1] = 0;
+  r->counter[2] = stream;
+  r->counter[3] = stream >> 32;
+  refill_counter (r);
+}
+
+uint32_t
+rng_next (rng *r)
+{
+  if (r->pos == r->end)
+    {
+      if (r->is_counter)
+	{
+	  refill_counter (r);
+	}
+      else
+	{
+	  refill (r);
+	}
+    }
+
+  return r->buffer[r->pos++];
+}
+
+uint32_t
+rng_below (rng *r, uint32_t n)
+{
+  uint64_t m = (uint64_t) rng_next (r) * n;
+  uint32_t low = m;
+
+  if (low < n)
+    {
+      uint32_t threshold = -n % n;
+
+      while (low < threshold)
+	{
+	  m = (uint64_t) rng_next (r) * n;
+	  low = m;
+	}
+    }
+
+  return m >> 32;
+}
+
+void
+destroy_rng (rng **r_ptr)
+{
+  if (*r_ptr == NULL)
+    {
+      return;
+    }
+
+  free (*r_ptr);
+  *r_ptr = NULL;
+}
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * Copyright (C) 2010 Tadeus Prastowo (eus@member.fsf.org)                   *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file rng.h
+ * @brief A buffered random number generator for dealing cards.
+ * @author Tadeus Prastowo <eus@member.fsf.org>
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#ifndef RNG_H
+#define RNG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The number of independent generator lanes advanced together. */
+#define RNG_LANE_COUNT 8
+
+/** The number of random numbers generated at once into the buffer. */
+#define RNG_BUFFER_SIZE 2048
+
+/** The number of Philox blocks generated at once by a counter-based rng. */
+#define RNG_COUNTER_BLOCK_COUNT 1
+
+/**
+ * A random number generator that fills a buffer of ::RNG_BUFFER_SIZE uniform
+ * 32-bit numbers at once using ::RNG_LANE_COUNT xoshiro128++ generators that
+ * are advanced in lockstep so that the compiler can vectorize the refill.
+ * Unlike lrand48(), each generator has its own state, so different threads
+ * can use different generators concurrently.
+ *
+ * A counter-based generator instead encrypts a counter with Philox4x32-10
+ * under a key. Its numbers are divided into streams (e.g., one per game) and
+ * any stream can be started in constant time, so the numbers of a stream do
+ * not depend on which generator or thread produces them.
+ */
+typedef struct rng_impl rng;
+
+/**
+ * Creates a random number generator. The returned generator has to be freed
+ * with destroy_rng().
+ *
+ * @param [in] seed the seed of the generator. The same seed always produces
+ *                  the same sequence.
+ *
+ * @return the generator or NULL if it cannot be created.
+ */
+rng *
+create_rng (uint64_t seed);
+
+/**
+ * Creates a counter-based random number generator positioned at the start
+ * of stream 0. The returned generator has to be freed with destroy_rng().
+ *
+ * @param [in] key the key of the generator.
+ *
+ * @return the generator or NULL if it cannot be created.
+ */
+rng *
+create_counter_rng (uint64_t key);
+
+/**
+ * Positions a counter-based generator at the start of a stream under a key.
+ * The same key and stream always produce the same sequence.
+ *
+ * @param [in] r the counter-based generator.
+ * @param [in] key the key of the stream.
+ * @param [in] stream the index of the stream.
+ */
+void
+rng_seek (rng *r, uint64_t key, uint64_t stream);
+
+/**
+ * Encrypts a counter with the Philox4x32-10 block cipher of Salmon et al.,
+ * which is the block function of a counter-based generator.
+ *
+ * @param [in] counter the counter.
+ * @param [in] key the key.
+ * @param [out] out the four random numbers of the counter.
+ */
+void
+philox4x32 (const uint32_t counter[4], const uint32_t key[2],
+	    uint32_t out[4]);
+
+/**
+ * Returns the next uniform 32-bit random number.
+ *
+ * @param [in] r the generator to draw from.
+ *
+ * @return the random number.
+ */
+uint32_t
+rng_next (rng *r);
+
+/**
+ * Returns a uniform random number below the bound using Lemire's
+ * multiply-and-shift range reduction, which rejects the few biased outcomes
+ * instead of taking the biased modulo.
+ *
+ * @param [in] r the generator to draw from.
+ * @param [in] n the number of possible outcomes (must not be 0).
+ *
+ * @return a random number between 0 inclusive and n exclusive.
+ */
+uint32_t
+rng_below (rng *r, uint32_t n);
+
+/**
+ * Reclaims the memory space that was allocated for the generator as well as
+ * setting the pointer to NULL as a safe guard. Passing a pointer to NULL is
+ * safe but not a NULL pointer.
+ *
+ * @param [in] r_ptr the pointer pointing to the generator to be freed.
+ */
+void
+destroy_rng (rng **r_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RNG_H */